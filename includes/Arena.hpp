@@ -0,0 +1,57 @@
+#ifndef ARENA_HPP
+#define ARENA_HPP
+
+#include <cstddef>
+#include <deque>
+#include <string>
+
+// Scratch memory for one request: dispatch and CGI setup take what they need
+// from it and nothing is freed piecemeal; reset() hands everything back at
+// once when the request is over. Two kinds of storage:
+//  - raw bytes from bump-allocated blocks, for C strings and pointer arrays
+//    (the CGI argv/envp). reset() keeps the first block, so a connection
+//    that stays under it never calls malloc again.
+//  - std::string slots for the path helpers that work on strings. A slot is
+//    cleared when handed out but keeps its capacity, so once a connection
+//    has seen its first request the same paths cost no allocation.
+// Anything taken from the arena is only valid until the next reset().
+class Arena
+{
+	public:
+	explicit Arena(size_t blockSize = 4096);
+	~Arena();
+
+	void *alloc(size_t n);  // pointer-aligned
+	// NUL-terminated copies.
+	char *dup(const char *p, size_t n);
+	char *dup(const std::string &s);
+	char *concat(const char *a, const std::string &b);
+
+	std::string &str();     // empty string, valid until reset()
+
+	void reset();    // keeps the first block and the slots
+	void release();  // gives all of it back
+	size_t capacity() const;
+
+	private:
+	struct Block
+	{
+		Block  *next;
+		size_t size;  // usable bytes after the header
+		size_t used;
+	};
+
+	Block                   *m_first;
+	Block                   *m_cur;
+	size_t                  m_blockSize;
+	std::deque<std::string> m_strings;  // deque: slots never move
+	size_t                  m_stringsUsed;
+
+	static char *payload(Block *b);
+	Block *newBlock(size_t size);
+
+	Arena(const Arena &src);
+	Arena &operator=(const Arena &src);
+};
+
+#endif
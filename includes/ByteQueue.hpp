@@ -0,0 +1,43 @@
+#ifndef BYTEQUEUE_HPP
+#define BYTEQUEUE_HPP
+
+#include <string>
+
+// Bytes received but not parsed yet (a connection's input, a CGI's stdin).
+// Taking bytes off the front moves a cursor instead of erasing them; the
+// dead prefix is reclaimed for free when the queue drains, or by one memmove
+// once it outweighs the live bytes and the tail is out of room. Pipelined
+// requests or a body consumed in small steps therefore cost O(n) overall
+// instead of a memmove of everything left behind per step. The live bytes
+// stay contiguous, so parsers still see one flat buffer.
+class ByteQueue
+{
+	public:
+	ByteQueue();
+
+	const char *data() const;   // first unconsumed byte
+	size_t size() const;
+	bool empty() const;
+	size_t capacity() const;    // storage held
+
+	void append(const char *p, size_t n);
+	// `n` writable bytes right after the data, to read() into; commit() says
+	// how many were filled. Storage only grows (and is zeroed) when needed.
+	char *prepare(size_t n);
+	void commit(size_t n);
+	void consume(size_t n);
+
+	// Takes the contents of `data` and leaves it empty.
+	void assignSwap(std::string &data);
+	void clear();    // keeps the storage
+	void release();  // and gives it back
+
+	private:
+	std::string m_buf;
+	size_t      m_head;  // consume cursor
+	size_t      m_tail;  // end of the live bytes
+
+	void makeRoom(size_t n);
+};
+
+#endif
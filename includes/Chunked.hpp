@@ -25,6 +25,7 @@ class ChunkedDecoder
 
 	public:
 	ChunkedDecoder();
+	void reset(); // ready for the next message, buffers keep their capacity
 
 	// Main function, feed update m_state and return how many bytes were consumed from buf
 	size_t feed(const char *buf, size_t len, size_t max_body_size);
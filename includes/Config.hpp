@@ -6,6 +6,9 @@
 # include <set>
 # include <map>
 
+# include "MimeTypes.hpp"
+# include "RouteTrie.hpp"
+
 struct RouteConfig
 {
     std::string path;
@@ -21,6 +24,10 @@ struct RouteConfig
     size_t      cgi_timeout_ms;
     size_t      cgi_max_output_bytes;
     std::vector<std::string> cgi_pass_env;
+    std::string fastcgi_pass;  // socket path of a FastCGI application, "" = fork per request
+    size_t      cgi_workers;              // pre-forked interpreters, 0 = fork per request
+    size_t      cgi_worker_max_requests;  // recycle a worker after this many, 0 = never
+    std::vector<std::string> cgi_worker;  // its command; speaks FastCGI on fd 0
     
     RouteConfig();
 };
@@ -29,19 +36,34 @@ struct ServerConfig
 {
     std::string host;
     int         port;
-    std::string server_name;
+    std::string server_name;  // first of server_names
+    std::vector<std::string> server_names;  // exact, "*.suffix" or ".both"
     std::string root;
     std::string index;
     std::map<int, std::string> error_pages;
     std::vector<RouteConfig> routes;
+    RouteTrie   routeTrie;  // over routes, see compileRoutes()
     size_t client_max_body_size;
 
     ServerConfig();
+    // (Re)build routeTrie; findMatchingLocation scans linearly until then.
+    void compileRoutes();
 };
 
+// Global (outside any server block) settings
 struct Config
 {
     std::vector<ServerConfig> servers;
+    std::string event_backend; // "epoll", "poll" or empty for best available
+    size_t worker_processes;   // 1 = single process, N = N forked event loops
+    size_t file_cache_entries; // open-file/stat cache size, 0 disables it
+    size_t file_cache_valid_ms; // re-stat cached entries after this long
+    size_t content_cache_bytes; // in-memory small file budget, 0 disables it
+    size_t content_cache_max_file; // larger files always go through sendfile
+    size_t io_budget_bytes;    // per connection per readiness event, 0 = no cap
+    MimeTypes types;           // built-in + types {} / types_file, compiled
+
+    Config();
 };
 
 #endif
\ No newline at end of file
@@ -15,6 +15,7 @@ class ConfigParser
 	private:
 	std::string m_filePath;
 	std::vector<ServerConfig> m_servers;
+	Config m_config; // global directives, servers copied in at the end of parse()
 
 	void parse();                    // Parses entire file
 	//void parseServer(std::istream&); // Parses a single `server` block
@@ -24,6 +25,7 @@ class ConfigParser
 	// Recursively parses a server block from tokens.
 	ServerConfig parseServerBlock(const std::vector<Token>& tokens, size_t &current);
 	RouteConfig parseLocationBlock(const std::vector <Token>& tokens, size_t &current);
+	void parseGlobalDirective(const std::vector<Token>& tokens, size_t &current);
 
 	public:
 	ConfigParser();
@@ -33,6 +35,7 @@ class ConfigParser
 	~ConfigParser();
 
 	const std::vector<ServerConfig> &getServers() const;
+	const Config &getConfig() const;
 };
 
 	//some printer for debug
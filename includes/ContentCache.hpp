@@ -0,0 +1,80 @@
+#ifndef CONTENTCACHE_HPP
+#define CONTENTCACHE_HPP
+
+#include <string>
+#include <vector>
+
+#include "FileCache.hpp"
+
+// Small files kept in memory, ready to send: `head` is the prebuilt status
+// line + entity headers (no blank line, no Connection header) and `body` the
+// file bytes. Entries are checked against the FileInfo the caller got from
+// FileCache, so a changed mtime/size/inode is a miss and the stale copy is
+// dropped. Bounded by a byte budget, least recently used goes first.
+class ContentCache
+{
+	public:
+	struct Entry
+	{
+		std::string key;
+		std::string head;
+		std::string body;
+		time_t      mtime;
+		size_t      size;
+		ino_t       ino;
+
+		private:
+		friend class ContentCache;
+		size_t      hash;
+		Entry       *chain;    // next in bucket
+		Entry       *lruPrev;  // towards most recently used
+		Entry       *lruNext;
+	};
+
+	struct Stats
+	{
+		unsigned long hits;
+		unsigned long misses;
+		unsigned long evictions;
+		size_t        entries;
+		size_t        bytes;
+
+		Stats();
+	};
+
+	ContentCache();
+	~ContentCache();
+
+	void configure(size_t budgetBytes, size_t maxFileBytes);
+	bool accepts(size_t fileSize) const;
+
+	// NULL on miss (counted); a stale entry is dropped on the way.
+	const Entry *find(const std::string &key, const FileInfo &info);
+	// Takes a copy; returns NULL if it doesn't fit the budget.
+	const Entry *store(const std::string &key, const FileInfo &info,
+					   const std::string &head, const std::string &body);
+
+	const Stats &stats() const;
+	void clear();
+
+	private:
+	std::vector<Entry*> m_buckets;  // power of two
+	Entry               *m_lruHead; // most recently used
+	Entry               *m_lruTail;
+	size_t              m_budget;
+	size_t              m_maxFile;
+	Stats               m_stats;
+
+	static size_t hashKey(const std::string &key);
+	static size_t cost(const Entry &e);
+	Entry **slotOf(const std::string &key, size_t hash);
+	void unlinkLru(Entry *e);
+	void pushFront(Entry *e);
+	void erase(Entry *e);
+	void rehash(size_t buckets);
+
+	ContentCache(const ContentCache &src);
+	ContentCache &operator=(const ContentCache &src);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef EVENTBACKEND_HPP
+#define EVENTBACKEND_HPP
+
+#include <poll.h>
+#include <string>
+#include <vector>
+
+// Readiness layer under SocketManager. Interest masks and reported events
+// always use the poll() bits (POLLIN, POLLOUT, POLLERR, POLLHUP, POLLNVAL),
+// whatever kernel mechanism sits underneath, so the handlers never care.
+struct ReadyEvent
+{
+	int		fd;
+	short	revents;
+};
+
+class EventBackend
+{
+	public:
+	virtual ~EventBackend();
+
+	virtual const char *name() const = 0;
+
+	// Registration, driven by SocketManager::addPollFd/modPollEvents/delPollFd.
+	// remove() must be called BEFORE close(fd): once the number is closed the
+	// kernel can hand it out again and epoll would keep the stale entry.
+	virtual bool add(int fd, short events) = 0;
+	virtual void modify(int fd, short setMask, short clearMask) = 0;
+	virtual void remove(int fd) = 0;
+	virtual bool watches(int fd) const = 0;
+	virtual void watchedFds(std::vector<int> &out) const = 0;
+
+	// Wait up to timeoutMs and fill `out` with the ready fds only.
+	// Returns how many fds are ready (0 on timeout) or -1 with errno set.
+	virtual int wait(std::vector<ReadyEvent> &out, int timeoutMs) = 0;
+
+	// "poll", "epoll" or "" (best available). Falls back to poll when the
+	// requested mechanism is missing on this platform.
+	static EventBackend *create(const std::string &preferred);
+};
+
+// Portable fallback: one pollfd per registered fd, scanned on every wait().
+// Registration changes are O(1): m_index maps fd -> position in m_pollfds and
+// remove() swaps the last entry into the hole instead of shifting the tail.
+class PollBackend : public EventBackend
+{
+	public:
+	PollBackend();
+	virtual ~PollBackend();
+
+	virtual const char *name() const;
+	virtual bool add(int fd, short events);
+	virtual void modify(int fd, short setMask, short clearMask);
+	virtual void remove(int fd);
+	virtual bool watches(int fd) const;
+	virtual void watchedFds(std::vector<int> &out) const;
+	virtual int wait(std::vector<ReadyEvent> &out, int timeoutMs);
+
+	private:
+	std::vector<struct pollfd>	m_pollfds;
+	std::vector<int>			m_index;	// fd -> m_pollfds position, -1 if none
+
+	int indexOf(int fd) const;
+
+	PollBackend(const PollBackend &src);
+	PollBackend &operator=(const PollBackend &src);
+};
+
+#ifdef __linux__
+# include <sys/epoll.h>
+
+// Level-triggered epoll: same semantics as poll(), but wait() only returns
+// the fds that are actually ready, so idle keep-alive clients cost nothing.
+class EpollBackend : public EventBackend
+{
+	public:
+	EpollBackend();
+	virtual ~EpollBackend();
+
+	bool isValid() const;
+
+	virtual const char *name() const;
+	virtual bool add(int fd, short events);
+	virtual void modify(int fd, short setMask, short clearMask);
+	virtual void remove(int fd);
+	virtual bool watches(int fd) const;
+	virtual void watchedFds(std::vector<int> &out) const;
+	virtual int wait(std::vector<ReadyEvent> &out, int timeoutMs);
+
+	private:
+	int								m_epfd;
+	std::vector<short>				m_masks;	// interest, indexed by fd
+	std::vector<unsigned char>		m_watched;	// registered, indexed by fd
+	size_t							m_count;
+	std::vector<struct epoll_event>	m_ready;
+
+	bool ctl(int op, int fd, short events);
+
+	EpollBackend(const EpollBackend &src);
+	EpollBackend &operator=(const EpollBackend &src);
+};
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef FASTCGI_HPP
+#define FASTCGI_HPP
+
+#include <cstddef>
+
+#include "ByteQueue.hpp"
+
+// FastCGI 1.0 records, the web server side of the responder role: what we
+// write to an application (BEGIN_REQUEST, PARAMS, STDIN) and the records
+// it answers with (STDOUT, STDERR, END_REQUEST). Encoding appends to a
+// ByteQueue; decoding looks at the bytes in place.
+enum FcgiRecordType
+{
+	FCGI_BEGIN_REQUEST = 1,
+	FCGI_ABORT_REQUEST = 2,
+	FCGI_END_REQUEST = 3,
+	FCGI_PARAMS = 4,
+	FCGI_STDIN = 5,
+	FCGI_STDOUT = 6,
+	FCGI_STDERR = 7,
+	FCGI_DATA = 8,
+	FCGI_GET_VALUES = 9,
+	FCGI_GET_VALUES_RESULT = 10,
+	FCGI_UNKNOWN_TYPE = 11
+};
+
+enum
+{
+	FCGI_HEADER_LEN = 8,
+	FCGI_MAX_CONTENT = 65535,
+	FCGI_REQUEST_COMPLETE = 0  // END_REQUEST protocolStatus
+};
+
+struct FcgiRecord
+{
+	int           type;
+	unsigned      requestId;
+	const char    *content;
+	size_t        length;
+};
+
+// Responder role; `keepConn` asks the application not to close the
+// connection after this request.
+void fcgiBeginRequest(ByteQueue &out, unsigned requestId, bool keepConn);
+// "NAME=value" strings (an envp), then the empty record ending the stream.
+void fcgiParams(ByteQueue &out, unsigned requestId, char *const *envp);
+// One STDIN record, n <= FCGI_MAX_CONTENT; n == 0 ends the stream.
+void fcgiStdin(ByteQueue &out, unsigned requestId, const char *p, size_t n);
+// Management record (request id 0) asking for FCGI_MAX_CONNS, FCGI_MAX_REQS
+// and FCGI_MPXS_CONNS; any FCGI_GET_VALUES_RESULT shows the peer is alive.
+void fcgiGetValues(ByteQueue &out);
+
+// Length of the complete record at the front of p[0..n) (header, content
+// and padding), filling `rec`; 0 if more bytes are needed.
+size_t fcgiNextRecord(const char *p, size_t n, FcgiRecord &rec);
+// END_REQUEST body; false if malformed.
+bool fcgiEndRequest(const FcgiRecord &rec, unsigned long &appStatus,
+					int &protocolStatus);
+
+#endif
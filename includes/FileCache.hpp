@@ -0,0 +1,94 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <sys/types.h>
+
+#include "MimeTypes.hpp"
+
+// What the static path needs to know about a filesystem path.
+struct FileInfo
+{
+	bool        exists;
+	bool        isDir;
+	bool        isReg;
+	size_t      size;
+	time_t      mtime;
+	ino_t       ino;
+	dev_t       dev;
+	const char  *mime; // from the extension, owned by the MIME table;
+	                   // NULL unless regular
+
+	FileInfo();
+};
+
+// Bounded LRU of stat() results and open read-only fds, keyed by the path
+// string dispatchRequest builds. An entry is trusted for `ttlMs` after its
+// last stat(); past that the next lookup re-stats it and drops the cached fd
+// if the file changed (inode, size or mtime). Within the TTL a static hit
+// costs no stat()/open() at all, only a dup() of the cached fd.
+class FileCache
+{
+	public:
+	FileCache();
+	~FileCache();
+
+	void configure(size_t maxEntries, unsigned long long ttlMs);
+	// Table the cached MIME types come from (it must outlive the cache);
+	// NULL = the built-in one.
+	void setMimeTypes(const MimeTypes *types);
+
+	FileInfo lookup(const std::string &path);
+
+	// New fd on the file (dup of the cached one, caller closes it), -1 if
+	// the path is not a readable regular file. `info` is filled either way.
+	int openShared(const std::string &path, FileInfo &info);
+
+	// Whole file through the cached fd, false if unreadable.
+	bool readAll(const std::string &path, std::string &out);
+
+	// isPathSafe(root, path), remembered per entry.
+	bool isSafe(const std::string &root, const std::string &path);
+
+	// Forget `path` right away (we just deleted or rewrote it ourselves).
+	void invalidate(const std::string &path);
+
+	void clear();
+
+	private:
+	// LRU nodes point at the map keys, which never move.
+	typedef std::list<const std::string*> LruList;
+
+	struct Entry
+	{
+		FileInfo           info;
+		int                fd;        // lazily opened, -1 if not yet
+		unsigned long long checkedMs; // last stat()
+		std::string        safeRoot;  // root the verdict is for
+		bool               safeKnown;
+		bool               safe;
+		LruList::iterator  lru;
+	};
+
+	typedef std::map<std::string, Entry> EntryMap;
+
+	EntryMap           m_entries;
+	LruList            m_lru;         // front = most recently used
+	size_t             m_maxEntries;
+	unsigned long long m_ttlMs;
+	const MimeTypes    *m_types;
+
+	Entry &fetch(const std::string &path);
+	void refresh(Entry &e, const std::string &path);
+	void evictOne();
+	int cachedFd(const std::string &path, FileInfo &info);
+	static void closeFd(Entry &e);
+
+	FileCache(const FileCache &src);
+	FileCache &operator=(const FileCache &src);
+};
+
+#endif
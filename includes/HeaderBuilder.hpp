@@ -0,0 +1,49 @@
+#ifndef HEADERBUILDER_HPP
+#define HEADERBUILDER_HPP
+
+#include <cstddef>
+#include <string>
+
+// Append-only serializer for a response head. Writes straight into the
+// caller's string (reserved once up front), with no stream objects. Status
+// lines for the codes we actually send are precomputed, and so is the Date
+// line, refreshed at most once per second.
+class HeaderBuilder
+{
+	public:
+	// Names we emit ourselves, as ready-made "Name: " prefixes.
+	enum Name
+	{
+		H_CONTENT_LENGTH,
+		H_CONTENT_TYPE,
+		H_CONTENT_RANGE,
+		H_ETAG,
+		H_LAST_MODIFIED,
+		H_LOCATION,
+		H_ALLOW,
+		H_ACCEPT_RANGES,
+		H_NAME_COUNT
+	};
+
+	explicit HeaderBuilder(std::string &out, size_t reserve = 256);
+
+	void statusLine(int code, const std::string &reason);
+	void header(const std::string &name, const std::string &value);
+	void header(Name name, const std::string &value);
+	void header(Name name, const char *value);
+	void header(Name name, size_t value);
+	void line(const std::string &raw); // "Name: value", CRLF added
+	void date();
+	void connectionClose();
+	void end();                        // blank line
+
+	private:
+	std::string &m_out;
+
+	void appendNumber(size_t value);
+
+	HeaderBuilder(const HeaderBuilder &src);
+	HeaderBuilder &operator=(const HeaderBuilder &src);
+};
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef HEADERTABLE_HPP
+#define HEADERTABLE_HPP
+
+#include <string>
+#include <vector>
+
+// Request head kept as the bytes we received plus a flat table of
+// (offset, length) slices into them: nothing is copied, lowercased or put in
+// a map. Header names we act on are interned to an Id while parsing, so
+// looking one up is an array index. Offsets (not pointers) keep the table
+// valid when the Request is copied.
+class HeaderTable
+{
+	public:
+	enum Id
+	{
+		HOST,
+		CONTENT_LENGTH,
+		TRANSFER_ENCODING,
+		CONNECTION,
+		CONTENT_TYPE,
+		IF_NONE_MATCH,
+		IF_MODIFIED_SINCE,
+		IF_RANGE,
+		RANGE,
+		KNOWN_COUNT,
+		OTHER = KNOWN_COUNT
+	};
+
+	struct Field
+	{
+		unsigned nameOff;
+		unsigned nameLen;
+		unsigned valueOff;
+		unsigned valueLen;  // OWS trimmed
+		int      id;
+		int      next;      // next field with the same known id, -1 at the end
+	};
+
+	enum ParseError
+	{
+		PARSE_OK,
+		PARSE_MALFORMED,    // bad line, obs-fold, invalid name
+		PARSE_DUPLICATE     // a header that must be unique came twice
+	};
+
+	HeaderTable();
+
+	// Copies the head (into storage kept from the previous request, so
+	// normally no allocation); the caller then consumes it from its input.
+	void adopt(const char *head, size_t len);
+	const std::string &raw() const;
+
+	// Header lines of raw() from `from` up to the blank line.
+	ParseError parse(size_t from);
+
+	// Empty, but the buffers keep their capacity for the next request.
+	void clear();
+
+	size_t size() const;
+	const Field &field(size_t i) const;
+	std::string name(size_t i) const;   // lowercased
+	std::string value(size_t i) const;
+
+	bool has(Id id) const;
+	size_t count(Id id) const;
+	// First occurrence, NULL if absent: a slice of raw(), no copy.
+	const Field *first(Id id) const;
+	// Every occurrence, comma-joined (RFC 9110 5.3), "" if absent.
+	std::string get(Id id) const;
+	// Names without an Id (give it lowercase): a scan of the table.
+	std::string get(const std::string &name) const;
+
+	private:
+	enum { INLINE_FIELDS = 32 };
+
+	std::string        m_raw;
+	Field              m_inline[INLINE_FIELDS];
+	std::vector<Field> m_overflow;  // only past INLINE_FIELDS
+	size_t             m_count;
+	int                m_first[KNOWN_COUNT];
+	int                m_last[KNOWN_COUNT];
+	unsigned           m_seen[KNOWN_COUNT];
+
+	Field &slot(size_t i);
+	void push(const Field &f);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef MIMETYPES_HPP
+#define MIMETYPES_HPP
+
+#include <string>
+#include <vector>
+
+// File extension -> Content-Type, compiled once at startup into a minimal
+// perfect hash (hash and displace): an extension is hashed twice, lands on
+// exactly one slot and is confirmed with one comparison. Lookups fold case
+// as they hash, so they never copy or allocate.
+//
+// Starts with a built-in table; `types { ... }` blocks and `types_file`
+// entries from the config are added on top (a later entry for the same
+// extension wins). compile() must run after the last add().
+class MimeTypes
+{
+	public:
+	MimeTypes();  // the built-in table, compiled
+
+	void add(const std::string &type, const std::string &ext);
+	// nginx mime.types ("type ext ...;" in a types block) or Apache
+	// ("type ext ..." per line, '#' comments). False and `err` on failure.
+	bool loadFile(const std::string &path, std::string &err);
+	void compile();
+
+	// NULL if the extension is unknown (or empty).
+	const char *lookup(const char *ext, size_t len) const;
+	// Extension after the last '.' of the last path segment, else
+	// application/octet-stream. The pointer lives as long as this table.
+	const char *forPath(const std::string &path) const;
+	size_t size() const;
+
+	static const char *const DEFAULT_TYPE;
+
+	private:
+	struct Entry
+	{
+		std::string ext;   // lowercase
+		size_t      type;  // index into m_types
+	};
+
+	std::vector<std::string> m_types;    // distinct type strings
+	std::vector<Entry>       m_entries;  // one per extension
+	std::vector<unsigned>    m_disp;     // per bucket: second-level seed
+	std::vector<int>         m_slots;    // power of two, entry or -1
+	unsigned                 m_mask;
+	unsigned                 m_salt;     // of the first hash
+	bool                     m_compiled;
+
+	size_t typeIndex(const std::string &type);
+	bool place(const std::vector<std::vector<size_t> > &buckets,
+			   const std::vector<unsigned> &hashes);
+};
+
+#endif
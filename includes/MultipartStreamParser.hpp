@@ -25,6 +25,8 @@ class MultipartStreamParser
 						void* user);
 
 	Result feed(const char* data, size_t n);  // body bytes only (unchunked)
+	// Back to the default-constructed state without freeing the buffers.
+	void clear();
 
 	int mp_state() const;
 	bool isDone() const;
@@ -0,0 +1,62 @@
+#ifndef OUTPUTQUEUE_HPP
+#define OUTPUTQUEUE_HPP
+
+#include <deque>
+#include <string>
+#include <sys/types.h>
+
+// What is left to send on a client socket, in order: memory segments (a
+// header block, a body string, a CGI chunk) and file ranges. Strings are
+// taken over with swap() rather than copied, and a cursor walks the front
+// segment instead of erasing sent bytes. flush() does exactly one syscall:
+// a sendmsg() gathering the leading memory segments, or a sendfile() of the
+// leading file range.
+class OutputQueue
+{
+	public:
+	OutputQueue();
+	~OutputQueue();
+
+	// Takes the contents of `data` and leaves it empty.
+	void appendSwap(std::string &data);
+	void append(const std::string &data);
+	// `length` bytes of `fd` from `offset`; with closeAfter the queue owns
+	// the fd and closes it once this range is sent (or dropped).
+	void appendFile(int fd, off_t offset, size_t length, bool closeAfter);
+
+	bool empty() const;
+	size_t size() const;     // bytes still queued
+	size_t memSize() const;  // of which in memory
+
+	// Same contract as a single send(): <= 0 means the peer is gone.
+	// At most `budget` bytes go out (0 = only the per-call limits).
+	ssize_t flush(int sock, size_t budget = 0);
+
+	void clear();
+
+	private:
+	struct Segment
+	{
+		std::string data;   // memory segment when fd == -1
+		size_t      pos;    // bytes of data already sent
+		int         fd;
+		off_t       offset;
+		size_t      length; // file bytes left
+		bool        ownsFd;
+
+		Segment();
+	};
+
+	std::deque<Segment> m_segments;
+	size_t              m_bytes;
+	size_t              m_memBytes;
+
+	ssize_t flushMemory(int sock, size_t budget);
+	ssize_t flushFile(int sock, size_t budget);
+	void popFront();
+
+	OutputQueue(const OutputQueue &src);
+	OutputQueue &operator=(const OutputQueue &src);
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef ROUTETRIE_HPP
+#define ROUTETRIE_HPP
+
+#include <string>
+#include <vector>
+
+// The location prefixes of one server block as a trie of path segments,
+// built once after parsing. Matching walks the request path a segment at a
+// time (a binary search among the children at each level) instead of
+// string-comparing every location twice.
+//
+// Same answer as the linear scan: "/upload" and "/upload/" both cover
+// "/upload" and everything under "/upload/", the longer location string
+// wins, and on a tie the first one declared. Locations the segment model
+// can't express (not starting with '/', or with an empty segment) make the
+// trie decline, and the caller falls back to the scan.
+class RouteTrie
+{
+	public:
+	RouteTrie();
+
+	void clear();
+	void add(const std::string &location, int index);
+	void finish();  // sorts the children, call after the last add()
+
+	// False if the trie can't answer for `path` (or was built for a
+	// different number of routes); else `index` is the route or -1.
+	bool match(const std::string &path, size_t routeCount, int &index) const;
+
+	private:
+	struct Edge
+	{
+		std::string segment;
+		int         child;
+	};
+
+	struct Node
+	{
+		int               route;     // -1 if no location ends here
+		size_t            routeLen;  // length of that location string
+		std::vector<Edge> edges;     // sorted by segment after finish()
+	};
+
+	std::vector<Node> m_nodes;       // [0] is "/"
+	size_t            m_routes;
+	bool              m_irregular;
+	bool              m_built;
+
+	static bool edgeBefore(const Edge &a, const Edge &b);
+	int child(int node, const char *seg, size_t len) const;
+	int addChild(int node, const std::string &seg);
+	void claim(int node, int index, size_t len);
+};
+
+#endif
@@ -21,6 +21,7 @@ class ServerSocket
 	int				m_fd;
 	unsigned short	m_port;
 	std::string		m_host;
+	bool			m_reusePort;	// SO_REUSEPORT: one listener per worker
 
 	
 	void setNonBlocking();
@@ -31,7 +32,7 @@ class ServerSocket
 	
 	public:
 	ServerSocket();
-	ServerSocket(const std::string &host, unsigned short port);
+	ServerSocket(const std::string &host, unsigned short port, bool reusePort = false);
 	~ServerSocket();
 
 	//get
@@ -15,15 +15,21 @@
 
 #include <map>
 #include <poll.h>
-#include <set>
 #include <string>
 #include <vector>
 
+#include "Arena.hpp"
+#include "ByteQueue.hpp"
 #include "Chunked.hpp"
 #include "Config.hpp"
+#include "ContentCache.hpp"
+#include "EventBackend.hpp"
+#include "FileCache.hpp"
 #include "MultipartStreamParser.hpp"
+#include "OutputQueue.hpp"
 #include "ServerSocket.hpp"
 #include "utils.hpp"
+#include "VirtualHosts.hpp"
 
 // -------------------------- Multipart context -------------------------------
 struct MultipartCtx
@@ -46,7 +52,7 @@ struct Cgi
 	int stdout_r;
 	bool stdin_closed;
 	bool stdoutPaused;
-	std::string inBuf;  // decoded request body to feed child
+	ByteQueue   inBuf;  // decoded request body to feed child
 	std::string outBuf; // bytes read but not yet parsed
 	bool headersParsed;
 	int cgiStatus;
@@ -55,9 +61,53 @@ struct Cgi
 	unsigned long long tStartMs;
 	std::string scriptFsPath;
 	std::string workingDir;
+	const RouteConfig *route;  // the location it was started for
+	int fcgiConn;   // fastcgi_pass: upstream connection still producing, else -1
+	bool fastcgi;   // sent to fastcgi_pass; cleared once its end is handled
 
 	Cgi();
 	void reset();
+	bool stdoutOpen() const { return stdout_r != -1 || fcgiConn != -1; }
+};
+
+// A pooled connection to a FastCGI application (fastcgi_pass). It carries
+// one request at a time and stays open (FCGI_KEEP_CONN) for the next one.
+struct FcgiConn
+{
+	std::string address;    // socket path, the pool key
+	int         client;     // client fd being served, -1 while idle
+	ByteQueue   in;         // read, not yet split into records
+	ByteQueue   out;        // encoded records not yet written
+	bool        stdinDone;  // the empty FCGI_STDIN is queued
+	bool        ended;      // FCGI_END_REQUEST seen
+	int         pool;       // cgi_workers: m_cgiPools index, else -1
+	size_t      worker;     // and the worker at the other end
+
+	FcgiConn(const std::string &addr);
+};
+
+// cgi_workers: long-lived interpreters a location's CGI requests go to
+// instead of fork()/execve() each. Every worker gets one already-connected
+// unix socket on fd 0 and speaks FastCGI over it, so requests run through
+// the FastCGI client; the manager respawns, probes and recycles them.
+struct CgiWorker
+{
+	pid_t              pid;        // -1 once reaped
+	int                conn;       // its FcgiConn fd, -1 once closed
+	size_t             served;     // requests since spawn
+	unsigned long long startedMs;
+	unsigned long long aliveMs;    // spawned, answered a probe or a request
+	unsigned long long probeMs;    // FCGI_GET_VALUES sent, 0 if none pending
+	unsigned long long stopMs;     // SIGTERM sent, 0 if not stopping
+
+	CgiWorker();
+};
+
+struct CgiPool
+{
+	const RouteConfig      *route;
+	std::vector<CgiWorker> workers;
+	size_t                 next;   // round-robin start
 };
 
 // ----------------------------- Client state ---------------------------------
@@ -82,14 +132,22 @@ struct ClientState
 	};
 
 	Phase                 phase;
-	std::string           recvBuffer;     // raw bytes unread from socket
+	ByteQueue             recvBuffer;     // raw bytes not parsed yet
+	size_t                hdrScanPos;     // recvBuffer prefix already searched for \r\n\r\n
 	Request               req;            // parsed request line + headers
+	const RouteConfig     *route;         // SocketManager::routeFor() cache
+	bool                  routeKnown;
 	bool                  isChunked;
 	size_t                contentLength;
 	size_t                maxBodyAllowed;
 	std::string           bodyBuffer;     // decoded body (uploads/CGI stdin)
 	ChunkedDecoder        chunkDec;
-	std::string           writeBuffer;    // pending response payload
+	OutputQueue           out;            // pending response bytes
+	Arena                 arena;          // dispatch/CGI scratch, per request
+	size_t                recvWindow;     // next read size, follows the traffic
+	unsigned long         recvCalls;      // socket syscalls spent on the
+	unsigned long         sendCalls;      // current request
+	unsigned long         allocMark;      // allocCount() when it started
 	bool                  forceCloseAfterWrite;
 	bool                  closing;
 
@@ -112,10 +170,54 @@ struct ClientState
 	struct Cgi            cgi;
 
 	bool mpDone() const;
+	// Per-request fields back to their initial values. Strings and parsers
+	// are cleared, not rebuilt, so a keep-alive request doesn't allocate.
+	// (mpCtx owns files: SocketManager::resetMultipartState.)
+	void resetForNextRequest();
+	// All of it, for a pooled state about to serve another connection.
+	void resetForNewConnection();
 
 	ClientState();
 };
 
+// Totals of ClientState::recvCalls/sendCalls over the requests answered.
+struct IoStats
+{
+	unsigned long requests;
+	unsigned long recvCalls;
+	unsigned long sendCalls;
+	unsigned long allocs;    // only counted with ALLOC_STATS
+
+	IoStats();
+};
+
+// ------------------------------ fd slot table -------------------------------
+// What an fd number currently is to the manager. Indexed by fd, so every
+// lookup on the event-loop hot path is an array access instead of a map search.
+struct FdSlot
+{
+	enum Kind
+	{
+		FREE,
+		LISTENER,
+		CLIENT,
+		CGI_STDIN,
+		CGI_STDOUT,
+		FCGI
+	};
+
+	Kind         kind;
+	size_t       serverIndex; // LISTENER: its default server; CLIENT: the
+	                          // current request's, index into m_serversConfig
+	size_t       listener;    // LISTENER, CLIENT: index into m_servers/m_vhosts
+	size_t       clientIndex; // CLIENT: position in m_clientList
+	int          owner;       // CGI_*, FCGI: client fd the pipe or upstream
+	                          // connection serves (FCGI: -1 while idle)
+	unsigned int generation;  // bumped on every bind, detects fd reuse
+
+	FdSlot();
+};
+
 // ================================ Manager ===================================
 class SocketManager
 {
@@ -125,8 +227,10 @@ class SocketManager
 	~SocketManager();
 
 	// Lifecycle
-	void addServer(const std::string& host, unsigned short port);
 	void setServers(const std::vector<ServerConfig> & servers);
+	// Listen for m_serversConfig[serverIndex]: server blocks on the same
+	// host:port share one socket and are told apart by Host.
+	void addServer(size_t serverIndex, bool reusePort = false);
 	void initPoll();
 	void run();
 
@@ -141,30 +245,63 @@ class SocketManager
 
 	// Connection / server context
 	const ServerConfig& findServerForClient(int fd) const;
+	const RouteConfig *routeFor(int fd, ClientState &st);
+	const RouteConfig *cgiRouteFor(int fd, ClientState &st);
 	bool clientRequestedClose(const Request &req) const;
 
 	// Poll bookkeeping
 	void setPollToWrite(int fd);
 	void clearPollout(int fd);
 
+	// fd slot table
+	FdSlot &slotFor(int fd);
+	ClientState *findClient(int fd) const;
+	ClientState &attachClient(int fd, size_t listener);
+	void detachClient(int fd);
+	void bindCgiPipe(int pipefd, FdSlot::Kind kind, int clientFd);
+	void unbindCgiPipe(int pipefd);
+	int cgiPipeOwner(int pipefd, FdSlot::Kind kind) const;
+	void releaseCgiPipes(ClientState &st);
+	void freeRetiredClients();
+
 	// Response queueing / keep-alive
 	void finalizeAndQueue(int fd, const Request &req, Response &res, bool body_expected, bool body_fully_consumed);
 	void finalizeAndQueue(int fd, Response &res);
 	bool shouldCloseAfterThisResponse(int status_code, bool headers_complete, bool body_expected, bool body_fully_consumed, bool client_close) const;
-	// Core sockets and poll bookkeeping
+	// Core sockets and readiness bookkeeping (epoll, or poll as fallback)
 	std::vector<ServerSocket*>	m_servers;
-	std::vector<struct pollfd>	m_pollfds;
-	std::set<int>				m_serverFds;
+	std::vector<VirtualHosts>	m_vhosts;		// parallel to m_servers
+	EventBackend				*m_events;
 	std::vector<ServerConfig>	m_serversConfig;
 	Config						m_config;
 
-	// Per-client state
-	std::map<int, ClientState>	m_clients;
-	std::map<int, size_t>		m_clientToServerIndex;
-
-	// CGI pipe ↔ client associations
-	std::map<int, int> m_cgiStdoutToClient;
-	std::map<int, int> m_cgiStdinToClient;
+	// Per-fd bookkeeping: listeners, clients and CGI pipes all live in
+	// m_slots. Clients are kept dense in m_clientList (swap-remove on
+	// disconnect) and heap-allocated, so a ClientState& held by a handler
+	// survives handleClientDisconnect until the loop turn ends (m_retired).
+	std::vector<FdSlot>			m_slots;
+	std::vector<ClientState*>	m_clientList;
+	std::vector<int>			m_clientFds;	// parallel to m_clientList
+	std::vector<ClientState*>	m_retired;
+	std::vector<ClientState*>	m_clientPool;	// reset, ready for attachClient
+	size_t						m_cgiPipes;		// live CGI pipe slots and busy
+												// FastCGI connections
+
+	// fastcgi_pass upstreams: connections by fd, and the idle ones by address
+	std::vector<FcgiConn*>		m_fcgiConns;
+	std::map<std::string, std::vector<int> >	m_fcgiIdle;
+
+	// cgi_workers pools, one per location using them
+	std::vector<CgiPool>		m_cgiPools;
+	unsigned long long			m_cgiPoolCheckMs;
+
+	// stat()/open() results for the static path (dispatch, index, error pages)
+	// and ready-to-send copies of the small files among them
+	FileCache					m_fileCache;
+	ContentCache				m_contentCache;
+
+	// Socket syscalls per completed request, for the end-of-run report
+	IoStats						m_io;
 
 	SocketManager &operator=(const SocketManager &src);
 	SocketManager(const SocketManager &src);
@@ -172,6 +309,7 @@ class SocketManager
 	// IO helpers
 	bool readIntoBuffer(int fd, ClientState &st);
 	bool tryFlushWrite(int fd, ClientState &st);
+	void noteRequestDone(int fd, ClientState &st);
 	bool clientHasPendingWrite(const ClientState &st) const;
 
 	// Legacy HTTP parsing helpers (still used in HTTP pipeline)
@@ -190,6 +328,7 @@ class SocketManager
 	bool ensureBodyReady(int fd, size_t hdrEnd, size_t &requestEnd);
 
 	// HTTP pipeline
+	void advanceRequest(int fd, ClientState &st);
 	bool tryParseHeaders(int fd, ClientState &st);
 	bool checkHeaderLimits(int fd, ClientState &st, size_t &hdrEndPos);
 	Response makeHtmlError(int code, const std::string& reason, const std::string& html);
@@ -203,16 +342,18 @@ class SocketManager
 	bool applyRoutePolicyAfterHeaders(int fd, ClientState &st);
 	bool badRequestAndQueue(int fd, ClientState &st);
 	bool setupBodyFramingAndLimits(int fd, ClientState &st);
-	void finalizeHeaderPhaseTransition (int fd, ClientState &st, size_t hdrEndPos);
+	void finalizeHeaderPhaseTransition (int fd, ClientState &st);
 	bool tryReadBody(int fd, ClientState &st);
 	void queueErrorAndClose(int fd, int status, const std::string &title, const std::string &html);
 
 	// Dispatch to handlers
 	void splitPathAndQuery(const std::string &raw, std::string &urlPath, std::string &query);
-	void dispatchRequest(int fd, const Request &req,
+	void dispatchRequest(int fd, ClientState &st,
 							const ServerConfig &server,
 							const std::string &methodUpper);
 	void finalizeRequestAndQueueResponse(int fd, ClientState &st);
+	bool buildStaticResponse(Response &res, const Request &req,
+							 const std::string &path, bool headOnly);
 
 	void	handlePostUpload(int fd, 
 									const Request &req,
@@ -273,6 +414,29 @@ class SocketManager
 	void handleCgiReadable(int pipefd);
 	void handleCgiPipeError(int pipefd);
 	void checkCgiTimeouts(); // new for cgi time out
+
+	// FastCGI (fastcgi_pass), the same Cgi state machine over a pooled socket
+	void startFastCgi(int fd, ClientState &st, int connFd, char *const *envp);
+	int  acquireFcgiConn(const std::string &address);
+	int  adoptFcgiConn(int fd, const std::string &address);
+	void releaseFcgiConn(int connFd);
+	void closeFcgiConn(int connFd);
+	void releaseFastCgi(ClientState &st);
+	bool isFcgiConn(int fd) const;
+	void handleFcgiReadable(int connFd);
+	void handleFcgiWritable(int connFd);
+	void handleFcgiError(int connFd);
+
+	// cgi_workers pools
+	void startCgiPools();
+	void stopCgiPools();
+	bool spawnCgiWorker(size_t pool, size_t worker);
+	void stopCgiWorker(CgiWorker &w, int sig);
+	int  acquireCgiWorker(const RouteConfig &route);
+	void cgiWorkerIdle(int connFd);
+	void cgiWorkerGone(int connFd);
+	void cgiWorkerAnswered(const FcgiConn &c);
+	void superviseCgiWorkers();
 };
 
 #endif
@@ -0,0 +1,62 @@
+#ifndef VIRTUALHOSTS_HPP
+#define VIRTUALHOSTS_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Host header -> server block, for the server blocks sharing one listening
+// socket. Names are hashed (FNV-1a over the lowercased bytes) into two open
+// addressing tables, so picking the server costs a hash per lookup however
+// many sites share the port:
+//  - exact names: "example.com"
+//  - wildcard suffixes: "*.example.com" matches "www.example.com" and
+//    "a.b.example.com" (the longest suffix wins), not "example.com" itself.
+//    nginx's ".example.com" means both.
+// The first server block declared on the socket is the default, for a
+// missing or unknown Host; a name claimed twice stays with the first block.
+class VirtualHosts
+{
+	public:
+	VirtualHosts();
+
+	void setDefault(size_t server);
+	void add(const std::string &name, size_t server);
+
+	// `host` as the client sent it: the port, a trailing dot and case are
+	// ignored, "[v6]" literals are matched as a whole.
+	size_t resolve(const char *host, size_t len) const;
+	size_t defaultServer() const;
+	size_t names() const;
+
+	private:
+	class NameTable
+	{
+		public:
+		NameTable();
+		bool insert(const std::string &lowerName, size_t server);
+		bool find(const char *p, size_t len, size_t &server) const;
+		size_t size() const;
+
+		private:
+		struct Entry
+		{
+			std::string name;  // lowercase
+			size_t      server;
+			unsigned    hash;
+		};
+
+		std::vector<Entry> m_entries;
+		std::vector<int>   m_index;  // power of two, -1 = empty
+		size_t             m_mask;
+
+		void grow();
+		bool equals(const Entry &e, const char *p, size_t len, unsigned h) const;
+	};
+
+	NameTable m_exact;
+	NameTable m_suffix;  // stored with the leading '.'
+	size_t    m_default;
+};
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef WORKERMASTER_HPP
+#define WORKERMASTER_HPP
+
+#include <sys/types.h>
+#include <vector>
+
+#include "Config.hpp"
+
+// Owns the process layout. With worker_processes 1 the event loop runs right
+// here; with N > 1 the master forks N workers, each with its own
+// SocketManager (event loop, client table, CGI children) and its own
+// SO_REUSEPORT listeners, then only supervises: respawns crashed workers and
+// forwards shutdown.
+class WorkerMaster
+{
+	public:
+	WorkerMaster(const Config &config);
+	~WorkerMaster();
+
+	int run();
+
+	private:
+	Config						m_config;
+	std::vector<pid_t>			m_pids;		// by worker slot, -1 when down
+	std::vector<unsigned long long>	m_startedMs;
+
+	bool spawn(size_t slot);
+	void stopAll();
+	int slotOf(pid_t pid) const;
+
+	static int runWorker(const Config &config, bool reusePort);
+
+	WorkerMaster(const WorkerMaster &src);
+	WorkerMaster &operator=(const WorkerMaster &src);
+};
+
+#endif
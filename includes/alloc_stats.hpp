@@ -0,0 +1,10 @@
+#ifndef ALLOC_STATS_HPP
+#define ALLOC_STATS_HPP
+
+// Heap allocation counter for measurements. Built with `make ALLOC_STATS=1`
+// (-DWEBSERV_ALLOC_STATS) the global operator new counts every call;
+// otherwise nothing is replaced and allocCount() stays 0.
+bool allocStatsEnabled();
+unsigned long allocCount();
+
+#endif
@@ -3,24 +3,57 @@
 
 #include <map>
 #include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "HeaderTable.hpp"
 
 struct Request {
     std::string method;
     std::string path;
     std::string http_version;
-    std::map<std::string, std::string> headers;
+    HeaderTable headers;                  // slices over the received head
     std::string body;
     std::map<std::string, std::string> form_fields;
+
+    // Back to empty for the next request on the connection, keeping the
+    // header buffer's capacity.
+    void clear();
+};
+
+// `length` bytes of a file from `offset`, then `after` from memory.
+struct FileSpan {
+    off_t offset;
+    size_t length;
+    std::string after;
+
+    FileSpan(off_t off = 0, size_t len = 0, const std::string &tail = std::string());
 };
 
 struct Response {
     int status_code;                      // e.g., 200, 404, 500
     std::string status_message;           // e.g., "OK", "Not Found", "Internal Server Error"
     std::map<std::string, std::string> headers;  // e.g., Content-Type, Content-Length
+    std::vector<std::string> header_lines;       // raw "Name: value" lines that may repeat (Set-Cookie)
     std::string body;                     // The actual body content (HTML, file data, CGI output)
     bool close_connection;                // Whether to close connection after response (Connection: close)
+
+    // File-backed body: when body_fd != -1 the payload is body_spans, each a
+    // slice of body_fd streamed with sendfile() after the headers (instead
+    // of being copied into `body`) followed by its `after` bytes. A plain
+    // file is one span; multipart/byteranges puts the part headers in
+    // `after`. The fd is owned by the Response until finalizeAndQueue hands
+    // it to the ClientState.
+    int body_fd;
+    std::vector<FileSpan> body_spans;
+
+    // Prebuilt status line + headers (see build_http_head) from the content
+    // cache. When set it is sent as is and `headers` is not serialized.
+    std::string raw_head;
+
+    Response();
 };
 
-std::string build_http_response(const Response &res);
+std::string build_http_head(const Response &res);
 
 #endif
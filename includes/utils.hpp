@@ -19,14 +19,17 @@ std::string joinAllowedMethods(const std::set<std::string> &methods);
 bool isMethodAllowedForRoute(const std::string &methodUpper, const std::set<std::string> &allowed);
 bool shouldCloseAfterThisResponse(int status, bool headers_complete, bool body_was_expected, bool body_fully_consumed, bool client_said_close);
 bool clientRequestedClose(const Request& req);
-std::string getMimeTypeFromPath(const std::string& path);
-void countHeaderNames(const std::string &rawHeaders, std::map<std::string, size_t> &outCounts);
+const char *getMimeTypeFromPath(const std::string& path);
 void normalizeHeaderKeys(std::map<std::string, std::string> &hdrs);
 std::string toLowerCopy(const std::string &str);
 std::string trimCopy(const std::string &s);
 bool std_to_hex(const std::string &hex_part, size_t &ret);
 std::string getFileExtension(const std::string &path);
 std::string joinPaths(const std::string &a, const std::string &b);
+void joinPaths(std::string &out, const std::string &a, const std::string &b);
 unsigned long long now_ms();
+std::string httpDate(time_t t);
+bool parseHttpDate(const std::string &s, time_t &out);
+size_t findHeaderEnd(const char *buf, size_t len, size_t &scanPos);
 
 #endif
@@ -6,12 +6,34 @@ ServerConfig::ServerConfig () :
 	return ;
 }
 
+void ServerConfig::compileRoutes()
+{
+	routeTrie.clear();
+	for (size_t i = 0; i < routes.size(); ++i)
+		routeTrie.add(routes[i].path, static_cast<int>(i));
+	routeTrie.finish();
+}
+
 RouteConfig::RouteConfig() :
 	autoindex(false),
 	max_body_size(0),
 	cgi_path(""),
 	cgi_timeout_ms(5000),
-	cgi_max_output_bytes(5 * 1024 * 1024)
+	cgi_max_output_bytes(5 * 1024 * 1024),
+	cgi_workers(0),
+	cgi_worker_max_requests(0)
+{
+	return ;
+}
+
+Config::Config() :
+	event_backend(""),
+	worker_processes(1),
+	file_cache_entries(256),
+	file_cache_valid_ms(1000),
+	content_cache_bytes(8 << 20),
+	content_cache_max_file(64 << 10),
+	io_budget_bytes(256 << 10)
 {
 	return ;
 }
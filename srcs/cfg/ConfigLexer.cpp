@@ -61,25 +61,28 @@ void ConfigLexer::lex()
 			continue;
 		}
 
-		// NUMBERS
+		// NUMBERS (digits followed by letters, like the "7z" extension, are
+		// an identifier)
 		if (std::isdigit(c))
 		{
-			std::string number;
-			while (_current < _source.length() && std::isdigit(_source[_current]))
+			size_t end = _current;
+			while (end < _source.length() && std::isdigit(_source[end]))
+				end++;
+			if (end >= _source.length() || !std::isalpha(_source[end]))
 			{
-				number.push_back(_source[_current]);
-				_current++;
+				Token token;
+				token.type = TOKEN_NUMBER;
+				token.value = _source.substr(_current, end - _current);
+				token.line = _line;
+				_tokens.push_back(token);
+				_current = end;
+				continue;
 			}
-			Token token;
-			token.type = TOKEN_NUMBER;
-			token.value = number;
-			token.line = _line;
-			_tokens.push_back(token);
-			continue;
 		}
 
-		// IDENTIFIERS or PATHS (stop before semicolon if needed)
-		if (std::isalpha(c) || c == '_' || c == '/' || c == '.')
+		// IDENTIFIERS or PATHS (stop before semicolon if needed); '*' for
+		// wildcard server names, '+' for MIME types like image/svg+xml
+		if (std::isalnum(c) || c == '_' || c == '/' || c == '.' || c == '*')
 		{
 			std::string identifier;
 			while (_current < _source.length() &&
@@ -88,6 +91,8 @@ void ConfigLexer::lex()
 					_source[_current] == '-' ||
 					_source[_current] == '/' ||
 					_source[_current] == '.' ||
+					_source[_current] == '*' ||
+					_source[_current] == '+' ||
 					_source[_current] == ':'))
 			{
 				if (_source[_current] == ';') // stop at semicolon
@@ -3,6 +3,7 @@
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <unistd.h>
 
 #include "Config.hpp"
 #include "ConfigLexer.hpp"
@@ -57,6 +58,7 @@ ConfigParser &ConfigParser::operator=(const ConfigParser &src)
 	{
 		this->m_filePath = src.m_filePath;
 		this->m_servers = src.m_servers;
+		this->m_config = src.m_config;
 	}
 	return (*this);
 }
@@ -68,6 +70,11 @@ const std::vector<ServerConfig> &ConfigParser::getServers() const
 	return m_servers;
 }
 
+const Config &ConfigParser::getConfig() const
+{
+	return m_config;
+}
+
 void ConfigParser::parse()
 {
 	std::ifstream file(this->m_filePath.c_str());
@@ -92,11 +99,128 @@ void ConfigParser::parse()
 			ServerConfig serverConfig = parseServerBlock(tokens, current);
 			this->m_servers.push_back(serverConfig);
 		}
+		else if (tokens[current].type == TOKEN_IDENTIFIER)
+		{
+			parseGlobalDirective(tokens, current);
+		}
 		else
 		{
 			current++;
 		}
 	}
+	m_config.types.compile();
+	m_config.servers = m_servers;
+}
+
+// Directives living outside of any server block
+void ConfigParser::parseGlobalDirective(const std::vector<Token>& tokens, size_t &current)
+{
+	std::string directive = tokens[current++].value;
+
+	if (directive == "event_backend")
+	{
+		if (current >= tokens.size() || tokens[current].value == ";")
+			throw std::runtime_error("Missing value for 'event_backend'");
+		std::string value = tokens[current++].value;
+		if (value != "epoll" && value != "poll")
+			throw std::runtime_error("Invalid event_backend (expected epoll or poll): " + value);
+		m_config.event_backend = value;
+		if (current >= tokens.size() || tokens[current++].value != ";")
+			throw std::runtime_error("Expected ';' after 'event_backend'");
+	}
+	// worker_processes 4;  or  worker_processes auto;  (one per online CPU)
+	else if (directive == "worker_processes")
+	{
+		if (current >= tokens.size() || tokens[current].value == ";")
+			throw std::runtime_error("Missing value for 'worker_processes'");
+		std::string v = tokens[current++].value;
+		size_t n = 0;
+		if (v == "auto")
+		{
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			n = cpus > 0 ? static_cast<size_t>(cpus) : 1;
+		}
+		else
+		{
+			std::istringstream is(v);
+			if (!(is >> n) || !is.eof() || n == 0 || n > 256)
+				throw std::runtime_error("Invalid worker_processes (1-256 or auto): " + v);
+		}
+		m_config.worker_processes = n;
+		if (current >= tokens.size() || tokens[current++].value != ";")
+			throw std::runtime_error("Expected ';' after 'worker_processes'");
+	}
+	// file_cache_entries 256;   file_cache_valid_ms 1000;
+	// content_cache_bytes 8388608;   content_cache_max_file 65536;
+	// io_budget_bytes 262144;
+	else if (directive == "file_cache_entries" || directive == "file_cache_valid_ms"
+		|| directive == "content_cache_bytes" || directive == "content_cache_max_file"
+		|| directive == "io_budget_bytes")
+	{
+		if (current >= tokens.size() || tokens[current].value == ";")
+			throw std::runtime_error("Missing value for '" + directive + "'");
+		std::string v = tokens[current++].value;
+		std::istringstream is(v);
+		size_t n = 0;
+		if (!(is >> n) || !is.eof())
+			throw std::runtime_error("Invalid " + directive + ": " + v);
+		if (directive == "file_cache_entries")
+			m_config.file_cache_entries = n;
+		else if (directive == "file_cache_valid_ms")
+			m_config.file_cache_valid_ms = n;
+		else if (directive == "content_cache_bytes")
+			m_config.content_cache_bytes = n;
+		else if (directive == "content_cache_max_file")
+			m_config.content_cache_max_file = n;
+		else
+			m_config.io_budget_bytes = n;
+		if (current >= tokens.size() || tokens[current++].value != ";")
+			throw std::runtime_error("Expected ';' after '" + directive + "'");
+	}
+	// types { text/html html htm; image/png png; }  (on top of the built-in
+	// table, a later extension wins)
+	else if (directive == "types")
+	{
+		if (current >= tokens.size() || tokens[current++].value != "{")
+			throw std::runtime_error("Expected '{' after 'types'");
+		while (current < tokens.size() && tokens[current].value != "}")
+		{
+			if (tokens[current].type == TOKEN_END_OF_FILE)
+				throw std::runtime_error("Unclosed 'types' block");
+			std::string type = tokens[current++].value;
+			if (current >= tokens.size() || tokens[current].value == ";")
+				throw std::runtime_error("Missing extensions for type '" + type + "'");
+			while (current < tokens.size() && tokens[current].value != ";"
+				&& tokens[current].value != "}"
+				&& tokens[current].type != TOKEN_END_OF_FILE)
+				m_config.types.add(type, tokens[current++].value);
+			if (current >= tokens.size() || tokens[current++].value != ";")
+				throw std::runtime_error("Expected ';' after type '" + type + "'");
+		}
+		if (current >= tokens.size())
+			throw std::runtime_error("Unclosed 'types' block");
+		current++;
+	}
+	// types_file /etc/mime.types;  (nginx or Apache format)
+	else if (directive == "types_file")
+	{
+		if (current >= tokens.size() || tokens[current].value == ";")
+			throw std::runtime_error("Missing value for 'types_file'");
+		std::string err;
+		if (!m_config.types.loadFile(tokens[current++].value, err))
+			throw std::runtime_error(err);
+		if (current >= tokens.size() || tokens[current++].value != ";")
+			throw std::runtime_error("Expected ';' after 'types_file'");
+	}
+	else
+	{
+		std::cerr << "Unknown global directive: " << directive << std::endl;
+		while (current < tokens.size() && tokens[current].value != ";"
+			&& tokens[current].type != TOKEN_END_OF_FILE)
+			current++;
+		if (current < tokens.size() && tokens[current].value == ";")
+			current++;
+	}
 }
 
 
@@ -150,10 +274,14 @@ ServerConfig ConfigParser::parseServerBlock(const std::vector<Token>& tokens, si
 		}
 		else if (directive == "server_name")
 		{
-			if (current >= tokens.size()) throw std::runtime_error("Missing value for 'server_name'");
-			server.server_name = tokens[current++].value;
-			if (tokens[current++].value != ";")
+			if (current >= tokens.size() || tokens[current].value == ";")
+				throw std::runtime_error("Missing value for 'server_name'");
+			while (current < tokens.size() && tokens[current].value != ";")
+				server.server_names.push_back(tokens[current++].value);
+			if (current >= tokens.size())
 				throw std::runtime_error("Expected ';' after 'server_name'");
+			current++;
+			server.server_name = server.server_names[0];
 		}
 		else if (directive == "root")
 		{
@@ -225,6 +353,7 @@ ServerConfig ConfigParser::parseServerBlock(const std::vector<Token>& tokens, si
 		throw std::runtime_error("Expected '}' to close server block");
 
 	current++; // consume '}'
+	server.compileRoutes();
 	return server;
 }
 
@@ -337,6 +466,45 @@ RouteConfig ConfigParser::parseLocationBlock(const std::vector<Token>& tokens, s
 			if (current >= tokens.size() || tokens[current++].value != ";")
 				throw std::runtime_error("Expected ';' after cgi_pass_env");
 		}
+		// fastcgi_pass unix:/run/app.sock;   (or a bare socket path)
+		else if (directive == "fastcgi_pass") {
+			if (current >= tokens.size() || tokens[current].value == ";")
+				throw std::runtime_error("Expected socket path after fastcgi_pass");
+			std::string addr = tokens[current++].value;
+			if (addr.compare(0, 5, "unix:") == 0)
+				addr.erase(0, 5);
+			if (addr.empty())
+				throw std::runtime_error("Expected socket path after fastcgi_pass");
+			ret.fastcgi_pass = addr;
+			if (current >= tokens.size() || tokens[current++].value != ";")
+				throw std::runtime_error("Expected ';' after fastcgi_pass");
+		}
+		// cgi_workers 4;   cgi_worker_max_requests 500;
+		else if (directive == "cgi_workers" || directive == "cgi_worker_max_requests") {
+			if (current >= tokens.size())
+				throw std::runtime_error("Expected numeric value after " + directive);
+			std::string v = tokens[current++].value;
+			std::istringstream is(v);
+			size_t n = 0;
+			if (!(is >> n) || !is.eof())
+				throw std::runtime_error("Invalid " + directive + ": " + v);
+			if (directive == "cgi_workers")
+				ret.cgi_workers = n;
+			else
+				ret.cgi_worker_max_requests = n;
+			if (current >= tokens.size() || tokens[current++].value != ";")
+				throw std::runtime_error("Expected ';' after " + directive);
+		}
+		// cgi_worker /usr/bin/python3 tools/cgi_worker.py;
+		else if (directive == "cgi_worker") {
+			ret.cgi_worker.clear();
+			while (current < tokens.size() && tokens[current].value != ";")
+				ret.cgi_worker.push_back(tokens[current++].value);
+			if (ret.cgi_worker.empty())
+				throw std::runtime_error("Expected a command after cgi_worker");
+			if (current >= tokens.size() || tokens[current++].value != ";")
+				throw std::runtime_error("Expected ';' after cgi_worker");
+		}
 		else if (directive == "max_body_size") {
 			ret.max_body_size = std::atoi(tokens[current++].value.c_str());
 			if (tokens[current++].value != ";")
@@ -363,6 +531,10 @@ RouteConfig ConfigParser::parseLocationBlock(const std::vector<Token>& tokens, s
 	{
 		ret.allowed_methods.insert("GET"); // default here, HEAD is added later via utils functions
 	}
+	if (ret.cgi_workers && ret.cgi_worker.empty())
+		throw std::runtime_error("cgi_workers needs a cgi_worker command");
+	if (ret.cgi_workers && !ret.fastcgi_pass.empty())
+		throw std::runtime_error("cgi_workers and fastcgi_pass are exclusive");
 
 	std::cout << "[DEBUG] Parsed location index: '" << ret.index << "'" << std::endl;
 	return ret;
@@ -389,6 +561,16 @@ void printRouteConfig(const RouteConfig &route) {
 	for (std::map<std::string, std::string>::const_iterator it = route.cgi_extension.begin(); it != route.cgi_extension.end(); it++)
 		std::cout << "    cgi_extension: " << it->first << " & " << it->second << std::endl;
 	std::cout << "    cgi_path: " << route.cgi_path << std::endl;
+	if (!route.fastcgi_pass.empty())
+		std::cout << "    fastcgi_pass: unix:" << route.fastcgi_pass << std::endl;
+	if (route.cgi_workers)
+	{
+		std::cout << "    cgi_workers: " << route.cgi_workers << " (max requests "
+				  << route.cgi_worker_max_requests << "):";
+		for (size_t i = 0; i < route.cgi_worker.size(); ++i)
+			std::cout << " " << route.cgi_worker[i];
+		std::cout << std::endl;
+	}
 	std::cout << "    max_body_size: " << route.max_body_size << std::endl;
 	std::cout << "    redirect: " << route.redirect << std::endl;
 }
@@ -397,7 +579,10 @@ void printServerConfig(const ServerConfig& server) {
 	std::cout << "=== Server Config ===" << std::endl;
 	std::cout << "host: " << server.host << std::endl;
 	std::cout << "port: " << server.port << std::endl;
-	std::cout << "server_name: " << server.server_name << std::endl;
+	std::cout << "server_name:";
+	for (size_t i = 0; i < server.server_names.size(); ++i)
+		std::cout << " " << server.server_names[i];
+	std::cout << std::endl;
 	std::cout << "root: " << server.root << std::endl;
 	std::cout << "index: " << server.index << std::endl;
 	std::cout << "client_max_body_size: " << server.client_max_body_size << std::endl;
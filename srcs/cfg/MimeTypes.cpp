@@ -0,0 +1,331 @@
+#include <fstream>
+#include <sstream>
+
+#include "MimeTypes.hpp"
+
+const char *const MimeTypes::DEFAULT_TYPE = "application/octet-stream";
+
+struct BuiltinType
+{
+	const char *ext;
+	const char *type;
+};
+
+// The common part of nginx's mime.types, plus the charsets we always sent.
+static const BuiltinType BUILTIN_TYPES[] = {
+	{"html", "text/html; charset=utf-8"},
+	{"htm", "text/html; charset=utf-8"},
+	{"shtml", "text/html; charset=utf-8"},
+	{"css", "text/css"},
+	{"xml", "text/xml"},
+	{"txt", "text/plain; charset=utf-8"},
+	{"log", "text/plain; charset=utf-8"},
+	{"md", "text/markdown"},
+	{"csv", "text/csv"},
+	{"ics", "text/calendar"},
+	{"vtt", "text/vtt"},
+	{"js", "application/javascript"},
+	{"mjs", "application/javascript"},
+	{"json", "application/json"},
+	{"map", "application/json"},
+	{"xhtml", "application/xhtml+xml"},
+	{"atom", "application/atom+xml"},
+	{"rss", "application/rss+xml"},
+	{"pdf", "application/pdf"},
+	{"rtf", "application/rtf"},
+	{"wasm", "application/wasm"},
+	{"zip", "application/zip"},
+	{"gz", "application/gzip"},
+	{"tgz", "application/gzip"},
+	{"tar", "application/x-tar"},
+	{"bz2", "application/x-bzip2"},
+	{"xz", "application/x-xz"},
+	{"7z", "application/x-7z-compressed"},
+	{"rar", "application/x-rar-compressed"},
+	{"jar", "application/java-archive"},
+	{"doc", "application/msword"},
+	{"xls", "application/vnd.ms-excel"},
+	{"ppt", "application/vnd.ms-powerpoint"},
+	{"docx", "application/vnd.openxmlformats-officedocument.wordprocessingml.document"},
+	{"xlsx", "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"},
+	{"pptx", "application/vnd.openxmlformats-officedocument.presentationml.presentation"},
+	{"odt", "application/vnd.oasis.opendocument.text"},
+	{"ods", "application/vnd.oasis.opendocument.spreadsheet"},
+	{"eot", "application/vnd.ms-fontobject"},
+	{"woff", "font/woff"},
+	{"woff2", "font/woff2"},
+	{"ttf", "font/ttf"},
+	{"otf", "font/otf"},
+	{"png", "image/png"},
+	{"jpg", "image/jpeg"},
+	{"jpeg", "image/jpeg"},
+	{"gif", "image/gif"},
+	{"webp", "image/webp"},
+	{"avif", "image/avif"},
+	{"svg", "image/svg+xml"},
+	{"svgz", "image/svg+xml"},
+	{"ico", "image/x-icon"},
+	{"bmp", "image/bmp"},
+	{"tif", "image/tiff"},
+	{"tiff", "image/tiff"},
+	{"mp3", "audio/mpeg"},
+	{"ogg", "audio/ogg"},
+	{"oga", "audio/ogg"},
+	{"wav", "audio/wav"},
+	{"flac", "audio/flac"},
+	{"m4a", "audio/x-m4a"},
+	{"mp4", "video/mp4"},
+	{"m4v", "video/mp4"},
+	{"webm", "video/webm"},
+	{"ogv", "video/ogg"},
+	{"mov", "video/quicktime"},
+	{"avi", "video/x-msvideo"},
+	{"mpeg", "video/mpeg"},
+	{"mpg", "video/mpeg"},
+	{"mkv", "video/x-matroska"}
+};
+
+static char lowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// FNV-1a over the case-folded bytes: the one pass over the extension.
+static unsigned extHash(unsigned salt, const char *p, size_t len)
+{
+	unsigned h = 2166136261u ^ salt;
+	for (size_t i = 0; i < len; ++i)
+	{
+		char c = p[i];
+		if (c >= 'A' && c <= 'Z')
+			c = static_cast<char>(c - 'A' + 'a');
+		h ^= static_cast<unsigned char>(c);
+		h *= 16777619u;
+	}
+	return h;
+}
+
+// murmur3's finalizer, seeded: the bucket (seed 0) and the slot (the
+// bucket's displacement) both come from the same extHash.
+static unsigned mix(unsigned h, unsigned seed)
+{
+	h ^= seed * 0x9e3779b9u;
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return h;
+}
+
+MimeTypes::MimeTypes()
+	: m_types(), m_entries(), m_disp(), m_slots(), m_mask(0), m_salt(0),
+	  m_compiled(false)
+{
+	const size_t n = sizeof(BUILTIN_TYPES) / sizeof(BUILTIN_TYPES[0]);
+	for (size_t i = 0; i < n; ++i)
+		add(BUILTIN_TYPES[i].type, BUILTIN_TYPES[i].ext);
+	compile();
+}
+
+size_t MimeTypes::size() const
+{
+	return m_entries.size();
+}
+
+size_t MimeTypes::typeIndex(const std::string &type)
+{
+	for (size_t i = 0; i < m_types.size(); ++i)
+		if (m_types[i] == type)
+			return i;
+	m_types.push_back(type);
+	return m_types.size() - 1;
+}
+
+// Startup only, so plain scans are fine here.
+void MimeTypes::add(const std::string &type, const std::string &ext)
+{
+	std::string lower;
+	for (size_t i = (!ext.empty() && ext[0] == '.') ? 1 : 0; i < ext.size(); ++i)
+		lower += lowerAscii(ext[i]);
+	if (lower.empty() || type.empty())
+		return;
+	m_compiled = false;
+	const size_t t = typeIndex(type);
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		if (m_entries[i].ext == lower)
+		{
+			m_entries[i].type = t;
+			return;
+		}
+	}
+	Entry e;
+	e.ext = lower;
+	e.type = t;
+	m_entries.push_back(e);
+}
+
+bool MimeTypes::loadFile(const std::string &path, std::string &err)
+{
+	std::ifstream file(path.c_str());
+	if (!file.is_open())
+	{
+		err = "Cannot open types file: " + path;
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << file.rdbuf();
+	const std::string text = buffer.str();
+
+	// nginx's file ends entries with ';', Apache's with the line
+	const bool semicolons = text.find(';') != std::string::npos;
+	std::vector<std::string> stmt;
+	std::string word;
+	bool comment = false;
+	for (size_t i = 0; i <= text.size(); ++i)
+	{
+		const char c = i < text.size() ? text[i] : '\n';
+		if (comment && c != '\n')
+			continue;
+		comment = false;
+		const bool ends = c == ';' || c == '{' || c == '}' ||
+						  (c == '\n' && !semicolons);
+		if (c == '#' || ends || c == ' ' || c == '\t' || c == '\r' || c == '\n')
+		{
+			if (!word.empty())
+				stmt.push_back(word);
+			word.clear();
+			comment = c == '#';
+		}
+		else
+			word += c;
+		if (!ends)
+			continue;
+		if (c == '{')
+			stmt.clear();  // the "types" opening a block
+		for (size_t k = 1; k < stmt.size(); ++k)
+			add(stmt[0], stmt[k]);
+		stmt.clear();
+	}
+	return true;
+}
+
+// Hash and displace: keys go to buckets by a first hash; buckets, largest
+// first, each search for a seed that puts all their keys on free slots.
+bool MimeTypes::place(const std::vector<std::vector<size_t> > &buckets,
+					  const std::vector<unsigned> &hashes)
+{
+	size_t largest = 0;
+	for (size_t b = 0; b < buckets.size(); ++b)
+		if (buckets[b].size() > largest)
+			largest = buckets[b].size();
+
+	std::vector<unsigned> taken;
+	for (size_t want = largest; want > 0; --want)
+	{
+		for (size_t b = 0; b < buckets.size(); ++b)
+		{
+			const std::vector<size_t> &keys = buckets[b];
+			if (keys.size() != want)
+				continue;
+			unsigned d = 1;
+			for (; d < (1u << 16); ++d)
+			{
+				taken.clear();
+				size_t k = 0;
+				for (; k < keys.size(); ++k)
+				{
+					const unsigned s = mix(hashes[keys[k]], d) & m_mask;
+					if (m_slots[s] != -1)
+						break;
+					size_t j = 0;
+					while (j < taken.size() && taken[j] != s)
+						++j;
+					if (j < taken.size())
+						break;
+					taken.push_back(s);
+				}
+				if (k == keys.size())
+					break;
+			}
+			if (d == (1u << 16))
+				return false;
+			m_disp[b] = d;
+			for (size_t k = 0; k < keys.size(); ++k)
+				m_slots[taken[k]] = static_cast<int>(keys[k]);
+		}
+	}
+	return true;
+}
+
+void MimeTypes::compile()
+{
+	const size_t n = m_entries.size();
+	size_t cap = 1;
+	while (cap < n * 2)
+		cap <<= 1;
+	m_salt = 0;
+	std::vector<unsigned> hashes(n);
+	for (;;)
+	{
+		for (size_t i = 0; i < n; ++i)
+			hashes[i] = extHash(m_salt, m_entries[i].ext.data(), m_entries[i].ext.size());
+		const size_t nb = n / 2 + 1;
+		m_slots.assign(cap, -1);
+		m_mask = static_cast<unsigned>(cap - 1);
+		m_disp.assign(nb, 0);
+		std::vector<std::vector<size_t> > buckets(nb);
+		for (size_t i = 0; i < n; ++i)
+			buckets[mix(hashes[i], 0) % nb].push_back(i);
+		if (place(buckets, hashes))
+			break;
+		// practically never: two extensions with the same extHash, or an
+		// unlucky table; another salt and more room
+		++m_salt;
+		cap <<= 1;
+	}
+	m_compiled = true;
+}
+
+static bool sameExt(const std::string &lowerExt, const char *ext, size_t len)
+{
+	if (lowerExt.size() != len)
+		return false;
+	for (size_t i = 0; i < len; ++i)
+		if (lowerAscii(ext[i]) != lowerExt[i])
+			return false;
+	return true;
+}
+
+const char *MimeTypes::lookup(const char *ext, size_t len) const
+{
+	if (!len || m_entries.empty())
+		return NULL;
+	if (!m_compiled)
+	{
+		// add() after compile(): still right, just not hashed
+		for (size_t i = 0; i < m_entries.size(); ++i)
+			if (sameExt(m_entries[i].ext, ext, len))
+				return m_types[m_entries[i].type].c_str();
+		return NULL;
+	}
+	const unsigned h = extHash(m_salt, ext, len);
+	const int idx = m_slots[mix(h, m_disp[mix(h, 0) % m_disp.size()]) & m_mask];
+	if (idx == -1 || !sameExt(m_entries[idx].ext, ext, len))
+		return NULL;
+	return m_types[m_entries[idx].type].c_str();
+}
+
+const char *MimeTypes::forPath(const std::string &path) const
+{
+	// one pass back to the last '.' of the last path segment
+	const char *p = path.data();
+	size_t i = path.size();
+	while (i > 0 && p[i - 1] != '.' && p[i - 1] != '/' && p[i - 1] != '\\')
+		--i;
+	if (i == 0 || p[i - 1] != '.')
+		return DEFAULT_TYPE;
+	const char *type = lookup(p + i, path.size() - i);
+	return type ? type : DEFAULT_TYPE;
+}
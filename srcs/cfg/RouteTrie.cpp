@@ -0,0 +1,133 @@
+#include <algorithm>
+
+#include "RouteTrie.hpp"
+
+RouteTrie::RouteTrie() : m_nodes(), m_routes(0), m_irregular(false), m_built(false)
+{
+	clear();
+}
+
+void RouteTrie::clear()
+{
+	m_nodes.clear();
+	Node root;
+	root.route = -1;
+	root.routeLen = 0;
+	m_nodes.push_back(root);
+	m_routes = 0;
+	m_irregular = false;
+	m_built = false;
+}
+
+int RouteTrie::addChild(int node, const std::string &seg)
+{
+	std::vector<Edge> &edges = m_nodes[node].edges;
+	for (size_t i = 0; i < edges.size(); ++i)
+		if (edges[i].segment == seg)
+			return edges[i].child;
+	Node n;
+	n.route = -1;
+	n.routeLen = 0;
+	m_nodes.push_back(n);
+	Edge e;
+	e.segment = seg;
+	e.child = static_cast<int>(m_nodes.size() - 1);
+	m_nodes[node].edges.push_back(e);
+	return e.child;
+}
+
+// Longer location string wins the node, the first one on a tie.
+void RouteTrie::claim(int node, int index, size_t len)
+{
+	Node &n = m_nodes[node];
+	if (n.route == -1 || len > n.routeLen)
+	{
+		n.route = index;
+		n.routeLen = len;
+	}
+}
+
+void RouteTrie::add(const std::string &location, int index)
+{
+	++m_routes;
+	m_built = false;
+	if (location.empty())
+		return; // the scan never picks a zero-length match either
+	if (location[0] != '/' || location.find("//") != std::string::npos)
+	{
+		m_irregular = true;
+		return;
+	}
+	// "/a/b/" and "/a/b" end on the same node
+	size_t end = location.size();
+	if (location[end - 1] == '/')
+		--end;
+	int node = 0;
+	size_t pos = 1;
+	while (pos < end)
+	{
+		size_t slash = location.find('/', pos);
+		if (slash == std::string::npos || slash > end)
+			slash = end;
+		node = addChild(node, location.substr(pos, slash - pos));
+		pos = slash + 1;
+	}
+	claim(node, index, location.size());
+}
+
+bool RouteTrie::edgeBefore(const Edge &a, const Edge &b)
+{
+	return a.segment < b.segment;
+}
+
+void RouteTrie::finish()
+{
+	for (size_t i = 0; i < m_nodes.size(); ++i)
+		std::sort(m_nodes[i].edges.begin(), m_nodes[i].edges.end(), edgeBefore);
+	m_built = true;
+}
+
+int RouteTrie::child(int node, const char *seg, size_t len) const
+{
+	const std::vector<Edge> &edges = m_nodes[node].edges;
+	size_t lo = 0;
+	size_t hi = edges.size();
+	while (lo < hi)
+	{
+		const size_t mid = (lo + hi) / 2;
+		const int c = edges[mid].segment.compare(0, std::string::npos, seg, len);
+		if (c == 0)
+			return edges[mid].child;
+		if (c < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return -1;
+}
+
+// Deepest node on the path that holds a location: deeper always means a
+// longer location string, so that is the longest match.
+bool RouteTrie::match(const std::string &path, size_t routeCount, int &index) const
+{
+	if (!m_built || m_irregular || routeCount != m_routes ||
+		path.empty() || path[0] != '/')
+		return false;
+	int node = 0;
+	int best = m_nodes[0].route;
+	size_t pos = 1;
+	while (pos < path.size())
+	{
+		size_t slash = path.find('/', pos);
+		if (slash == std::string::npos)
+			slash = path.size();
+		node = child(node, path.data() + pos, slash - pos);
+		if (node == -1)
+			break;
+		if (m_nodes[node].route != -1)
+			best = m_nodes[node].route;
+		pos = slash + 1;
+	}
+	index = best;
+	return true;
+}
@@ -15,11 +15,12 @@
 
 static const size_t CGI_HIGH_WATER = 1 << 20; // 1 MiB
 static const size_t CGI_LOW_WATER = 1 << 19;  // 512 KiB
+static const size_t CGI_READ_MAX = 64 << 10;   // one pipe's worth
 
 Cgi::Cgi()
 	: pid(-1), stdin_w(-1), stdout_r(-1), stdin_closed(-1), stdoutPaused(false),
 	  headersParsed(false), cgiStatus(200), bytesInTotal(0), bytesOutTotal(0),
-	  tStartMs(0ULL)
+	  tStartMs(0ULL), route(NULL), fcgiConn(-1), fastcgi(false)
 {
 	inBuf.clear();
 	outBuf.clear();
@@ -31,18 +32,22 @@ Cgi::Cgi()
 // Review this black magic
 void SocketManager::checkCgiTimeouts()
 {
+	// Called on every loop turn: without a live CGI pipe there is nothing to
+	// time out, don't walk every idle keep-alive client for nothing.
+	if (m_cgiPipes == 0)
+		return;
+
 	const unsigned long long now = now_ms();
 	std::vector<int> toTimeout;
 
 	// Pass 1: just collect which FDs timed out
-	for (std::map<int, ClientState>::iterator it = m_clients.begin();
-		 it != m_clients.end(); ++it)
+	for (size_t i = 0; i < m_clientList.size(); ++i)
 	{
-		int fd = it->first;
-		ClientState &st = it->second;
+		int fd = m_clientFds[i];
+		ClientState &st = *m_clientList[i];
 
 		// No CGI running → skip
-		if (st.cgi.pid <= 0)
+		if (st.cgi.pid <= 0 && !st.cgi.fastcgi)
 			continue;
 
 		// Already parsed CGI headers → we've already sent/started a response,
@@ -50,11 +55,7 @@ void SocketManager::checkCgiTimeouts()
 			continue;
 
 		// Find route to read cgi_timeout_ms
-		const ServerConfig &srv = m_serversConfig[m_clientToServerIndex[fd]];
-		std::string urlPath, query;
-		splitPathAndQuery(st.req.path, urlPath, query); // IMPORTANT: strip ?foo=bar
-
-		const RouteConfig *rt = findMatchingLocation(srv, urlPath);
+		const RouteConfig *rt = cgiRouteFor(fd, st);
 		size_t timeout_ms = 0;
 		if (rt)
 			timeout_ms = rt->cgi_timeout_ms;
@@ -72,38 +73,19 @@ void SocketManager::checkCgiTimeouts()
 	{
 		int fd = toTimeout[i];
 
-		std::map<int, ClientState>::iterator it = m_clients.find(fd);
-		if (it == m_clients.end())
+		ClientState *stp = findClient(fd);
+		if (!stp)
 			continue; // already gone
 
-		ClientState &st = it->second;
+		ClientState &st = *stp;
 
-		const ServerConfig &srv = m_serversConfig[m_clientToServerIndex[fd]];
-		std::string urlPath, query;
-		splitPathAndQuery(st.req.path, urlPath, query);
-		const RouteConfig *rt = findMatchingLocation(srv, urlPath);
+		const ServerConfig &srv = findServerForClient(fd);
+		const RouteConfig *rt = cgiRouteFor(fd, st);
 
-		// 1) Kill CGI process
-		killCgiProcess(st, SIGKILL);
+		// 1) Kill CGI process, close pipes / the FastCGI connection
+		releaseCgiPipes(st);
 
-		// 2) Close pipes & remove from poll
-		if (st.cgi.stdin_w != -1)
-		{
-			delPollFd(st.cgi.stdin_w);
-			::close(st.cgi.stdin_w);
-			m_cgiStdinToClient.erase(st.cgi.stdin_w);
-			st.cgi.stdin_w = -1;
-			st.cgi.stdin_closed = true;
-		}
-		if (st.cgi.stdout_r != -1)
-		{
-			delPollFd(st.cgi.stdout_r);
-			::close(st.cgi.stdout_r);
-			m_cgiStdoutToClient.erase(st.cgi.stdout_r);
-			st.cgi.stdout_r = -1;
-		}
-
-		// 3) Queue 504 response
+		// 2) Queue 504 response
 		Response err;
 		if (rt)
 			err = makeConfigErrorResponse(srv, rt, 504, "Gateway Timeout",
@@ -138,97 +120,146 @@ void Cgi::reset()
 
 	tStartMs = 0ULL;
 	scriptFsPath.clear();
+	route = NULL;
 	workingDir.clear();
+	fcgiConn = -1;
+	fastcgi = false;
 }
 
 void SocketManager::addPollFd(int fd, short events)
 {
-	struct pollfd p;
-	p.fd = fd;
-	p.events = events;
-	p.revents = 0;
-	m_pollfds.push_back(p);
+	m_events->add(fd, events);
 }
+
 void SocketManager::modPollEvents(int fd, short setMask, short clearMask)
 {
-	for (size_t i = 0; i < m_pollfds.size(); ++i)
-		if (m_pollfds[i].fd == fd)
-		{
-			m_pollfds[i].events |= setMask;
-			m_pollfds[i].events &= ~clearMask;
-			break;
-		}
+	m_events->modify(fd, setMask, clearMask);
 }
 
 void SocketManager::delPollFd(int fd)
 {
-	for (size_t i = 0; i < m_pollfds.size(); ++i)
+	m_events->remove(fd);
+}
+
+void SocketManager::bindCgiPipe(int pipefd, FdSlot::Kind kind, int clientFd)
+{
+	FdSlot &slot = slotFor(pipefd);
+	slot.kind = kind;
+	slot.owner = clientFd;
+	++slot.generation;
+	++m_cgiPipes;
+}
+
+void SocketManager::unbindCgiPipe(int pipefd)
+{
+	if (pipefd < 0 || static_cast<size_t>(pipefd) >= m_slots.size())
+		return;
+	FdSlot &slot = m_slots[pipefd];
+	if (slot.kind != FdSlot::CGI_STDIN && slot.kind != FdSlot::CGI_STDOUT)
+		return;
+	slot.kind = FdSlot::FREE;
+	slot.owner = -1;
+	--m_cgiPipes;
+}
+
+// Client fd owning this pipe, or -1 if pipefd is not a CGI pipe of that kind.
+int SocketManager::cgiPipeOwner(int pipefd, FdSlot::Kind kind) const
+{
+	if (pipefd < 0 || static_cast<size_t>(pipefd) >= m_slots.size())
+		return -1;
+	const FdSlot &slot = m_slots[pipefd];
+	return slot.kind == kind ? slot.owner : -1;
+}
+
+// Client went away mid-CGI (or the CGI failed): drop the pipes and the child
+// with it, or the FastCGI request.
+void SocketManager::releaseCgiPipes(ClientState &st)
+{
+	releaseFastCgi(st);
+	if (st.cgi.stdin_w != -1)
 	{
-		if (m_pollfds[i].fd == fd)
-		{
-			m_pollfds.erase(m_pollfds.begin() + i);
-			break;
-		}
+		delPollFd(st.cgi.stdin_w);
+		::close(st.cgi.stdin_w);
+		unbindCgiPipe(st.cgi.stdin_w);
+		st.cgi.stdin_w = -1;
+		st.cgi.stdin_closed = true;
+	}
+	if (st.cgi.stdout_r != -1)
+	{
+		delPollFd(st.cgi.stdout_r);
+		::close(st.cgi.stdout_r);
+		unbindCgiPipe(st.cgi.stdout_r);
+		st.cgi.stdout_r = -1;
+	}
+	if (st.cgi.pid > 0)
+	{
+		killCgiProcess(st, SIGKILL);
+		reapCgiIfDone(st);
 	}
 }
 
 void SocketManager::pauseCgiStdoutIfNeeded(int clientFd, ClientState &st)
 {
 	(void)clientFd;
-	if (st.cgi.stdout_r == -1 || st.cgi.stdoutPaused)
+	if (!st.cgi.stdoutOpen() || st.cgi.stdoutPaused)
 		return;
-	if (st.writeBuffer.size() < CGI_HIGH_WATER)
+	if (st.out.size() < CGI_HIGH_WATER)
 		return;
-	delPollFd(st.cgi.stdout_r);
+	if (st.cgi.stdout_r != -1)
+		delPollFd(st.cgi.stdout_r);
+	else
+		modPollEvents(st.cgi.fcgiConn, 0, POLLIN);
 	st.cgi.stdoutPaused = true;
 }
 
 void SocketManager::maybeResumeCgiStdout(int clientFd, ClientState &st)
 {
 	(void)clientFd;
-	if (st.cgi.stdout_r == -1 || !st.cgi.stdoutPaused)
+	if (!st.cgi.stdoutOpen() || !st.cgi.stdoutPaused)
 		return;
-	if (st.writeBuffer.size() > CGI_LOW_WATER)
+	if (st.out.size() > CGI_LOW_WATER)
 		return;
-	addPollFd(st.cgi.stdout_r, POLLIN);
+	if (st.cgi.stdout_r != -1)
+		addPollFd(st.cgi.stdout_r, POLLIN);
+	else
+		modPollEvents(st.cgi.fcgiConn, POLLIN, 0);
 	st.cgi.stdoutPaused = false;
 }
 
 bool SocketManager::isCgiStdout(int fd) const
 {
-	return m_cgiStdoutToClient.find(fd) != m_cgiStdoutToClient.end();
+	return cgiPipeOwner(fd, FdSlot::CGI_STDOUT) != -1;
 }
 
 bool SocketManager::isCgiStdin(int fd) const
 {
-	return m_cgiStdinToClient.find(fd) != m_cgiStdinToClient.end();
+	return cgiPipeOwner(fd, FdSlot::CGI_STDIN) != -1;
 }
 
 void SocketManager::handleCgiWritable(int pipefd)
 {
-	std::map<int, int>::iterator it = m_cgiStdinToClient.find(pipefd);
-	if (it == m_cgiStdinToClient.end())
+	int clientFd = cgiPipeOwner(pipefd, FdSlot::CGI_STDIN);
+	if (clientFd == -1)
 		return;
 
-	int clientFd = it->second;
-	ClientState &st = m_clients[clientFd];
-
-	if (st.cgi.stdin_w != pipefd || st.cgi.stdin_closed)
+	ClientState *stp = findClient(clientFd);
+	if (!stp || stp->cgi.stdin_w != pipefd || stp->cgi.stdin_closed)
 	{
 		delPollFd(pipefd);
-		m_cgiStdinToClient.erase(it);
+		unbindCgiPipe(pipefd);
 		return;
 	}
+	ClientState &st = *stp;
 
 	bool shouldClose = st.cgi.inBuf.empty();
 
 	if (!st.cgi.inBuf.empty())
 	{
-		ssize_t n = ::write(pipefd, &st.cgi.inBuf[0], st.cgi.inBuf.size());
+		ssize_t n = ::write(pipefd, st.cgi.inBuf.data(), st.cgi.inBuf.size());
 
 		if (n > 0)
 		{
-			st.cgi.inBuf.erase(0, static_cast<size_t>(n));
+			st.cgi.inBuf.consume(static_cast<size_t>(n));
 			st.cgi.bytesInTotal += static_cast<size_t>(n);
 			shouldClose = st.cgi.inBuf.empty(); // close when request body fully sent
 		}
@@ -240,38 +271,49 @@ void SocketManager::handleCgiWritable(int pipefd)
 
 	if (shouldClose)
 	{
+		delPollFd(pipefd);
 		::close(pipefd);
 		st.cgi.stdin_w = -1;
 		st.cgi.stdin_closed = true;
-		delPollFd(pipefd);
-		m_cgiStdinToClient.erase(it);
+		unbindCgiPipe(pipefd);
 	}
 }
 
 void SocketManager::handleCgiReadable(int pipefd)
 {
-	std::map<int, int>::iterator it = m_cgiStdoutToClient.find(pipefd);
-	if (it == m_cgiStdoutToClient.end())
+	int clientFd = cgiPipeOwner(pipefd, FdSlot::CGI_STDOUT);
+	if (clientFd == -1)
 		return;
 
-	int clientFd = it->second;
-	ClientState &st = m_clients[clientFd];
-
-	char buf[4096];
-
-	ssize_t n = ::read(pipefd, buf, sizeof(buf));
+	ClientState *stp = findClient(clientFd);
+	if (!stp)
+	{
+		delPollFd(pipefd);
+		unbindCgiPipe(pipefd);
+		return;
+	}
+	ClientState &st = *stp;
+
+	// Straight onto outBuf's tail, a full pipe buffer at a time unless
+	// io_budget_bytes says less.
+	size_t room = CGI_READ_MAX;
+	if (m_config.io_budget_bytes && room > m_config.io_budget_bytes)
+		room = m_config.io_budget_bytes;
+	const size_t old = st.cgi.outBuf.size();
+	st.cgi.outBuf.resize(old + room);
+	ssize_t n = ::read(pipefd, &st.cgi.outBuf[old], room);
+	st.cgi.outBuf.resize(old + (n > 0 ? static_cast<size_t>(n) : 0));
 
 	if (n > 0)
 	{
-		st.cgi.outBuf.append(buf, static_cast<size_t>(n));
 		drainCgiOutput(clientFd); // parse headers / push body / enforce caps
 	}
 	else
 	{
+		delPollFd(pipefd);
 		::close(pipefd);
 		st.cgi.stdout_r = -1;
-		delPollFd(pipefd);
-		m_cgiStdoutToClient.erase(it);
+		unbindCgiPipe(pipefd);
 
 		drainCgiOutput(clientFd);
 	}
@@ -279,23 +321,32 @@ void SocketManager::handleCgiReadable(int pipefd)
 
 void SocketManager::handleCgiPipeError(int pipefd)
 {
-	if (isCgiStdout(pipefd))
+	int clientFd = cgiPipeOwner(pipefd, FdSlot::CGI_STDOUT);
+	if (clientFd != -1)
 	{
-		int clientFd = m_cgiStdoutToClient[pipefd];
 		delPollFd(pipefd);
 		::close(pipefd);
-		m_cgiStdoutToClient.erase(pipefd);
-		m_clients[clientFd].cgi.stdout_r = -1;
-		drainCgiOutput(clientFd);
+		unbindCgiPipe(pipefd);
+		ClientState *st = findClient(clientFd);
+		if (st)
+		{
+			st->cgi.stdout_r = -1;
+			drainCgiOutput(clientFd);
+		}
+		return;
 	}
-	if (isCgiStdin(pipefd))
+	clientFd = cgiPipeOwner(pipefd, FdSlot::CGI_STDIN);
+	if (clientFd != -1)
 	{
-		int clientFd = m_cgiStdinToClient[pipefd];
 		delPollFd(pipefd);
 		::close(pipefd);
-		m_cgiStdinToClient.erase(pipefd);
-		m_clients[clientFd].cgi.stdin_w = -1;
-		m_clients[clientFd].cgi.stdin_closed = true;
+		unbindCgiPipe(pipefd);
+		ClientState *st = findClient(clientFd);
+		if (st)
+		{
+			st->cgi.stdin_w = -1;
+			st->cgi.stdin_closed = true;
+		}
 	}
 }
 
@@ -322,39 +373,6 @@ void SocketManager::reapCgiIfDone(ClientState &st)
 	}
 }
 
-static void
-inject_header_lines_before_body(std::string &respBuf,
-								const std::vector<std::string> &lines)
-{
-	if (lines.empty())
-		return;
-	size_t p = respBuf.find("\r\n\r\n");
-	if (p == std::string::npos)
-	{
-		p = respBuf.find("\n\n");
-	}
-	if (p == std::string::npos)
-	{
-		std::string block;
-		for (size_t i = 0; i < lines.size(); ++i)
-		{
-			block += lines[i];
-			if (block.size() < 2 || block.substr(block.size() - 2) != "\r\n")
-				block += "\r\n";
-		}
-		respBuf = block + respBuf;
-		return;
-	}
-	std::string block;
-	for (size_t i = 0; i < lines.size(); ++i)
-	{
-		block += lines[i];
-		if (block.size() < 2 || block.substr(block.size() - 2) != "\r\n")
-			block += "\r\n";
-	}
-	respBuf.insert(p, block);
-}
-
 static bool isHopByHop(const std::string &k)
 {
 	return k == "connection" || k == "transfer-encoding" || k == "keep-alive" ||
@@ -435,23 +453,11 @@ bool SocketManager::parseCgiHeaders(ClientState &st, int clientFd,
 		st.cgi.outBuf.find("\n\n") == std::string::npos)
 	{
 		// No header terminator within cap — treat as bad gateway
-		killCgiProcess(st, SIGKILL);
+		releaseCgiPipes(st);
 		Response err = makeHtmlError(
 			502, "Bad Gateway",
 			"<h1>502 Bad Gateway</h1><p>CGI produced no headers.</p>");
 		finalizeAndQueue(clientFd, st.req, err, false, true);
-		// close pipes
-		if (st.cgi.stdin_w != -1)
-		{
-			::close(st.cgi.stdin_w);
-			st.cgi.stdin_w = -1;
-		}
-		if (st.cgi.stdout_r != -1)
-		{
-			::close(st.cgi.stdout_r);
-			st.cgi.stdout_r = -1;
-		}
-		reapCgiIfDone(st);
 		return false;
 	}
 
@@ -534,16 +540,10 @@ bool SocketManager::parseCgiHeaders(ClientState &st, int clientFd,
 	// Queue headers. IMPORTANT: pass (body_expected=false,
 	// body_fully_consumed=true) so we DON'T force-close right away; we'll stream
 	// the body manually.
+	res.header_lines.swap(setCookieLines);
 	finalizeAndQueue(clientFd, st.req, res, /*body_expected=*/false,
 					 /*body_fully_consumed=*/true);
 
-	if (!setCookieLines.empty())
-	{
-		inject_header_lines_before_body(st.writeBuffer, setCookieLines);
-		setPollToWrite(clientFd);
-		tryFlushWrite(clientFd, st);
-	}
-
 	st.cgi.headersParsed = true;
 	st.cgi.cgiHeaders.swap(merged);
 	return true;
@@ -551,19 +551,16 @@ bool SocketManager::parseCgiHeaders(ClientState &st, int clientFd,
 
 void SocketManager::drainCgiOutput(int clientFd)
 {
-	std::map<int, ClientState>::iterator itc = m_clients.find(clientFd);
-	if (itc == m_clients.end())
+	ClientState *stp = findClient(clientFd);
+	if (!stp)
 		return;
 
-	ClientState &st = itc->second;
-	if (st.cgi.pid <= 0 && st.cgi.stdout_r == -1 && !clientHasPendingWrite(st))
+	ClientState &st = *stp;
+	if (st.cgi.pid <= 0 && !st.cgi.fastcgi && !st.cgi.stdoutOpen() &&
+		!clientHasPendingWrite(st))
 		return;
 
-	const ServerConfig &srv = m_serversConfig[m_clientToServerIndex[clientFd]];
-
-	std::string urlPath, query;
-	splitPathAndQuery(st.req.path, urlPath, query);
-	const RouteConfig *matchedRoute = findMatchingLocation(srv, urlPath);
+	const RouteConfig *matchedRoute = cgiRouteFor(clientFd, st);
 	RouteConfig fallbackRoute;
 	const RouteConfig &route = matchedRoute ? *matchedRoute : fallbackRoute;
 	const size_t timeout_ms = route.cgi_timeout_ms;
@@ -572,28 +569,10 @@ void SocketManager::drainCgiOutput(int clientFd)
 	const unsigned long long elapsed = now_ms() - st.cgi.tStartMs;
 	if (timeout_ms > 0 && elapsed > static_cast<unsigned long long>(timeout_ms))
 	{
-		killCgiProcess(st, SIGKILL);
-
-		if (st.cgi.stdin_w != -1)
-		{
-			delPollFd(st.cgi.stdin_w);
-			::close(st.cgi.stdin_w);
-			m_cgiStdinToClient.erase(st.cgi.stdin_w);
-			st.cgi.stdin_w = -1;
-			st.cgi.stdin_closed = true;
-		}
-		if (st.cgi.stdout_r != -1)
-		{
-			delPollFd(st.cgi.stdout_r);
-			::close(st.cgi.stdout_r);
-			m_cgiStdoutToClient.erase(st.cgi.stdout_r);
-			st.cgi.stdout_r = -1;
-		}
-
+		releaseCgiPipes(st);
 		Response err =
 			makeHtmlError(504, "Gateway Timeout", "<h1>504 Gateway Timeout</h1>");
 		finalizeAndQueue(clientFd, st.req, err, false, true);
-		reapCgiIfDone(st);
 		return;
 	}
 
@@ -606,22 +585,12 @@ void SocketManager::drainCgiOutput(int clientFd)
 		}
 	}
 
-	if (!st.cgi.headersParsed && st.cgi.stdout_r == -1)
+	if (!st.cgi.headersParsed && !st.cgi.stdoutOpen())
 	{
-		killCgiProcess(st, SIGKILL);
-
-		if (st.cgi.stdin_w != -1)
-		{
-			delPollFd(st.cgi.stdin_w);
-			::close(st.cgi.stdin_w);
-			m_cgiStdinToClient.erase(st.cgi.stdin_w);
-			st.cgi.stdin_w = -1;
-			st.cgi.stdin_closed = true;
-		}
+		releaseCgiPipes(st);
 		Response err = makeHtmlError(
 			502, "Bad Gateway", "<h1>502 Bad Gateway</h1><p>CGI exited early.</p>");
 		finalizeAndQueue(clientFd, st.req, err, false, true);
-		reapCgiIfDone(st);
 		return;
 	}
 
@@ -630,29 +599,11 @@ void SocketManager::drainCgiOutput(int clientFd)
 		if (max_bytes > 0 &&
 			st.cgi.bytesOutTotal + st.cgi.outBuf.size() > max_bytes)
 		{
-			killCgiProcess(st, SIGKILL);
-
-			if (st.cgi.stdin_w != -1)
-			{
-				delPollFd(st.cgi.stdin_w);
-				::close(st.cgi.stdin_w);
-				m_cgiStdinToClient.erase(st.cgi.stdin_w);
-				st.cgi.stdin_w = -1;
-				st.cgi.stdin_closed = true;
-			}
-			if (st.cgi.stdout_r != -1)
-			{
-				delPollFd(st.cgi.stdout_r);
-				::close(st.cgi.stdout_r);
-				m_cgiStdoutToClient.erase(st.cgi.stdout_r);
-				st.cgi.stdout_r = -1;
-			}
-
+			releaseCgiPipes(st);
 			Response err =
 				makeHtmlError(502, "Bad Gateway",
 							  "<h1>502 Bad Gateway</h1><p>CGI output too large.</p>");
 			finalizeAndQueue(clientFd, st.req, err, false, true);
-			reapCgiIfDone(st);
 			return;
 		}
 
@@ -663,17 +614,17 @@ void SocketManager::drainCgiOutput(int clientFd)
 		}
 		else
 		{
-			st.writeBuffer.append(st.cgi.outBuf);
-			pauseCgiStdoutIfNeeded(clientFd, st);
 			st.cgi.bytesOutTotal += st.cgi.outBuf.size();
-			st.cgi.outBuf.clear();
+			st.out.appendSwap(st.cgi.outBuf); // leaves outBuf empty
+			pauseCgiStdoutIfNeeded(clientFd, st);
 			setPollToWrite(clientFd);
 			tryFlushWrite(clientFd, st);
 		}
 	}
 
-	if (st.cgi.stdout_r == -1)
+	if (!st.cgi.stdoutOpen())
 	{
+		st.cgi.fastcgi = false; // its end is handled
 		bool haveCL = false;
 		bool haveTE = false;
 		if (!st.cgi.cgiHeaders.empty())
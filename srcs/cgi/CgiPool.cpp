@@ -0,0 +1,305 @@
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/prctl.h>
+#endif
+
+#include "FastCgi.hpp"
+#include "SocketManager.hpp"
+
+extern char **environ;
+
+// A worker is respawned no sooner than this after its previous spawn, so a
+// broken cgi_worker command costs one fork a second instead of a spin.
+static const unsigned long long CGI_WORKER_RESPAWN_MS = 1000;
+// An idle worker not heard from for this long gets an FCGI_GET_VALUES, and
+// is killed if the answer doesn't come in time.
+static const unsigned long long CGI_WORKER_PROBE_MS = 2000;
+static const unsigned long long CGI_WORKER_PROBE_TIMEOUT_MS = 1000;
+// SIGTERM first, SIGKILL if it is still there after this.
+static const unsigned long long CGI_WORKER_STOP_MS = 2000;
+// superviseCgiWorkers() runs every loop turn but works at most this often.
+static const unsigned long long CGI_POOL_CHECK_MS = 100;
+
+CgiWorker::CgiWorker()
+	: pid(-1), conn(-1), served(0), startedMs(0ULL), aliveMs(0ULL),
+	  probeMs(0ULL), stopMs(0ULL)
+{
+	return;
+}
+
+void SocketManager::startCgiPools()
+{
+	for (size_t s = 0; s < m_serversConfig.size(); ++s)
+	{
+		const std::vector<RouteConfig> &routes = m_serversConfig[s].routes;
+		for (size_t r = 0; r < routes.size(); ++r)
+		{
+			if (!routes[r].cgi_workers)
+				continue;
+			CgiPool pool;
+			pool.route = &routes[r];
+			pool.workers.resize(routes[r].cgi_workers);
+			pool.next = 0;
+			m_cgiPools.push_back(pool);
+			for (size_t w = 0; w < routes[r].cgi_workers; ++w)
+				spawnCgiWorker(m_cgiPools.size() - 1, w);
+		}
+	}
+}
+
+// Shutdown: the connections are closed by the destructor; the workers get
+// SIGTERM and CGI_WORKER_STOP_MS to go before SIGKILL.
+void SocketManager::stopCgiPools()
+{
+	for (size_t p = 0; p < m_cgiPools.size(); ++p)
+		for (size_t i = 0; i < m_cgiPools[p].workers.size(); ++i)
+			stopCgiWorker(m_cgiPools[p].workers[i], SIGTERM);
+
+	const unsigned long long deadline = now_ms() + CGI_WORKER_STOP_MS;
+	for (size_t p = 0; p < m_cgiPools.size(); ++p)
+	{
+		for (size_t i = 0; i < m_cgiPools[p].workers.size(); ++i)
+		{
+			CgiWorker &w = m_cgiPools[p].workers[i];
+			while (w.pid > 0 && ::waitpid(w.pid, NULL, WNOHANG) == 0)
+			{
+				if (now_ms() > deadline)
+				{
+					::kill(w.pid, SIGKILL);
+					::waitpid(w.pid, NULL, 0);
+					break;
+				}
+				usleep(10000);
+			}
+			w.pid = -1;
+		}
+	}
+	m_cgiPools.clear();
+}
+
+// fork()/execve() the location's cgi_worker command with fd 0 a listening
+// unix socket (what FastCGI applications expect there) that already holds
+// our connection in its backlog. The path is unlinked before the worker
+// runs, so that one connection is all it will ever see.
+bool SocketManager::spawnCgiWorker(size_t p, size_t i)
+{
+	const RouteConfig &route = *m_cgiPools[p].route;
+	CgiWorker &w = m_cgiPools[p].workers[i];
+	w = CgiWorker();
+	w.startedMs = now_ms(); // on failure too: the respawn waits either way
+
+	std::ostringstream path;
+	path << "/tmp/webserv-cgi-" << getpid() << "-" << p << "-" << i << ".sock";
+	struct sockaddr_un sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	const std::string sockPath = path.str();
+	if (sockPath.size() >= sizeof(sa.sun_path))
+		return false;
+	std::memcpy(sa.sun_path, sockPath.c_str(), sockPath.size() + 1);
+	const struct sockaddr *addr = reinterpret_cast<struct sockaddr *>(&sa);
+
+	::unlink(sa.sun_path);
+	const int lfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	const int cfd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0 || cfd < 0 || ::bind(lfd, addr, sizeof(sa)) != 0 ||
+		::listen(lfd, 1) != 0 || ::connect(cfd, addr, sizeof(sa)) != 0)
+	{
+		std::cerr << "[cgi-pool] " << route.path << " worker " << i
+				  << ": socket setup failed" << std::endl;
+		::unlink(sa.sun_path);
+		if (lfd >= 0)
+			::close(lfd);
+		if (cfd >= 0)
+			::close(cfd);
+		return false;
+	}
+	::unlink(sa.sun_path);
+	fcntl(cfd, F_SETFL, O_NONBLOCK);
+
+	// argv before fork()
+	std::vector<char *> argv;
+	for (size_t k = 0; k < route.cgi_worker.size(); ++k)
+		argv.push_back(const_cast<char *>(route.cgi_worker[k].c_str()));
+	argv.push_back(NULL);
+
+	const pid_t pid = ::fork();
+	if (pid < 0)
+	{
+		::close(lfd);
+		::close(cfd);
+		return false;
+	}
+	if (pid == 0)
+	{
+#ifdef __linux__
+		// server killed hard: don't leave the interpreters behind
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		::dup2(lfd, STDIN_FILENO);
+		std::vector<int> inherited;
+		m_events->watchedFds(inherited);
+		for (size_t k = 0; k < inherited.size(); ++k)
+			if (inherited[k] > 2)
+				::close(inherited[k]);
+		::close(lfd);
+		::close(cfd);
+		::execve(argv[0], &argv[0], environ);
+		std::exit(127);
+	}
+	::close(lfd);
+
+	std::ostringstream name;
+	name << "cgi worker " << route.path << " #" << i;
+	w.pid = pid;
+	w.aliveMs = w.startedMs;
+	w.conn = adoptFcgiConn(cfd, name.str());
+	m_fcgiConns[w.conn]->pool = static_cast<int>(p);
+	m_fcgiConns[w.conn]->worker = i;
+	std::cerr << "[cgi-pool] " << route.path << " worker " << i << " pid " << pid
+			  << std::endl;
+	return true;
+}
+
+void SocketManager::stopCgiWorker(CgiWorker &w, int sig)
+{
+	if (w.pid <= 0)
+		return;
+	::kill(w.pid, sig);
+	if (!w.stopMs)
+		w.stopMs = now_ms();
+}
+
+// An idle, healthy worker of the pool for `route` (round robin), its request
+// counted; -1 if there is no pool or every worker is busy or (re)starting.
+int SocketManager::acquireCgiWorker(const RouteConfig &route)
+{
+	for (size_t p = 0; p < m_cgiPools.size(); ++p)
+	{
+		CgiPool &pool = m_cgiPools[p];
+		if (pool.route != &route)
+			continue;
+		const size_t n = pool.workers.size();
+		for (size_t k = 0; k < n; ++k)
+		{
+			const size_t i = (pool.next + k) % n;
+			CgiWorker &w = pool.workers[i];
+			if (w.pid <= 0 || w.conn == -1 || w.stopMs ||
+				m_fcgiConns[w.conn]->client != -1)
+				continue;
+			++w.served;
+			pool.next = i + 1;
+			return w.conn;
+		}
+		return -1;
+	}
+	return -1;
+}
+
+// A request on a worker's connection ended cleanly; it is retired once it
+// has served cgi_worker_max_requests.
+void SocketManager::cgiWorkerIdle(int connFd)
+{
+	const FcgiConn &c = *m_fcgiConns[connFd];
+	CgiWorker &w = m_cgiPools[c.pool].workers[c.worker];
+	const RouteConfig &route = *m_cgiPools[c.pool].route;
+	w.aliveMs = now_ms();
+	if (route.cgi_worker_max_requests && w.served >= route.cgi_worker_max_requests)
+	{
+		std::cerr << "[cgi-pool] " << route.path << " worker " << c.worker
+				  << " recycled after " << w.served << " requests" << std::endl;
+		closeFcgiConn(connFd);
+	}
+}
+
+// Its FCGI_GET_VALUES_RESULT came: the probe is answered.
+void SocketManager::cgiWorkerAnswered(const FcgiConn &c)
+{
+	CgiWorker &w = m_cgiPools[c.pool].workers[c.worker];
+	w.probeMs = 0;
+	w.aliveMs = now_ms();
+}
+
+// The worker's connection is being closed (EOF, error, a request given up
+// on, recycling): the worker is useless without it.
+void SocketManager::cgiWorkerGone(int connFd)
+{
+	const FcgiConn &c = *m_fcgiConns[connFd];
+	CgiWorker &w = m_cgiPools[c.pool].workers[c.worker];
+	w.conn = -1;
+	stopCgiWorker(w, SIGTERM);
+}
+
+// Reap, probe, stop and respawn; called every loop turn.
+void SocketManager::superviseCgiWorkers()
+{
+	if (m_cgiPools.empty())
+		return;
+	const unsigned long long now = now_ms();
+	if (now - m_cgiPoolCheckMs < CGI_POOL_CHECK_MS)
+		return;
+	m_cgiPoolCheckMs = now;
+
+	for (size_t p = 0; p < m_cgiPools.size(); ++p)
+	{
+		CgiPool &pool = m_cgiPools[p];
+		for (size_t i = 0; i < pool.workers.size(); ++i)
+		{
+			CgiWorker &w = pool.workers[i];
+			int status = 0;
+			if (w.pid > 0 && ::waitpid(w.pid, &status, WNOHANG) == w.pid)
+			{
+				std::cerr << "[cgi-pool] " << pool.route->path << " worker " << i
+						  << " (pid " << w.pid << ") ";
+				if (WIFSIGNALED(status))
+					std::cerr << "killed by signal " << WTERMSIG(status);
+				else
+					std::cerr << "exited with status " << WEXITSTATUS(status);
+				std::cerr << " after " << w.served << " requests" << std::endl;
+				w.pid = -1;
+			}
+
+			const bool idle = w.conn != -1 && m_fcgiConns[w.conn]->client == -1;
+			if (w.pid <= 0)
+			{
+				// a request in flight ends on the connection's EOF (or its
+				// timeout), like a CGI child's pipe; an idle one can go now
+				if (idle)
+					closeFcgiConn(w.conn);
+				if (w.conn == -1 && now - w.startedMs >= CGI_WORKER_RESPAWN_MS)
+					spawnCgiWorker(p, i);
+				continue;
+			}
+			if (w.stopMs)
+			{
+				if (now - w.stopMs > CGI_WORKER_STOP_MS)
+					::kill(w.pid, SIGKILL);
+				continue;
+			}
+			if (w.probeMs && now - w.probeMs > CGI_WORKER_PROBE_TIMEOUT_MS)
+			{
+				std::cerr << "[cgi-pool] " << pool.route->path << " worker " << i
+						  << " (pid " << w.pid << ") not answering, killed" << std::endl;
+				stopCgiWorker(w, SIGKILL);
+				if (idle)
+					closeFcgiConn(w.conn);
+				continue;
+			}
+			if (idle && !w.probeMs && now - w.aliveMs >= CGI_WORKER_PROBE_MS)
+			{
+				fcgiGetValues(m_fcgiConns[w.conn]->out);
+				modPollEvents(w.conn, POLLOUT, 0);
+				w.probeMs = now;
+			}
+		}
+	}
+}
@@ -0,0 +1,140 @@
+#include <cstring>
+#include <string>
+
+#include "FastCgi.hpp"
+
+static const unsigned char FCGI_VERSION_1 = 1;
+static const unsigned char FCGI_RESPONDER = 1;
+static const unsigned char FCGI_KEEP_CONN = 1;
+
+// Header plus the padding that keeps the next record 8-byte aligned.
+static void recordHeader(ByteQueue &out, int type, unsigned requestId,
+						 size_t length)
+{
+	const size_t padding = (8 - (length & 7)) & 7;
+	unsigned char h[FCGI_HEADER_LEN];
+	h[0] = FCGI_VERSION_1;
+	h[1] = static_cast<unsigned char>(type);
+	h[2] = static_cast<unsigned char>((requestId >> 8) & 0xff);
+	h[3] = static_cast<unsigned char>(requestId & 0xff);
+	h[4] = static_cast<unsigned char>((length >> 8) & 0xff);
+	h[5] = static_cast<unsigned char>(length & 0xff);
+	h[6] = static_cast<unsigned char>(padding);
+	h[7] = 0;
+	out.append(reinterpret_cast<const char *>(h), sizeof(h));
+}
+
+static void recordPadding(ByteQueue &out, size_t length)
+{
+	static const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	const size_t padding = (8 - (length & 7)) & 7;
+	if (padding)
+		out.append(zeros, padding);
+}
+
+static void record(ByteQueue &out, int type, unsigned requestId,
+				   const char *p, size_t n)
+{
+	recordHeader(out, type, requestId, n);
+	if (n)
+		out.append(p, n);
+	recordPadding(out, n);
+}
+
+void fcgiBeginRequest(ByteQueue &out, unsigned requestId, bool keepConn)
+{
+	char body[8];
+	std::memset(body, 0, sizeof(body));
+	body[1] = static_cast<char>(FCGI_RESPONDER);
+	body[2] = static_cast<char>(keepConn ? FCGI_KEEP_CONN : 0);
+	record(out, FCGI_BEGIN_REQUEST, requestId, body, sizeof(body));
+}
+
+// Name-value pair lengths: one byte below 128, else four with the top bit.
+static void pairLength(std::string &params, size_t n)
+{
+	if (n < 128)
+	{
+		params += static_cast<char>(n);
+		return;
+	}
+	params += static_cast<char>(((n >> 24) & 0x7f) | 0x80);
+	params += static_cast<char>((n >> 16) & 0xff);
+	params += static_cast<char>((n >> 8) & 0xff);
+	params += static_cast<char>(n & 0xff);
+}
+
+void fcgiParams(ByteQueue &out, unsigned requestId, char *const *envp)
+{
+	std::string params;
+	for (size_t i = 0; envp && envp[i]; ++i)
+	{
+		const char *eq = std::strchr(envp[i], '=');
+		if (!eq)
+			continue;
+		const size_t nameLen = static_cast<size_t>(eq - envp[i]);
+		const size_t valueLen = std::strlen(eq + 1);
+		pairLength(params, nameLen);
+		pairLength(params, valueLen);
+		params.append(envp[i], nameLen);
+		params.append(eq + 1, valueLen);
+	}
+	// a pair may straddle two records: PARAMS is one stream
+	for (size_t off = 0; off < params.size(); off += FCGI_MAX_CONTENT)
+	{
+		size_t n = params.size() - off;
+		if (n > FCGI_MAX_CONTENT)
+			n = FCGI_MAX_CONTENT;
+		record(out, FCGI_PARAMS, requestId, params.data() + off, n);
+	}
+	record(out, FCGI_PARAMS, requestId, NULL, 0);
+}
+
+void fcgiStdin(ByteQueue &out, unsigned requestId, const char *p, size_t n)
+{
+	record(out, FCGI_STDIN, requestId, p, n);
+}
+
+void fcgiGetValues(ByteQueue &out)
+{
+	static const char *const names[] = {
+		"FCGI_MAX_CONNS", "FCGI_MAX_REQS", "FCGI_MPXS_CONNS"
+	};
+	std::string body;
+	for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i)
+	{
+		pairLength(body, std::strlen(names[i]));
+		pairLength(body, 0);
+		body += names[i];
+	}
+	record(out, FCGI_GET_VALUES, 0, body.data(), body.size());
+}
+
+size_t fcgiNextRecord(const char *p, size_t n, FcgiRecord &rec)
+{
+	if (n < FCGI_HEADER_LEN)
+		return 0;
+	const unsigned char *h = reinterpret_cast<const unsigned char *>(p);
+	const size_t length = (static_cast<size_t>(h[4]) << 8) | h[5];
+	const size_t total = FCGI_HEADER_LEN + length + h[6];
+	if (n < total)
+		return 0;
+	rec.type = h[1];
+	rec.requestId = (static_cast<unsigned>(h[2]) << 8) | h[3];
+	rec.content = p + FCGI_HEADER_LEN;
+	rec.length = length;
+	return total;
+}
+
+bool fcgiEndRequest(const FcgiRecord &rec, unsigned long &appStatus,
+					int &protocolStatus)
+{
+	if (rec.type != FCGI_END_REQUEST || rec.length < 8)
+		return false;
+	const unsigned char *b = reinterpret_cast<const unsigned char *>(rec.content);
+	appStatus = (static_cast<unsigned long>(b[0]) << 24) |
+				(static_cast<unsigned long>(b[1]) << 16) |
+				(static_cast<unsigned long>(b[2]) << 8) | b[3];
+	protocolStatus = b[4];
+	return true;
+}
@@ -14,7 +14,7 @@
 
 #include <iostream>
 #include "ConfigParser.hpp"
-#include "SocketManager.hpp"
+#include "WorkerMaster.hpp"
 #include <csignal>
 
 volatile sig_atomic_t g_stop = 0; 
@@ -28,6 +28,7 @@ extern "C" void handleSigint(int) //here we force g_stop to use C convention as
 int main(int argc, char** argv)
 {
 	std::signal(SIGINT, handleSigint);
+	std::signal(SIGTERM, handleSigint); // master forwards this to workers
 	try 
 	{
 		std::string configFile = "config.conf";  // default fallback
@@ -44,12 +45,8 @@ int main(int argc, char** argv)
 
 		std::cout << "Starting WebServer now..." << std::endl;
 
-		SocketManager sm;
-		sm.setServers(servers);
-
-		for (size_t i = 0; i < servers.size(); ++i)
-			sm.addServer(servers[i].host, servers[i].port);
-		sm.run();
+		WorkerMaster master(parser.getConfig());
+		return master.run();
 	}
 	catch (const std::exception & e)
 	{
@@ -0,0 +1,127 @@
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "Arena.hpp"
+
+static const size_t ALIGN = sizeof(void *);
+
+static size_t alignUp(size_t n)
+{
+	return (n + ALIGN - 1) & ~(ALIGN - 1);
+}
+
+Arena::Arena(size_t blockSize)
+	: m_first(NULL), m_cur(NULL), m_blockSize(alignUp(blockSize)),
+	  m_strings(), m_stringsUsed(0)
+{
+	return;
+}
+
+Arena::~Arena()
+{
+	release();
+}
+
+char *Arena::payload(Block *b)
+{
+	return reinterpret_cast<char *>(b) + alignUp(sizeof(Block));
+}
+
+Arena::Block *Arena::newBlock(size_t size)
+{
+	Block *b = static_cast<Block *>(std::malloc(alignUp(sizeof(Block)) + size));
+	if (!b)
+		throw std::bad_alloc();
+	b->next = NULL;
+	b->size = size;
+	b->used = 0;
+	return b;
+}
+
+// First fit in the current block, else chain a new one (big requests get a
+// block of their own size).
+void *Arena::alloc(size_t n)
+{
+	n = alignUp(n ? n : 1);
+	if (!m_first)
+		m_first = m_cur = newBlock(n > m_blockSize ? n : m_blockSize);
+	else if (m_cur->size - m_cur->used < n)
+	{
+		Block *b = newBlock(n > m_blockSize ? n : m_blockSize);
+		m_cur->next = b;
+		m_cur = b;
+	}
+	void *p = payload(m_cur) + m_cur->used;
+	m_cur->used += n;
+	return p;
+}
+
+char *Arena::dup(const char *p, size_t n)
+{
+	char *s = static_cast<char *>(alloc(n + 1));
+	std::memcpy(s, p, n);
+	s[n] = '\0';
+	return s;
+}
+
+char *Arena::dup(const std::string &s)
+{
+	return dup(s.data(), s.size());
+}
+
+char *Arena::concat(const char *a, const std::string &b)
+{
+	const size_t alen = std::strlen(a);
+	char *s = static_cast<char *>(alloc(alen + b.size() + 1));
+	std::memcpy(s, a, alen);
+	std::memcpy(s + alen, b.data(), b.size());
+	s[alen + b.size()] = '\0';
+	return s;
+}
+
+std::string &Arena::str()
+{
+	if (m_stringsUsed == m_strings.size())
+		m_strings.push_back(std::string());
+	std::string &s = m_strings[m_stringsUsed++];
+	s.clear();
+	return s;
+}
+
+// Overflow blocks go back; the first one and the string slots stay.
+void Arena::reset()
+{
+	if (m_first)
+	{
+		Block *b = m_first->next;
+		while (b)
+		{
+			Block *next = b->next;
+			std::free(b);
+			b = next;
+		}
+		m_first->next = NULL;
+		m_first->used = 0;
+	}
+	m_cur = m_first;
+	m_stringsUsed = 0;
+}
+
+void Arena::release()
+{
+	reset();
+	std::free(m_first);
+	m_first = m_cur = NULL;
+	m_strings.clear();
+}
+
+size_t Arena::capacity() const
+{
+	size_t n = 0;
+	for (const Block *b = m_first; b; b = b->next)
+		n += b->size;
+	for (size_t i = 0; i < m_strings.size(); ++i)
+		n += m_strings[i].capacity();
+	return n;
+}
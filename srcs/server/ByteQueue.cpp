@@ -0,0 +1,105 @@
+#include <cstring>
+
+#include "ByteQueue.hpp"
+
+ByteQueue::ByteQueue() : m_buf(), m_head(0), m_tail(0)
+{
+	return;
+}
+
+const char *ByteQueue::data() const
+{
+	return m_buf.data() + m_head;
+}
+
+size_t ByteQueue::size() const
+{
+	return m_tail - m_head;
+}
+
+bool ByteQueue::empty() const
+{
+	return m_head == m_tail;
+}
+
+size_t ByteQueue::capacity() const
+{
+	return m_buf.size();
+}
+
+// Slide the live bytes down only when the dead prefix is at least as big as
+// they are: each byte is then moved O(1) times on average.
+void ByteQueue::makeRoom(size_t n)
+{
+	if (m_buf.size() - m_tail >= n)
+		return;
+	const size_t live = m_tail - m_head;
+	if (m_head > 0 && m_head >= live)
+	{
+		std::memmove(&m_buf[0], m_buf.data() + m_head, live);
+		m_head = 0;
+		m_tail = live;
+		if (m_buf.size() - m_tail >= n)
+			return;
+	}
+	size_t grown = m_buf.size() * 2;
+	if (grown < m_tail + n)
+		grown = m_tail + n;
+	m_buf.resize(grown);
+}
+
+void ByteQueue::append(const char *p, size_t n)
+{
+	if (n == 0)
+		return;
+	makeRoom(n);
+	std::memcpy(&m_buf[m_tail], p, n);
+	m_tail += n;
+}
+
+char *ByteQueue::prepare(size_t n)
+{
+	makeRoom(n);
+	if (m_buf.empty())
+		return NULL;
+	return &m_buf[0] + m_tail;
+}
+
+void ByteQueue::commit(size_t n)
+{
+	if (n > m_buf.size() - m_tail)
+		n = m_buf.size() - m_tail;
+	m_tail += n;
+}
+
+void ByteQueue::consume(size_t n)
+{
+	if (n >= m_tail - m_head)
+	{
+		m_head = 0;
+		m_tail = 0;
+		return;
+	}
+	m_head += n;
+}
+
+void ByteQueue::assignSwap(std::string &data)
+{
+	m_buf.swap(data);
+	data.clear();
+	m_head = 0;
+	m_tail = m_buf.size();
+}
+
+void ByteQueue::clear()
+{
+	m_head = 0;
+	m_tail = 0;
+}
+
+void ByteQueue::release()
+{
+	std::string().swap(m_buf);
+	m_head = 0;
+	m_tail = 0;
+}
@@ -14,6 +14,17 @@ ChunkedDecoder::ChunkedDecoder() :
 	m_line.empty();
 }
 
+void ChunkedDecoder::reset()
+{
+	m_state = S_SIZE;
+	m_total = 0;
+	m_curr_size = 0;
+	m_status_code = 0;
+	m_data.clear();
+	m_error.clear();
+	m_line.clear();
+}
+
 bool ChunkedDecoder::done() const
 {
 	return (m_state == S_DONE);
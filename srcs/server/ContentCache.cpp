@@ -0,0 +1,193 @@
+#include "ContentCache.hpp"
+
+ContentCache::Stats::Stats()
+	: hits(0), misses(0), evictions(0), entries(0), bytes(0)
+{
+	return;
+}
+
+ContentCache::ContentCache()
+	: m_buckets(64, static_cast<Entry*>(NULL)), m_lruHead(NULL),
+	  m_lruTail(NULL), m_budget(8 << 20), m_maxFile(64 << 10)
+{
+	return;
+}
+
+ContentCache::~ContentCache()
+{
+	clear();
+}
+
+void ContentCache::configure(size_t budgetBytes, size_t maxFileBytes)
+{
+	clear();
+	m_budget = budgetBytes;
+	m_maxFile = maxFileBytes;
+}
+
+bool ContentCache::accepts(size_t fileSize) const
+{
+	return m_budget > 0 && fileSize <= m_maxFile && fileSize <= m_budget;
+}
+
+const ContentCache::Stats &ContentCache::stats() const
+{
+	return m_stats;
+}
+
+// FNV-1a
+size_t ContentCache::hashKey(const std::string &key)
+{
+	size_t h = static_cast<size_t>(2166136261u);
+	for (size_t i = 0; i < key.size(); ++i)
+	{
+		h ^= static_cast<unsigned char>(key[i]);
+		h *= static_cast<size_t>(16777619u);
+	}
+	return h;
+}
+
+// What an entry charges against the budget.
+size_t ContentCache::cost(const Entry &e)
+{
+	return e.key.size() + e.head.size() + e.body.size() + sizeof(Entry);
+}
+
+ContentCache::Entry **ContentCache::slotOf(const std::string &key, size_t hash)
+{
+	Entry **pp = &m_buckets[hash & (m_buckets.size() - 1)];
+	while (*pp && ((*pp)->hash != hash || (*pp)->key != key))
+		pp = &(*pp)->chain;
+	return pp;
+}
+
+void ContentCache::unlinkLru(Entry *e)
+{
+	if (e->lruPrev)
+		e->lruPrev->lruNext = e->lruNext;
+	else
+		m_lruHead = e->lruNext;
+	if (e->lruNext)
+		e->lruNext->lruPrev = e->lruPrev;
+	else
+		m_lruTail = e->lruPrev;
+	e->lruPrev = NULL;
+	e->lruNext = NULL;
+}
+
+void ContentCache::pushFront(Entry *e)
+{
+	e->lruPrev = NULL;
+	e->lruNext = m_lruHead;
+	if (m_lruHead)
+		m_lruHead->lruPrev = e;
+	m_lruHead = e;
+	if (!m_lruTail)
+		m_lruTail = e;
+}
+
+void ContentCache::erase(Entry *e)
+{
+	Entry **pp = slotOf(e->key, e->hash);
+	if (*pp == e)
+		*pp = e->chain;
+	unlinkLru(e);
+	m_stats.bytes -= cost(*e);
+	--m_stats.entries;
+	delete e;
+}
+
+void ContentCache::rehash(size_t buckets)
+{
+	std::vector<Entry*> next(buckets, static_cast<Entry*>(NULL));
+	for (size_t i = 0; i < m_buckets.size(); ++i)
+	{
+		Entry *e = m_buckets[i];
+		while (e)
+		{
+			Entry *following = e->chain;
+			Entry **head = &next[e->hash & (buckets - 1)];
+			e->chain = *head;
+			*head = e;
+			e = following;
+		}
+	}
+	m_buckets.swap(next);
+}
+
+void ContentCache::clear()
+{
+	while (m_lruHead)
+		erase(m_lruHead);
+}
+
+const ContentCache::Entry *ContentCache::find(const std::string &key,
+											  const FileInfo &info)
+{
+	if (m_budget == 0)
+		return NULL;
+	const size_t h = hashKey(key);
+	Entry *e = *slotOf(key, h);
+	if (e && (e->mtime != info.mtime || e->size != info.size || e->ino != info.ino))
+	{
+		erase(e); // file changed on disk
+		e = NULL;
+	}
+	if (!e)
+	{
+		++m_stats.misses;
+		return NULL;
+	}
+	++m_stats.hits;
+	unlinkLru(e);
+	pushFront(e);
+	return e;
+}
+
+const ContentCache::Entry *ContentCache::store(const std::string &key,
+											   const FileInfo &info,
+											   const std::string &head,
+											   const std::string &body)
+{
+	if (!accepts(body.size()))
+		return NULL;
+
+	const size_t h = hashKey(key);
+	Entry **pp = slotOf(key, h);
+	if (*pp)
+		erase(*pp);
+
+	Entry *e = new Entry();
+	e->key = key;
+	e->head = head;
+	e->body = body;
+	e->mtime = info.mtime;
+	e->size = info.size;
+	e->ino = info.ino;
+	e->hash = h;
+	e->chain = NULL;
+	e->lruPrev = NULL;
+	e->lruNext = NULL;
+
+	const size_t need = cost(*e);
+	if (need > m_budget)
+	{
+		delete e;
+		return NULL;
+	}
+	while (m_lruTail && m_stats.bytes + need > m_budget)
+	{
+		erase(m_lruTail);
+		++m_stats.evictions;
+	}
+
+	if (m_stats.entries + 1 > m_buckets.size())
+		rehash(m_buckets.size() * 2);
+	Entry **head_slot = &m_buckets[h & (m_buckets.size() - 1)];
+	e->chain = *head_slot;
+	*head_slot = e;
+	pushFront(e);
+	m_stats.bytes += need;
+	++m_stats.entries;
+	return e;
+}
@@ -0,0 +1,281 @@
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+#include "EventBackend.hpp"
+
+EventBackend::~EventBackend()
+{
+	return;
+}
+
+EventBackend *EventBackend::create(const std::string &preferred)
+{
+#ifdef __linux__
+	if (preferred != "poll")
+	{
+		EpollBackend *ep = new EpollBackend();
+		if (ep->isValid())
+			return ep;
+		std::cerr << "[events] epoll unavailable (" << std::strerror(errno)
+				  << "), falling back to poll" << std::endl;
+		delete ep;
+	}
+#else
+	if (preferred == "epoll")
+		std::cerr << "[events] epoll not supported here, using poll" << std::endl;
+#endif
+	return new PollBackend();
+}
+
+// ------------------------------- poll() -------------------------------------
+
+PollBackend::PollBackend()
+{
+	return;
+}
+
+PollBackend::~PollBackend()
+{
+	return;
+}
+
+const char *PollBackend::name() const
+{
+	return "poll";
+}
+
+int PollBackend::indexOf(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= m_index.size())
+		return -1;
+	return m_index[fd];
+}
+
+bool PollBackend::add(int fd, short events)
+{
+	if (fd < 0)
+		return false;
+	int idx = indexOf(fd);
+	if (idx != -1)
+	{
+		m_pollfds[idx].events = events;
+		return true;
+	}
+	if (static_cast<size_t>(fd) >= m_index.size())
+		m_index.resize(static_cast<size_t>(fd) + 1, -1);
+
+	struct pollfd p;
+	p.fd = fd;
+	p.events = events;
+	p.revents = 0;
+	m_index[fd] = static_cast<int>(m_pollfds.size());
+	m_pollfds.push_back(p);
+	return true;
+}
+
+void PollBackend::modify(int fd, short setMask, short clearMask)
+{
+	int idx = indexOf(fd);
+	if (idx == -1)
+		return;
+	m_pollfds[idx].events |= setMask;
+	m_pollfds[idx].events &= ~clearMask;
+}
+
+void PollBackend::remove(int fd)
+{
+	int idx = indexOf(fd);
+	if (idx == -1)
+		return;
+	const size_t last = m_pollfds.size() - 1;
+	if (static_cast<size_t>(idx) != last)
+	{
+		m_pollfds[idx] = m_pollfds[last];
+		m_index[m_pollfds[idx].fd] = idx;
+	}
+	m_pollfds.pop_back();
+	m_index[fd] = -1;
+}
+
+bool PollBackend::watches(int fd) const
+{
+	return indexOf(fd) != -1;
+}
+
+void PollBackend::watchedFds(std::vector<int> &out) const
+{
+	out.clear();
+	for (size_t i = 0; i < m_pollfds.size(); ++i)
+		out.push_back(m_pollfds[i].fd);
+}
+
+int PollBackend::wait(std::vector<ReadyEvent> &out, int timeoutMs)
+{
+	out.clear();
+	struct pollfd *pbase = m_pollfds.empty() ? NULL : &m_pollfds[0];
+	int rc = ::poll(pbase, static_cast<nfds_t>(m_pollfds.size()), timeoutMs);
+	if (rc <= 0)
+		return rc;
+
+	// Snapshot before dispatch: handlers add/remove fds while we iterate.
+	out.reserve(static_cast<size_t>(rc));
+	for (size_t i = 0; i < m_pollfds.size(); ++i)
+	{
+		if (m_pollfds[i].revents != 0)
+		{
+			ReadyEvent ev;
+			ev.fd = m_pollfds[i].fd;
+			ev.revents = m_pollfds[i].revents;
+			out.push_back(ev);
+		}
+	}
+	return static_cast<int>(out.size());
+}
+
+// ------------------------------- epoll --------------------------------------
+#ifdef __linux__
+
+static uint32_t toEpoll(short events)
+{
+	uint32_t e = 0;
+	if (events & POLLIN)
+		e |= EPOLLIN;
+	if (events & POLLOUT)
+		e |= EPOLLOUT;
+	return e;
+}
+
+static short fromEpoll(uint32_t e)
+{
+	short r = 0;
+	if (e & EPOLLIN)
+		r |= POLLIN;
+	if (e & EPOLLOUT)
+		r |= POLLOUT;
+	if (e & EPOLLERR)
+		r |= POLLERR;
+	if (e & EPOLLHUP)
+		r |= POLLHUP;
+	return r;
+}
+
+EpollBackend::EpollBackend() : m_epfd(-1), m_count(0)
+{
+	// CLOEXEC so CGI children never inherit the instance.
+	m_epfd = ::epoll_create1(EPOLL_CLOEXEC);
+	m_ready.resize(256);
+}
+
+EpollBackend::~EpollBackend()
+{
+	if (m_epfd != -1)
+		::close(m_epfd);
+}
+
+bool EpollBackend::isValid() const
+{
+	return m_epfd != -1;
+}
+
+const char *EpollBackend::name() const
+{
+	return "epoll";
+}
+
+bool EpollBackend::ctl(int op, int fd, short events)
+{
+	struct epoll_event ev;
+	std::memset(&ev, 0, sizeof(ev));
+	ev.events = toEpoll(events);
+	ev.data.fd = fd;
+	return ::epoll_ctl(m_epfd, op, fd, &ev) == 0;
+}
+
+bool EpollBackend::add(int fd, short events)
+{
+	if (fd < 0)
+		return false;
+	if (static_cast<size_t>(fd) >= m_masks.size())
+	{
+		m_masks.resize(static_cast<size_t>(fd) + 1, 0);
+		m_watched.resize(static_cast<size_t>(fd) + 1, 0);
+	}
+
+	if (m_watched[fd])
+	{
+		m_masks[fd] = events;
+		return ctl(EPOLL_CTL_MOD, fd, events);
+	}
+	if (!ctl(EPOLL_CTL_ADD, fd, events))
+	{
+		// Number recycled while a stale registration survived: take it over.
+		if (errno != EEXIST || !ctl(EPOLL_CTL_MOD, fd, events))
+			return false;
+	}
+	m_masks[fd] = events;
+	m_watched[fd] = 1;
+	++m_count;
+	return true;
+}
+
+void EpollBackend::modify(int fd, short setMask, short clearMask)
+{
+	if (!watches(fd))
+		return;
+	short next = m_masks[fd];
+	next |= setMask;
+	next &= ~clearMask;
+	if (next == m_masks[fd])
+		return; // no syscall when nothing changes (setPollToWrite is hot)
+	m_masks[fd] = next;
+	ctl(EPOLL_CTL_MOD, fd, next);
+}
+
+void EpollBackend::remove(int fd)
+{
+	if (!watches(fd))
+		return;
+	m_masks[fd] = 0;
+	m_watched[fd] = 0;
+	--m_count;
+	ctl(EPOLL_CTL_DEL, fd, 0); // EBADF if already closed: nothing left to do
+}
+
+bool EpollBackend::watches(int fd) const
+{
+	return fd >= 0 && static_cast<size_t>(fd) < m_watched.size() && m_watched[fd];
+}
+
+void EpollBackend::watchedFds(std::vector<int> &out) const
+{
+	out.clear();
+	for (size_t i = 0; i < m_watched.size(); ++i)
+		if (m_watched[i])
+			out.push_back(static_cast<int>(i));
+}
+
+int EpollBackend::wait(std::vector<ReadyEvent> &out, int timeoutMs)
+{
+	out.clear();
+	if (m_ready.size() < m_count && m_ready.size() < 4096)
+		m_ready.resize(m_count < 4096 ? m_count : 4096);
+
+	int rc = ::epoll_wait(m_epfd, &m_ready[0], static_cast<int>(m_ready.size()),
+						  timeoutMs);
+	if (rc <= 0)
+		return rc;
+
+	out.reserve(static_cast<size_t>(rc));
+	for (int i = 0; i < rc; ++i)
+	{
+		ReadyEvent ev;
+		ev.fd = m_ready[i].data.fd;
+		ev.revents = fromEpoll(m_ready[i].events);
+		out.push_back(ev);
+	}
+	return rc;
+}
+
+#endif
@@ -0,0 +1,255 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "FileCache.hpp"
+#include "file_utils.hpp"
+#include "utils.hpp"
+
+FileInfo::FileInfo()
+	: exists(false), isDir(false), isReg(false), size(0), mtime(0), ino(0),
+	  dev(0), mime(NULL)
+{
+	return;
+}
+
+// The MIME type is looked up once per entry and kept while the file is.
+static void fillInfo(FileInfo &info, const struct stat &sb, const std::string &path,
+					 const MimeTypes *types)
+{
+	info.exists = true;
+	info.isDir = S_ISDIR(sb.st_mode);
+	info.isReg = S_ISREG(sb.st_mode);
+	info.size = static_cast<size_t>(sb.st_size);
+	info.mtime = sb.st_mtime;
+	info.ino = sb.st_ino;
+	info.dev = sb.st_dev;
+	if (info.isReg && !info.mime)
+		info.mime = types ? types->forPath(path) : getMimeTypeFromPath(path);
+}
+
+static int openReadOnly(const std::string &path)
+{
+	int flags = O_RDONLY;
+#ifdef O_CLOEXEC
+	flags |= O_CLOEXEC; // CGI children must not inherit cached files
+#endif
+	return ::open(path.c_str(), flags);
+}
+
+// dup() drops FD_CLOEXEC, so ask for it explicitly.
+static int dupCloexec(int fd)
+{
+#ifdef F_DUPFD_CLOEXEC
+	return ::fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#else
+	int nfd = ::dup(fd);
+	if (nfd != -1)
+		::fcntl(nfd, F_SETFD, FD_CLOEXEC);
+	return nfd;
+#endif
+}
+
+FileCache::FileCache() : m_maxEntries(256), m_ttlMs(1000), m_types(NULL)
+{
+	return;
+}
+
+FileCache::~FileCache()
+{
+	clear();
+}
+
+void FileCache::configure(size_t maxEntries, unsigned long long ttlMs)
+{
+	clear();
+	m_maxEntries = maxEntries;
+	m_ttlMs = ttlMs;
+}
+
+void FileCache::setMimeTypes(const MimeTypes *types)
+{
+	clear();
+	m_types = types;
+}
+
+void FileCache::clear()
+{
+	for (EntryMap::iterator it = m_entries.begin(); it != m_entries.end(); ++it)
+		closeFd(it->second);
+	m_entries.clear();
+	m_lru.clear();
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+	EntryMap::iterator it = m_entries.find(path);
+	if (it == m_entries.end())
+		return;
+	closeFd(it->second);
+	m_lru.erase(it->second.lru);
+	m_entries.erase(it);
+}
+
+void FileCache::closeFd(Entry &e)
+{
+	if (e.fd != -1)
+		::close(e.fd);
+	e.fd = -1;
+}
+
+void FileCache::evictOne()
+{
+	if (m_lru.empty())
+		return;
+	EntryMap::iterator victim = m_entries.find(*m_lru.back());
+	m_lru.pop_back();
+	if (victim != m_entries.end())
+	{
+		closeFd(victim->second);
+		m_entries.erase(victim);
+	}
+}
+
+// stat() again; a changed file loses its cached fd and MIME type.
+void FileCache::refresh(Entry &e, const std::string &path)
+{
+	struct stat sb;
+	FileInfo fresh;
+	if (::stat(path.c_str(), &sb) == 0)
+	{
+		if (e.info.exists && e.info.ino == sb.st_ino && e.info.dev == sb.st_dev)
+			fresh.mime = e.info.mime;
+		fillInfo(fresh, sb, path, m_types);
+	}
+
+	if (!fresh.exists || fresh.ino != e.info.ino || fresh.dev != e.info.dev ||
+		fresh.size != e.info.size || fresh.mtime != e.info.mtime)
+		closeFd(e);
+	e.info = fresh;
+	e.checkedMs = now_ms();
+}
+
+FileCache::Entry &FileCache::fetch(const std::string &path)
+{
+	EntryMap::iterator it = m_entries.find(path);
+	if (it != m_entries.end())
+	{
+		Entry &e = it->second;
+		m_lru.splice(m_lru.begin(), m_lru, e.lru);
+		if (now_ms() - e.checkedMs >= m_ttlMs)
+			refresh(e, path);
+		return e;
+	}
+
+	while (!m_entries.empty() && m_entries.size() >= m_maxEntries)
+		evictOne();
+
+	it = m_entries.insert(std::make_pair(path, Entry())).first;
+	Entry &e = it->second;
+	e.fd = -1;
+	e.checkedMs = 0;
+	e.safeKnown = false;
+	e.safe = false;
+	m_lru.push_front(&it->first);
+	e.lru = m_lru.begin();
+	refresh(e, path);
+	return e;
+}
+
+FileInfo FileCache::lookup(const std::string &path)
+{
+	if (m_maxEntries == 0)
+	{
+		FileInfo info;
+		struct stat sb;
+		if (::stat(path.c_str(), &sb) == 0)
+			fillInfo(info, sb, path, m_types);
+		return info;
+	}
+	return fetch(path).info;
+}
+
+static int openRegular(const std::string &path, FileInfo &info,
+					   const MimeTypes *types)
+{
+	info = FileInfo();
+	int fd = openReadOnly(path);
+	struct stat sb;
+	if (fd != -1 && ::fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode))
+	{
+		fillInfo(info, sb, path, types);
+		return fd;
+	}
+	if (fd != -1)
+		::close(fd);
+	return -1;
+}
+
+// The entry's own fd (still owned by the cache), opened on first use.
+int FileCache::cachedFd(const std::string &path, FileInfo &info)
+{
+	Entry &e = fetch(path);
+	if (e.info.isReg && e.fd == -1)
+	{
+		e.fd = openReadOnly(path);
+		// The file may have been swapped since stat(): trust the open fd.
+		struct stat sb;
+		if (e.fd != -1 && ::fstat(e.fd, &sb) == 0)
+		{
+			e.info = FileInfo();
+			fillInfo(e.info, sb, path, m_types);
+		}
+		else
+			closeFd(e);
+	}
+	info = e.info;
+	if (!e.info.isReg)
+		return -1;
+	return e.fd;
+}
+
+int FileCache::openShared(const std::string &path, FileInfo &info)
+{
+	if (m_maxEntries == 0)
+		return openRegular(path, info, m_types);
+	int fd = cachedFd(path, info);
+	return fd == -1 ? -1 : dupCloexec(fd);
+}
+
+bool FileCache::readAll(const std::string &path, std::string &out)
+{
+	FileInfo info;
+	int fd = m_maxEntries == 0 ? openRegular(path, info, m_types) : cachedFd(path, info);
+	if (fd == -1)
+		return false;
+
+	out.resize(info.size);
+	size_t got = 0;
+	while (got < info.size)
+	{
+		ssize_t n = ::pread(fd, &out[got], info.size - got, static_cast<off_t>(got));
+		if (n <= 0)
+			break;
+		got += static_cast<size_t>(n);
+	}
+	out.resize(got);
+	if (m_maxEntries == 0)
+		::close(fd);
+	return true;
+}
+
+bool FileCache::isSafe(const std::string &root, const std::string &path)
+{
+	if (m_maxEntries == 0)
+		return isPathSafe(root, path);
+
+	Entry &e = fetch(path);
+	if (!e.safeKnown || e.safeRoot != root)
+	{
+		e.safe = isPathSafe(root, path);
+		e.safeRoot = root;
+		e.safeKnown = true;
+	}
+	return e.safe;
+}
@@ -0,0 +1,163 @@
+#include <cstring>
+#include <ctime>
+
+#include "HeaderBuilder.hpp"
+#include "utils.hpp"
+
+struct StatusEntry
+{
+	int         code;
+	const char  *reason;
+	const char  *line;
+};
+
+static const StatusEntry STATUS_LINES[] = {
+	{200, "OK", "HTTP/1.1 200 OK\r\n"},
+	{201, "Created", "HTTP/1.1 201 Created\r\n"},
+	{204, "No Content", "HTTP/1.1 204 No Content\r\n"},
+	{206, "Partial Content", "HTTP/1.1 206 Partial Content\r\n"},
+	{301, "Moved Permanently", "HTTP/1.1 301 Moved Permanently\r\n"},
+	{302, "Found", "HTTP/1.1 302 Found\r\n"},
+	{303, "See Other", "HTTP/1.1 303 See Other\r\n"},
+	{304, "Not Modified", "HTTP/1.1 304 Not Modified\r\n"},
+	{307, "Temporary Redirect", "HTTP/1.1 307 Temporary Redirect\r\n"},
+	{308, "Permanent Redirect", "HTTP/1.1 308 Permanent Redirect\r\n"},
+	{400, "Bad Request", "HTTP/1.1 400 Bad Request\r\n"},
+	{403, "Forbidden", "HTTP/1.1 403 Forbidden\r\n"},
+	{404, "Not Found", "HTTP/1.1 404 Not Found\r\n"},
+	{405, "Method Not Allowed", "HTTP/1.1 405 Method Not Allowed\r\n"},
+	{408, "Request Timeout", "HTTP/1.1 408 Request Timeout\r\n"},
+	{411, "Length Required", "HTTP/1.1 411 Length Required\r\n"},
+	{413, "Payload Too Large", "HTTP/1.1 413 Payload Too Large\r\n"},
+	{414, "URI Too Long", "HTTP/1.1 414 URI Too Long\r\n"},
+	{416, "Range Not Satisfiable", "HTTP/1.1 416 Range Not Satisfiable\r\n"},
+	{500, "Internal Server Error", "HTTP/1.1 500 Internal Server Error\r\n"},
+	{501, "Not Implemented", "HTTP/1.1 501 Not Implemented\r\n"},
+	{502, "Bad Gateway", "HTTP/1.1 502 Bad Gateway\r\n"},
+	{503, "Service Unavailable", "HTTP/1.1 503 Service Unavailable\r\n"},
+	{504, "Gateway Timeout", "HTTP/1.1 504 Gateway Timeout\r\n"},
+	{505, "HTTP Version Not Supported", "HTTP/1.1 505 HTTP Version Not Supported\r\n"}
+};
+
+static const size_t STATUS_COUNT = sizeof(STATUS_LINES) / sizeof(STATUS_LINES[0]);
+
+// Indexed by HeaderBuilder::Name.
+static const char *const NAME_PREFIX[] = {
+	"Content-Length: ",
+	"Content-Type: ",
+	"Content-Range: ",
+	"ETag: ",
+	"Last-Modified: ",
+	"Location: ",
+	"Allow: ",
+	"Accept-Ranges: "
+};
+
+static const StatusEntry *findStatus(int code)
+{
+	// code -> table slot, built on first use (0 = not precomputed)
+	static unsigned char index[600];
+	static bool ready = false;
+	if (!ready)
+	{
+		for (size_t i = 0; i < STATUS_COUNT; ++i)
+			index[STATUS_LINES[i].code] = static_cast<unsigned char>(i + 1);
+		ready = true;
+	}
+	if (code < 0 || code >= 600 || index[code] == 0)
+		return NULL;
+	return &STATUS_LINES[index[code] - 1];
+}
+
+HeaderBuilder::HeaderBuilder(std::string &out, size_t reserve) : m_out(out)
+{
+	m_out.reserve(m_out.size() + reserve);
+}
+
+void HeaderBuilder::appendNumber(size_t value)
+{
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	do
+	{
+		*--p = static_cast<char>('0' + value % 10);
+		value /= 10;
+	} while (value);
+	m_out.append(p, buf + sizeof(buf) - p);
+}
+
+// Precomputed line when the reason is the standard one; handlers that pass
+// their own wording still get it verbatim.
+void HeaderBuilder::statusLine(int code, const std::string &reason)
+{
+	const StatusEntry *e = findStatus(code);
+	if (e && reason == e->reason)
+	{
+		m_out.append(e->line);
+		return;
+	}
+	m_out.append("HTTP/1.1 ", 9);
+	appendNumber(code < 0 ? 0 : static_cast<size_t>(code));
+	m_out += ' ';
+	m_out += reason;
+	m_out.append("\r\n", 2);
+}
+
+void HeaderBuilder::header(const std::string &name, const std::string &value)
+{
+	m_out += name;
+	m_out.append(": ", 2);
+	m_out += value;
+	m_out.append("\r\n", 2);
+}
+
+void HeaderBuilder::header(Name name, const std::string &value)
+{
+	m_out.append(NAME_PREFIX[name]);
+	m_out += value;
+	m_out.append("\r\n", 2);
+}
+
+void HeaderBuilder::header(Name name, const char *value)
+{
+	m_out.append(NAME_PREFIX[name]);
+	m_out.append(value);
+	m_out.append("\r\n", 2);
+}
+
+void HeaderBuilder::header(Name name, size_t value)
+{
+	m_out.append(NAME_PREFIX[name]);
+	appendNumber(value);
+	m_out.append("\r\n", 2);
+}
+
+void HeaderBuilder::line(const std::string &raw)
+{
+	m_out += raw;
+	m_out.append("\r\n", 2);
+}
+
+// "Date: <IMF-fixdate>\r\n", formatted again only when the second changes.
+void HeaderBuilder::date()
+{
+	static time_t cachedSec = static_cast<time_t>(-1);
+	static std::string cachedLine;
+	const time_t now = std::time(NULL);
+	if (now != cachedSec)
+	{
+		cachedLine = "Date: " + httpDate(now) + "\r\n";
+		cachedSec = now;
+	}
+	m_out += cachedLine;
+}
+
+void HeaderBuilder::connectionClose()
+{
+	m_out.append("Connection: close\r\n", 19);
+}
+
+void HeaderBuilder::end()
+{
+	m_out.append("\r\n", 2);
+}
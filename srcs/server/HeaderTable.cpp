@@ -0,0 +1,242 @@
+#include <cstring>
+
+#include "HeaderTable.hpp"
+
+struct KnownName
+{
+	const char      *name;  // lowercase
+	unsigned        len;
+	HeaderTable::Id id;
+};
+
+static const KnownName KNOWN_NAMES[] = {
+	{"host", 4, HeaderTable::HOST},
+	{"content-length", 14, HeaderTable::CONTENT_LENGTH},
+	{"transfer-encoding", 17, HeaderTable::TRANSFER_ENCODING},
+	{"connection", 10, HeaderTable::CONNECTION},
+	{"content-type", 12, HeaderTable::CONTENT_TYPE},
+	{"if-none-match", 13, HeaderTable::IF_NONE_MATCH},
+	{"if-modified-since", 17, HeaderTable::IF_MODIFIED_SINCE},
+	{"if-range", 8, HeaderTable::IF_RANGE},
+	{"range", 5, HeaderTable::RANGE}
+};
+
+static char lowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static bool equalsLower(const char *p, size_t len, const char *lower, size_t lowerLen)
+{
+	if (len != lowerLen)
+		return false;
+	for (size_t i = 0; i < len; ++i)
+		if (lowerAscii(p[i]) != lower[i])
+			return false;
+	return true;
+}
+
+static HeaderTable::Id intern(const char *p, size_t len)
+{
+	for (size_t i = 0; i < sizeof(KNOWN_NAMES) / sizeof(KNOWN_NAMES[0]); ++i)
+		if (equalsLower(p, len, KNOWN_NAMES[i].name, KNOWN_NAMES[i].len))
+			return KNOWN_NAMES[i].id;
+	return HeaderTable::OTHER;
+}
+
+// Same alphabet the old map-based parser accepted.
+static bool isTokenChar(char c)
+{
+	return (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+		   (c >= '0' && c <= '9') || c == '-';
+}
+
+static bool isOws(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+HeaderTable::HeaderTable() : m_raw(), m_overflow(), m_count(0)
+{
+	clear();
+}
+
+void HeaderTable::clear()
+{
+	m_raw.clear();
+	m_overflow.clear();
+	m_count = 0;
+	for (size_t i = 0; i < KNOWN_COUNT; ++i)
+	{
+		m_first[i] = -1;
+		m_last[i] = -1;
+		m_seen[i] = 0;
+	}
+}
+
+void HeaderTable::adopt(const char *head, size_t len)
+{
+	clear();
+	m_raw.assign(head, len);
+}
+
+const std::string &HeaderTable::raw() const
+{
+	return m_raw;
+}
+
+HeaderTable::Field &HeaderTable::slot(size_t i)
+{
+	return i < INLINE_FIELDS ? m_inline[i] : m_overflow[i - INLINE_FIELDS];
+}
+
+const HeaderTable::Field &HeaderTable::field(size_t i) const
+{
+	return i < INLINE_FIELDS ? m_inline[i] : m_overflow[i - INLINE_FIELDS];
+}
+
+void HeaderTable::push(const Field &f)
+{
+	if (m_count < INLINE_FIELDS)
+		m_inline[m_count] = f;
+	else
+		m_overflow.push_back(f);
+	++m_count;
+}
+
+// One pass over the lines: split, trim, validate, intern, chain repeats of
+// the same known header and catch the ones that must not repeat.
+HeaderTable::ParseError HeaderTable::parse(size_t from)
+{
+	const char *base = m_raw.data();
+	const size_t end = m_raw.size();
+	size_t pos = from;
+	while (pos < end)
+	{
+		const char *nl = static_cast<const char *>(std::memchr(base + pos, '\n', end - pos));
+		if (!nl)
+			return PARSE_MALFORMED;
+		const size_t eol = static_cast<size_t>(nl - base);
+		if (eol == pos || base[eol - 1] != '\r')
+			return PARSE_MALFORMED; // bare LF
+		const size_t lineEnd = eol - 1;
+		if (lineEnd == pos)
+			return PARSE_OK; // blank line: end of the head
+
+		// No obs-fold: reject lines starting with SP/HTAB
+		if (isOws(base[pos]))
+			return PARSE_MALFORMED;
+		const char *colon = static_cast<const char *>(std::memchr(base + pos, ':', lineEnd - pos));
+		if (!colon)
+			return PARSE_MALFORMED;
+
+		size_t nameEnd = static_cast<size_t>(colon - base);
+		while (nameEnd > pos && isOws(base[nameEnd - 1]))
+			--nameEnd;
+		if (nameEnd == pos)
+			return PARSE_MALFORMED;
+		for (size_t i = pos; i < nameEnd; ++i)
+			if (!isTokenChar(base[i]))
+				return PARSE_MALFORMED;
+
+		size_t vBegin = static_cast<size_t>(colon - base) + 1;
+		size_t vEnd = lineEnd;
+		while (vBegin < vEnd && isOws(base[vBegin]))
+			++vBegin;
+		while (vEnd > vBegin && isOws(base[vEnd - 1]))
+			--vEnd;
+
+		Field f;
+		f.nameOff = static_cast<unsigned>(pos);
+		f.nameLen = static_cast<unsigned>(nameEnd - pos);
+		f.valueOff = static_cast<unsigned>(vBegin);
+		f.valueLen = static_cast<unsigned>(vEnd - vBegin);
+		f.id = intern(base + pos, nameEnd - pos);
+		f.next = -1;
+		if (f.id != OTHER)
+		{
+			// RFC 9112 3.2: more than one Host is a 400.
+			if (f.id == HOST && m_seen[HOST])
+				return PARSE_DUPLICATE;
+			const int index = static_cast<int>(m_count);
+			if (m_first[f.id] == -1)
+				m_first[f.id] = index;
+			else
+				slot(m_last[f.id]).next = index;
+			m_last[f.id] = index;
+			++m_seen[f.id];
+		}
+		push(f);
+		pos = eol + 1;
+	}
+	return PARSE_OK;
+}
+
+size_t HeaderTable::size() const
+{
+	return m_count;
+}
+
+std::string HeaderTable::name(size_t i) const
+{
+	const Field &f = field(i);
+	std::string out(m_raw, f.nameOff, f.nameLen);
+	for (size_t k = 0; k < out.size(); ++k)
+		out[k] = lowerAscii(out[k]);
+	return out;
+}
+
+std::string HeaderTable::value(size_t i) const
+{
+	const Field &f = field(i);
+	return std::string(m_raw, f.valueOff, f.valueLen);
+}
+
+bool HeaderTable::has(Id id) const
+{
+	return id < KNOWN_COUNT && m_seen[id] > 0;
+}
+
+size_t HeaderTable::count(Id id) const
+{
+	return id < KNOWN_COUNT ? m_seen[id] : 0;
+}
+
+const HeaderTable::Field *HeaderTable::first(Id id) const
+{
+	if (!has(id))
+		return NULL;
+	return &field(static_cast<size_t>(m_first[id]));
+}
+
+std::string HeaderTable::get(Id id) const
+{
+	if (!has(id))
+		return std::string();
+	int i = m_first[id];
+	std::string out = value(static_cast<size_t>(i));
+	for (i = field(static_cast<size_t>(i)).next; i != -1; i = field(static_cast<size_t>(i)).next)
+	{
+		out += ',';
+		out.append(m_raw, field(static_cast<size_t>(i)).valueOff,
+				   field(static_cast<size_t>(i)).valueLen);
+	}
+	return out;
+}
+
+std::string HeaderTable::get(const std::string &name) const
+{
+	std::string out;
+	bool found = false;
+	for (size_t i = 0; i < m_count; ++i)
+	{
+		const Field &f = field(i);
+		if (!equalsLower(m_raw.data() + f.nameOff, f.nameLen, name.data(), name.size()))
+			continue;
+		if (found)
+			out += ',';
+		out.append(m_raw, f.valueOff, f.valueLen);
+		found = true;
+	}
+	return out;
+}
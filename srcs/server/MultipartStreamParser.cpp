@@ -13,6 +13,20 @@ MultipartStreamParser::MultipartStreamParser() :
 	return ;
 }
 
+void MultipartStreamParser::clear()
+{
+	m_st = S_ERROR;
+	m_boundary.clear();
+	m_delim.clear();
+	m_delimClose.clear();
+	m_buf.clear();
+	m_curHeaders.clear();
+	m_onBegin = NULL;
+	m_onData = NULL;
+	m_onEnd = NULL;
+	m_user = NULL;
+}
+
 // we accept only [A-Za-z0-9._+-]{1,70}
 
 static bool isValidBoundary(const std::string &boundary)
@@ -0,0 +1,185 @@
+#include <climits>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/sendfile.h>
+#endif
+
+#include "OutputQueue.hpp"
+
+#ifdef MSG_NOSIGNAL
+# define OQ_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define OQ_SEND_FLAGS 0
+#endif
+
+// iovecs per sendmsg(); a response is a handful of segments, a CGI stream
+// maybe a few dozen.
+static const size_t MAX_IOV = 64;
+static const size_t SENDFILE_CHUNK = 1 << 20;
+
+OutputQueue::Segment::Segment()
+	: data(), pos(0), fd(-1), offset(0), length(0), ownsFd(false)
+{
+	return;
+}
+
+OutputQueue::OutputQueue() : m_segments(), m_bytes(0), m_memBytes(0)
+{
+	return;
+}
+
+OutputQueue::~OutputQueue()
+{
+	clear();
+}
+
+void OutputQueue::appendSwap(std::string &data)
+{
+	if (data.empty())
+		return;
+	m_segments.push_back(Segment());
+	m_segments.back().data.swap(data);
+	m_bytes += m_segments.back().data.size();
+	m_memBytes += m_segments.back().data.size();
+}
+
+void OutputQueue::append(const std::string &data)
+{
+	std::string copy(data);
+	appendSwap(copy);
+}
+
+void OutputQueue::appendFile(int fd, off_t offset, size_t length, bool closeAfter)
+{
+	if (length == 0)
+	{
+		if (closeAfter)
+			::close(fd);
+		return;
+	}
+	m_segments.push_back(Segment());
+	Segment &seg = m_segments.back();
+	seg.fd = fd;
+	seg.offset = offset;
+	seg.length = length;
+	seg.ownsFd = closeAfter;
+	m_bytes += length;
+}
+
+bool OutputQueue::empty() const
+{
+	return m_segments.empty();
+}
+
+size_t OutputQueue::size() const
+{
+	return m_bytes;
+}
+
+size_t OutputQueue::memSize() const
+{
+	return m_memBytes;
+}
+
+void OutputQueue::popFront()
+{
+	Segment &seg = m_segments.front();
+	if (seg.fd != -1 && seg.ownsFd)
+		::close(seg.fd);
+	m_segments.pop_front();
+}
+
+void OutputQueue::clear()
+{
+	while (!m_segments.empty())
+		popFront();
+	m_bytes = 0;
+	m_memBytes = 0;
+}
+
+ssize_t OutputQueue::flush(int sock, size_t budget)
+{
+	if (m_segments.empty())
+		return 0;
+	if (budget == 0)
+		budget = ~size_t(0);
+	if (m_segments.front().fd != -1)
+		return flushFile(sock, budget);
+	return flushMemory(sock, budget);
+}
+
+// Gather every leading memory segment (up to MAX_IOV, `budget` bytes) into
+// one sendmsg(); sendmsg() rather than writev() so MSG_NOSIGNAL applies.
+ssize_t OutputQueue::flushMemory(int sock, size_t budget)
+{
+	struct iovec iov[MAX_IOV];
+	size_t count = 0;
+	for (std::deque<Segment>::iterator it = m_segments.begin();
+		 it != m_segments.end() && it->fd == -1 && count < MAX_IOV && budget > 0; ++it)
+	{
+		size_t len = it->data.size() - it->pos;
+		if (len > budget)
+			len = budget;
+		iov[count].iov_base = const_cast<char *>(it->data.data() + it->pos);
+		iov[count].iov_len = len;
+		budget -= len;
+		++count;
+	}
+
+	struct msghdr msg;
+	std::memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = count;
+	ssize_t n = ::sendmsg(sock, &msg, OQ_SEND_FLAGS);
+	if (n <= 0)
+		return n;
+
+	size_t left = static_cast<size_t>(n);
+	m_bytes -= left;
+	m_memBytes -= left;
+	while (left > 0)
+	{
+		Segment &seg = m_segments.front();
+		const size_t avail = seg.data.size() - seg.pos;
+		if (left < avail)
+		{
+			seg.pos += left;
+			break;
+		}
+		left -= avail;
+		popFront();
+	}
+	return n;
+}
+
+ssize_t OutputQueue::flushFile(int sock, size_t budget)
+{
+	Segment &seg = m_segments.front();
+	size_t want = seg.length < SENDFILE_CHUNK ? seg.length : SENDFILE_CHUNK;
+	if (want > budget)
+		want = budget;
+#ifdef __linux__
+	ssize_t n = ::sendfile(sock, seg.fd, &seg.offset, want);
+#else
+	// No sendfile(): bounce through a fixed stack buffer, still O(1) memory.
+	char buf[65536];
+	if (want > sizeof(buf))
+		want = sizeof(buf);
+	ssize_t r = ::pread(seg.fd, buf, want, seg.offset);
+	if (r <= 0)
+		return r;
+	ssize_t n = ::send(sock, buf, static_cast<size_t>(r), OQ_SEND_FLAGS);
+	if (n > 0)
+		seg.offset += n;
+#endif
+	if (n <= 0)
+		return n;
+	seg.length -= static_cast<size_t>(n);
+	m_bytes -= static_cast<size_t>(n);
+	if (seg.length == 0)
+		popFront();
+	return n;
+}
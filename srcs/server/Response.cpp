@@ -1,30 +1,41 @@
-#include <sstream>
-
+#include "HeaderBuilder.hpp"
 #include "request_response_struct.hpp"
 
-std::string build_http_response(const Response& res)
+FileSpan::FileSpan(off_t off, size_t len, const std::string &tail)
+	: offset(off), length(len), after(tail)
 {
-	std::stringstream response;
-
-	// Status line
-	response << "HTTP/1.1 " << res.status_code << " " << res.status_message << "\r\n";
-
-	// Headers
-	for (std::map<std::string, std::string>::const_iterator it = res.headers.begin();
-			it != res.headers.end(); ++it) {
-		response << it->first << ": " << it->second << "\r\n";
-	}
-
-	// Connection close (if needed)
-	if (res.close_connection) {
-		response << "Connection: close\r\n";
-	}
+	return;
+}
 
-	// Empty line between headers and body
-	response << "\r\n";
+void Request::clear()
+{
+	method.clear();
+	path.clear();
+	http_version.clear();
+	headers.clear();
+	body.clear();
+	form_fields.clear();
+}
 
-	// Body
-	response << res.body;
+Response::Response()
+	: status_code(0), status_message(), headers(), header_lines(), body(),
+	  close_connection(false), body_fd(-1), body_spans(), raw_head()
+{
+	return;
+}
 
-	return response.str();
+// Status line + headers, without Date, Connection and the blank line, so
+// the result can be cached and reused by responses that differ only in
+// those.
+std::string build_http_head(const Response& res)
+{
+	std::string head;
+	HeaderBuilder hb(head);
+	hb.statusLine(res.status_code, res.status_message);
+	for (std::map<std::string, std::string>::const_iterator it = res.headers.begin();
+			it != res.headers.end(); ++it)
+		hb.header(it->first, it->second);
+	for (size_t i = 0; i < res.header_lines.size(); ++i)
+		hb.line(res.header_lines[i]);
+	return head;
 }
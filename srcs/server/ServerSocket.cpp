@@ -29,20 +29,21 @@
 // Setup: socket() → fcntl() → setsockopt() → getaddrinfo() → bind() → listen()
 
 ServerSocket::ServerSocket() :
-	m_fd(-1), m_port(0), m_host("127.0.0.1")
+	m_fd(-1), m_port(0), m_host("127.0.0.1"), m_reusePort(false)
 {
 	std::cerr << "default used !!!!!!" << std::endl;
 	return ;
 }
 
-ServerSocket::ServerSocket(const std::string& host, unsigned short port)
-	: m_fd(-1), m_port(port), m_host(host)
+ServerSocket::ServerSocket(const std::string& host, unsigned short port, bool reusePort)
+	: m_fd(-1), m_port(port), m_host(host), m_reusePort(reusePort)
 {
 	setup();
 }
 
 ServerSocket::ServerSocket(const ServerSocket& other)
-	: m_fd(other.m_fd), m_port(other.m_port), m_host(other.m_host)
+	: m_fd(other.m_fd), m_port(other.m_port), m_host(other.m_host),
+	  m_reusePort(other.m_reusePort)
 {
 	return ;
 }
@@ -60,6 +61,7 @@ ServerSocket& ServerSocket::operator=(const ServerSocket& other)
 		m_fd = other.m_fd;
 		m_port = other.m_port;
 		m_host = other.m_host;
+		m_reusePort = other.m_reusePort;
 	}
 	return *this;
 }
@@ -97,6 +99,18 @@ void ServerSocket::setup()
 	if (setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
 		throw std::runtime_error("setsockopt() failed: " + std::string(strerror(errno)));
 
+	// Every worker binds its own socket on the same host:port and the kernel
+	// load-balances incoming connections between them.
+	if (m_reusePort)
+	{
+#ifdef SO_REUSEPORT
+		if (setsockopt(m_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+			throw std::runtime_error("setsockopt(SO_REUSEPORT) failed: " + std::string(strerror(errno)));
+#else
+		throw std::runtime_error("SO_REUSEPORT not supported on this platform");
+#endif
+	}
+
 	setNonBlocking();
 	bindSocket();
 	listenSocket();
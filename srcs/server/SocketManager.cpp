@@ -21,24 +21,40 @@
 #include <stdexcept>
 #include <string>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
+#include "HeaderBuilder.hpp"
 #include "SocketManager.hpp"
+#include "alloc_stats.hpp"
 #include "file_utils.hpp"
 #include "request_response_struct.hpp"
 #include "utils.hpp"
 #include <csignal> // for clean shutdown when ctrl+c
 
 extern volatile sig_atomic_t g_stop;
+
+// Receive window bounds (readIntoBuffer) and the overflow area behind it.
+static const size_t RECV_WINDOW_MIN = 4096;
+static const size_t RECV_WINDOW_MAX = 256 * 1024;
+static const size_t RECV_SPILL = 64 * 1024;
+
+// ClientStates kept for reuse, and the buffer size they may keep doing so.
+static const size_t MAX_POOLED_CLIENTS = 128;
+static const size_t POOL_KEEP_BYTES = 64 * 1024;
+
 bool ClientState::mpDone() const
 {
 	return mp.isDone();
 }
 
 ClientState::ClientState()
-	: phase(READING_HEADERS), recvBuffer(), req(), isChunked(false),
+	: phase(READING_HEADERS), recvBuffer(), hdrScanPos(0), req(), route(NULL),
+	  routeKnown(false), isChunked(false),
 	  contentLength(0), maxBodyAllowed(0), bodyBuffer(), chunkDec(),
-	  writeBuffer(), forceCloseAfterWrite(false), closing(false),
+	  out(), arena(), recvWindow(RECV_WINDOW_MIN), recvCalls(0), sendCalls(0), allocMark(0),
+	  forceCloseAfterWrite(false), closing(false),
 	  isMultipart(false), multipartInit(false), multipartBoundary(),
 	  mpState(MP_START), mp(), mpCtx(), debugMultipartBytes(0), uploadDir(),
 	  maxFilePerPart(0), multipartError(false), multipartStatusCode(0),
@@ -47,6 +63,97 @@ ClientState::ClientState()
 	return;
 }
 
+IoStats::IoStats() : requests(0), recvCalls(0), sendCalls(0), allocs(0)
+{
+	return;
+}
+
+void ClientState::resetForNextRequest()
+{
+	req.clear();
+	route = NULL;
+	routeKnown = false;
+	isChunked = false;
+	contentLength = 0;
+	maxBodyAllowed = 0;
+	bodyBuffer.clear();
+	chunkDec.reset();
+	forceCloseAfterWrite = false;
+	closing = false;
+	isMultipart = false;
+	multipartInit = false;
+	multipartBoundary.clear();
+	mpState = MP_START;
+	mp.clear();
+	arena.reset();
+}
+
+void ClientState::resetForNewConnection()
+{
+	resetForNextRequest();
+	phase = READING_HEADERS;
+	recvBuffer.clear();
+	hdrScanPos = 0;
+	recvWindow = RECV_WINDOW_MIN;
+	recvCalls = 0;
+	sendCalls = 0;
+	out.clear();
+	cgi.reset();
+	uploadDir.clear();
+	maxFilePerPart = 0;
+	// one big upload shouldn't pin its buffers in the pool
+	if (recvBuffer.capacity() > POOL_KEEP_BYTES)
+		recvBuffer.release();
+	if (bodyBuffer.capacity() > POOL_KEEP_BYTES)
+		std::string().swap(bodyBuffer);
+	if (arena.capacity() > POOL_KEEP_BYTES)
+		arena.release();
+}
+
+FdSlot::FdSlot()
+	: kind(FREE), serverIndex(0), listener(0), clientIndex(0), owner(-1),
+	  generation(0)
+{
+	return;
+}
+
+// Serialize `res` into the client's (empty) output queue: one header block,
+// then the body string and the file spans as their own segments, so no body
+// byte is copied just to sit next to the headers.
+static void queueResponse(ClientState &st, Response &res)
+{
+	st.out.clear();
+	std::string head;
+	if (res.raw_head.empty())
+		head = build_http_head(res);
+	else
+		head.swap(res.raw_head);
+	HeaderBuilder hb(head, 64);
+	hb.date();
+	if (res.close_connection)
+		hb.connectionClose();
+	hb.end();
+	st.out.appendSwap(head);
+	st.out.appendSwap(res.body);
+	if (res.body_fd == -1)
+		return;
+
+	// The last span that actually reads the file takes the fd with it.
+	size_t owner = res.body_spans.size();
+	for (size_t i = 0; i < res.body_spans.size(); ++i)
+		if (res.body_spans[i].length > 0)
+			owner = i;
+	for (size_t i = 0; i < res.body_spans.size(); ++i)
+	{
+		FileSpan &span = res.body_spans[i];
+		st.out.appendFile(res.body_fd, span.offset, span.length, i == owner);
+		st.out.appendSwap(span.after);
+	}
+	if (owner == res.body_spans.size())
+		::close(res.body_fd);
+	res.body_fd = -1; // ownership moved to the client
+}
+
 /* helper for safeguard*/
 // debug func
 
@@ -80,14 +187,22 @@ void SocketManager::setPhase(int fd, ClientState &st, ClientState::Phase newp,
 	st.phase = newp;
 }
 
-SocketManager::SocketManager(const Config &config) : m_config(config)
+SocketManager::SocketManager(const Config &config)
+	: m_events(NULL), m_config(config), m_cgiPipes(0), m_cgiPoolCheckMs(0ULL)
 {
-	return;
+	m_fileCache.configure(config.file_cache_entries, config.file_cache_valid_ms);
+	m_fileCache.setMimeTypes(&m_config.types);
+	m_contentCache.configure(config.content_cache_bytes,
+							 config.content_cache_max_file);
 }
 
+// With fastcgi_pass and no cgi_extension the whole location goes to the
+// application; otherwise only the listed extensions do.
 static bool isCgiEndpoint(const RouteConfig &route,
 						  const std::string &urlPath)
 {
+	if (!route.fastcgi_pass.empty() && route.cgi_extension.empty())
+		return true;
 	const std::string ext = getFileExtension(urlPath);
 	return !ext.empty() &&
 		   route.cgi_extension.find(ext) != route.cgi_extension.end();
@@ -167,8 +282,7 @@ bool SocketManager::handleMultipartFailure(int fd, ClientState &st)
 		body = "<h1>413 Payload Too Large</h1><p>Multipart upload aborted.</p>";
 
 	const ServerConfig &srv = findServerForClient(fd);
-	const RouteConfig *rt =
-		st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+	const RouteConfig *rt = routeFor(fd, st);
 	Response err = makeConfigErrorResponse(srv, rt, status, title, body);
 	finalizeAndQueue(fd, st.req, err, false, true);
 	setPhase(fd, st, ClientState::SENDING_RESPONSE, "tryReadBody");
@@ -198,8 +312,7 @@ bool SocketManager::feedToMultipart(int fd, ClientState &st, const char *p,
 	if (st.maxBodyAllowed > 0 && nextTotal > st.maxBodyAllowed)
 	{
 		const ServerConfig &srv = findServerForClient(fd);
-		const RouteConfig *rt =
-			st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+		const RouteConfig *rt = routeFor(fd, st);
 		Response err = makeConfigErrorResponse(srv, rt, 413, "Payload Too Large",
 											   "<h1>413 Payload Too Large</h1>");
 		finalizeAndQueue(fd, st.req, err, false, true);
@@ -212,8 +325,7 @@ bool SocketManager::feedToMultipart(int fd, ClientState &st, const char *p,
 	if (mpRes == MultipartStreamParser::ERR)
 	{
 		const ServerConfig &srv = findServerForClient(fd);
-		const RouteConfig *rt =
-			st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+		const RouteConfig *rt = routeFor(fd, st);
 		Response err =
 			makeConfigErrorResponse(srv, rt, 400, "Malformed multipart body",
 									"<h1>400 Malformed multipart body</h1>");
@@ -300,24 +412,23 @@ void SocketManager::queueMultipartSummary(int fd, ClientState &st)
 }
 
 SocketManager::SocketManager()
+	: m_events(NULL), m_cgiPipes(0), m_cgiPoolCheckMs(0ULL)
 {
 	return;
 }
 
 SocketManager::SocketManager(const SocketManager &src)
-	: m_pollfds(src.m_pollfds), m_serverFds(src.m_serverFds)
+	: m_events(NULL), m_cgiPipes(0), m_cgiPoolCheckMs(0ULL)
 {
 	// Do NOT copy m_servers — ServerSocket is non-copyable
+	// nor m_events, the backend owns a kernel object, nor the fd table
+	(void)src;
 }
 
 SocketManager &SocketManager::operator=(const SocketManager &src)
 {
-	if (this != &src)
-	{
-		m_pollfds = src.m_pollfds;
-		m_serverFds = src.m_serverFds;
-		// Do NOT copy m_servers
-	}
+	(void)src;
+	// Do NOT copy m_servers, m_events nor the fd table
 	return *this;
 }
 
@@ -325,31 +436,146 @@ SocketManager::~SocketManager()
 {
 	for (size_t i = 0; i < m_servers.size(); ++i)
 		delete m_servers[i];
+	for (size_t i = 0; i < m_clientList.size(); ++i)
+		delete m_clientList[i];
+	freeRetiredClients();
+	for (size_t i = 0; i < m_clientPool.size(); ++i)
+		delete m_clientPool[i];
+	for (size_t i = 0; i < m_fcgiConns.size(); ++i)
+	{
+		if (!m_fcgiConns[i])
+			continue;
+		::close(static_cast<int>(i));
+		delete m_fcgiConns[i];
+	}
+	stopCgiPools(); // after the close: the workers see EOF and may just leave
+	delete m_events;
 }
 
-void SocketManager::addServer(const std::string &host, unsigned short port)
+void SocketManager::addServer(size_t serverIndex, bool reusePort)
 {
-	ServerSocket *server = new ServerSocket(host, port);
-	m_servers.push_back(server);
-	m_serverFds.insert(server->getFd());
+	const ServerConfig &cfg = m_serversConfig.at(serverIndex);
+
+	// startup only: a scan over the listeners so far is fine
+	size_t listener = 0;
+	while (listener < m_vhosts.size())
+	{
+		const ServerConfig &first = m_serversConfig[m_vhosts[listener].defaultServer()];
+		if (first.port == cfg.port && first.host == cfg.host)
+			break;
+		++listener;
+	}
+	if (listener == m_vhosts.size())
+	{
+		ServerSocket *server = new ServerSocket(cfg.host, cfg.port, reusePort);
+		FdSlot &slot = slotFor(server->getFd());
+		slot.kind = FdSlot::LISTENER;
+		slot.serverIndex = serverIndex;
+		slot.listener = listener;
+		++slot.generation;
+		m_servers.push_back(server);
+		m_vhosts.push_back(VirtualHosts());
+		m_vhosts.back().setDefault(serverIndex);
+	}
+	else
+		std::cout << "server " << serverIndex << " shares " << cfg.host << ":"
+				  << cfg.port << " with server "
+				  << m_vhosts[listener].defaultServer() << std::endl;
+	for (size_t i = 0; i < cfg.server_names.size(); ++i)
+		m_vhosts[listener].add(cfg.server_names[i], serverIndex);
 }
 
-void SocketManager::initPoll()
+FdSlot &SocketManager::slotFor(int fd)
 {
-	m_pollfds.clear();
-	for (size_t i = 0; i < m_servers.size(); ++i)
+	if (static_cast<size_t>(fd) >= m_slots.size())
+		m_slots.resize(static_cast<size_t>(fd) + 1);
+	return m_slots[fd];
+}
+
+ClientState *SocketManager::findClient(int fd) const
+{
+	if (fd < 0 || static_cast<size_t>(fd) >= m_slots.size())
+		return NULL;
+	const FdSlot &slot = m_slots[fd];
+	if (slot.kind != FdSlot::CLIENT)
+		return NULL;
+	return m_clientList[slot.clientIndex];
+}
+
+ClientState &SocketManager::attachClient(int fd, size_t listener)
+{
+	FdSlot &slot = slotFor(fd);
+	slot.kind = FdSlot::CLIENT;
+	slot.listener = listener;
+	slot.serverIndex = m_vhosts[listener].defaultServer();
+	slot.clientIndex = m_clientList.size();
+	++slot.generation;
+	if (!m_clientPool.empty())
+	{
+		m_clientList.push_back(m_clientPool.back());
+		m_clientPool.pop_back();
+	}
+	else
+		m_clientList.push_back(new ClientState());
+	m_clientFds.push_back(fd);
+	return *m_clientList.back();
+}
+
+// Swap-remove from the dense list. The state itself is only parked in
+// m_retired: callers up the stack may still hold a reference to it.
+void SocketManager::detachClient(int fd)
+{
+	ClientState *st = findClient(fd);
+	if (!st)
+		return;
+	FdSlot &slot = m_slots[fd];
+	const size_t idx = slot.clientIndex;
+	const size_t last = m_clientList.size() - 1;
+	if (idx != last)
+	{
+		m_clientList[idx] = m_clientList[last];
+		m_clientFds[idx] = m_clientFds[last];
+		m_slots[m_clientFds[idx]].clientIndex = idx;
+	}
+	m_clientList.pop_back();
+	m_clientFds.pop_back();
+	slot.kind = FdSlot::FREE;
+	m_retired.push_back(st);
+}
+
+// End of the loop turn: nothing refers to the retired states any more.
+// They go back to the pool, reset but with their buffers, up to
+// MAX_POOLED_CLIENTS; the rest are freed.
+void SocketManager::freeRetiredClients()
+{
+	for (size_t i = 0; i < m_retired.size(); ++i)
 	{
-		struct pollfd pfd;
-		pfd.fd = m_servers[i]->getFd();
-		pfd.events = POLLIN;
-		pfd.revents = 0;
-		m_pollfds.push_back(pfd);
+		ClientState *st = m_retired[i];
+		resetMultipartState(*st); // partial upload file of a dropped client
+		if (m_clientPool.size() >= MAX_POOLED_CLIENTS)
+		{
+			delete st;
+			continue;
+		}
+		st->resetForNewConnection();
+		m_clientPool.push_back(st);
 	}
+	m_retired.clear();
+}
+
+void SocketManager::initPoll()
+{
+	delete m_events;
+	m_events = EventBackend::create(m_config.event_backend);
+	std::cout << "Event backend: " << m_events->name() << std::endl;
+	for (size_t i = 0; i < m_servers.size(); ++i)
+		addPollFd(m_servers[i]->getFd(), POLLIN);
 }
 
 bool SocketManager::isListeningSocket(int fd) const
 {
-	return m_serverFds.count(fd) > 0;
+	return fd >= 0 && static_cast<size_t>(fd) < m_slots.size() &&
+		   m_slots[fd].kind == FdSlot::LISTENER;
 }
 
 void SocketManager::handleNewConnection(int listen_fd)
@@ -371,92 +597,42 @@ void SocketManager::handleNewConnection(int listen_fd)
 
 	std::cout << "Accepted new client: fd " << client_fd << std::endl;
 
-	struct pollfd pdf;
-	pdf.fd = client_fd;
-	pdf.events = POLLIN; // ready for reading
-	pdf.revents = 0;
-	m_pollfds.push_back(pdf);
-
-	for (size_t i = 0; i < m_servers.size(); ++i)
-	{
-		if (m_servers[i]->getFd() == listen_fd)
-		{
-			m_clientToServerIndex[client_fd] = i;
-			break;
-		}
-	}
+	addPollFd(client_fd, POLLIN); // ready for reading
 
-	ClientState st = ClientState();
+	// fresh or from the pool, either way already in its initial state
+	ClientState &st = attachClient(client_fd, m_slots[listen_fd].listener);
 	setPhase(client_fd, st, ClientState::READING_HEADERS, "handleNewConnection");
-	st.recvBuffer = std::string();
-	st.bodyBuffer = std::string();
-	st.isChunked = false;
-	st.contentLength = 0;
-	st.maxBodyAllowed = 0;
-	st.writeBuffer.clear();
-	st.forceCloseAfterWrite = false;
-	st.closing = false;
-	st.isMultipart = false;
-	st.multipartInit = false;
-	st.multipartBoundary.clear();
-	st.mpState = ClientState::MP_START;
-	st.mp = MultipartStreamParser();
-	resetMultipartState(st);
+	st.allocMark = allocCount();
 
-	m_clients[client_fd] = st;
 	std::cerr << "[fd " << client_fd
-			  << "] inserted in m_clients, phase=READING_HEADERS" << std::endl;
+			  << "] attached to slot table, phase=READING_HEADERS" << std::endl;
 }
 
 void SocketManager::setPollToWrite(int fd)
 {
-	for (size_t i = 0; i < m_pollfds.size(); ++i)
-	{
-		if (m_pollfds[i].fd == fd)
-		{
-			m_pollfds[i].events |= POLLOUT;
-			break;
-		}
-	}
+	modPollEvents(fd, POLLOUT, 0);
 }
 
 void SocketManager::clearPollout(int fd)
 {
-	for (size_t i = 0; i < m_pollfds.size(); ++i)
-	{
-		if (m_pollfds[i].fd == fd)
-		{
-			m_pollfds[i].events &=
-				~POLLOUT; // remove write interest ONLY operator bitwise AND (&=) and
-						  // NOT (~) to just remove pollout
-			break;
-		}
-	}
+	// remove write interest ONLY, POLLIN stays as it was
+	modPollEvents(fd, 0, POLLOUT);
 }
 
 void SocketManager::queueErrorAndClose(int fd, int status,
 									   const std::string &title,
 									   const std::string &html)
 {
-	std::map<int, ClientState>::iterator it = m_clients.find(fd);
-	if (it == m_clients.end())
-	{
-		ClientState fresh = ClientState();
-		setPhase(fd, fresh, ClientState::READING_HEADERS, "queueErrorAndClose");
-		fresh.forceCloseAfterWrite = false;
-		fresh.closing = false;
-		m_clients[fd] = fresh;
-		it = m_clients.find(fd);
-	}
-	ClientState &st = it->second;
+	ClientState *stp = findClient(fd);
+	if (!stp)
+		return; // connection already gone, nowhere to send the error
+	ClientState &st = *stp;
 	if (st.closing)
 		return;
 	st.closing = true;
 
 	const ServerConfig &srv = findServerForClient(fd);
-	const RouteConfig *route = NULL;
-	if (!st.req.path.empty())
-		route = findMatchingLocation(srv, st.req.path);
+	const RouteConfig *route = routeFor(fd, st);
 
 	Response res = makeConfigErrorResponse(srv, route, status, title, html);
 	res.close_connection = true;
@@ -465,46 +641,99 @@ void SocketManager::queueErrorAndClose(int fd, int status,
 }
 
 // Nonblocking read into the ClientState recvBuffer
+// One readv() per readiness event, straight into the buffer the bytes
+// belong to: a plain Content-Length body goes onto bodyBuffer's tail (never
+// past what the body still lacks), anything else onto recvBuffer's tail. The
+// second iovec is a shared spill area, so a burst bigger than the window
+// still costs a single call; what lands there is appended to recvBuffer.
+// The window doubles when a read fills it and halves when reads come back
+// small, so idle keep-alive connections don't pin large buffers. Nothing
+// past io_budget_bytes is taken in one go: a bulk upload leaves the rest in
+// the socket for the next turn and the other clients get theirs first.
 bool SocketManager::readIntoBuffer(int fd, ClientState &st)
 {
-	char buffer[4096];
-	ssize_t bytes = ::recv(fd, buffer, sizeof(buffer), 0);
-
-	if (bytes == 0)
-		return false;
+	static char spill[RECV_SPILL];
+
+	const bool toBody = st.phase == ClientState::READING_BODY && !st.isChunked &&
+						!st.isMultipart && st.recvBuffer.empty() &&
+						st.bodyBuffer.size() < st.contentLength;
+	const size_t budget = m_config.io_budget_bytes;
+	size_t room = st.recvWindow;
+	if (toBody && st.contentLength - st.bodyBuffer.size() < room)
+		room = st.contentLength - st.bodyBuffer.size();
+	if (budget && room > budget)
+		room = budget;
+	size_t spillLen = sizeof(spill);
+	if (budget && spillLen > budget - room)
+		spillLen = budget - room;
+
+	const size_t old = st.bodyBuffer.size();
+	char *dst;
+	if (toBody)
+	{
+		st.bodyBuffer.resize(old + room);
+		dst = &st.bodyBuffer[old];
+	}
+	else
+		dst = st.recvBuffer.prepare(room);
+	struct iovec iov[2];
+	iov[0].iov_base = dst;
+	iov[0].iov_len = room;
+	iov[1].iov_base = spill;
+	iov[1].iov_len = spillLen;
+	ssize_t bytes = ::readv(fd, iov, spillLen ? 2 : 1);
+	++st.recvCalls;
 
 	if (bytes <= 0) // we are dumb here, before we used erno but its after recv so
 					// this is clean from subject but dumb.
 	{
+		if (toBody)
+			st.bodyBuffer.resize(old);
 		return false;
 	}
 
-	st.recvBuffer.append(buffer, static_cast<size_t>(bytes));
+	const size_t n = static_cast<size_t>(bytes);
+	const size_t inPlace = n < room ? n : room;
+	if (toBody)
+		st.bodyBuffer.resize(old + inPlace);
+	else
+		st.recvBuffer.commit(inPlace);
+	if (n > inPlace)
+		st.recvBuffer.append(spill, n - inPlace);
+
+	if (n >= st.recvWindow && st.recvWindow < RECV_WINDOW_MAX)
+		st.recvWindow *= 2;
+	else if (n < st.recvWindow / 4 && st.recvWindow > RECV_WINDOW_MIN)
+		st.recvWindow /= 2;
 	return true;
 }
 
-void SocketManager::dispatchRequest(int fd, const Request &req,
+// Path temporaries live in the request's arena: on a keep-alive connection
+// they reuse the previous request's storage.
+void SocketManager::dispatchRequest(int fd, ClientState &st,
 									const ServerConfig &server,
 									const std::string &methodUpper)
 {
+	const Request &req = st.req;
 	// dispatch: static/autoindex/redirect
-	const RouteConfig *route = findMatchingLocation(server, req.path);
+	const RouteConfig *route = routeFor(fd, st);
 
-	std::string effectiveRoot =
+	const std::string &effectiveRoot =
 		(route && !route->root.empty()) ? route->root : server.root;
-	std::string effectiveIndex =
+	const std::string &effectiveIndex =
 		(route && !route->index.empty()) ? route->index : server.index;
 
-	// strip route prefix
-	std::string strippedPath = req.path;
-	if (route && strippedPath.find(route->path) == 0)
-		strippedPath = strippedPath.substr(route->path.length());
-	if (!strippedPath.empty() && strippedPath[0] != '/')
-		strippedPath = "/" + strippedPath;
-
-	std::string fullPath = effectiveRoot + strippedPath;
-
-	if (dirExists(fullPath))
+	// root + path with the route prefix stripped
+	std::string &fullPath = st.arena.str();
+	size_t skip = 0;
+	if (route && req.path.compare(0, route->path.size(), route->path) == 0)
+		skip = route->path.size();
+	fullPath.assign(effectiveRoot);
+	if (skip < req.path.size() && req.path[skip] != '/')
+		fullPath += '/';
+	fullPath.append(req.path, skip, std::string::npos);
+
+	if (m_fileCache.lookup(fullPath).isDir)
 	{
 		// redirect missing trailing slash
 		if (!req.path.empty() && req.path[req.path.length() - 1] != '/')
@@ -521,23 +750,20 @@ void SocketManager::dispatchRequest(int fd, const Request &req,
 		}
 
 		// try index
-		std::string indexCandidate = fullPath;
+		std::string &indexCandidate = st.arena.str();
+		indexCandidate.assign(fullPath);
 		if (!indexCandidate.empty() &&
 			indexCandidate[indexCandidate.size() - 1] != '/')
 			indexCandidate += '/';
 		indexCandidate += effectiveIndex;
 
-		if (fileExists(indexCandidate))
+		if (m_fileCache.lookup(indexCandidate).exists)
 		{
-			std::string body = readFile(indexCandidate);
 			Response res;
-			res.status_code = 200;
-			res.status_message = "OK";
-			res.body = body;
-			res.headers["Content-Type"] = getMimeTypeFromPath(indexCandidate);
-			res.headers["Content-Length"] = to_string(body.length());
-			if (methodUpper == "HEAD")
-				res.body.clear();
+			if (!buildStaticResponse(res, req, indexCandidate,
+									 methodUpper == "HEAD"))
+				res = makeConfigErrorResponse(server, route, 403, "Forbidden",
+											  "<h1>403 Forbidden</h1>");
 			const bool body_expected = false;
 			const bool body_fully_consumed = true;
 			finalizeAndQueue(fd, req, res, body_expected, body_fully_consumed);
@@ -572,7 +798,7 @@ void SocketManager::dispatchRequest(int fd, const Request &req,
 	}
 
 	// path safety / existence
-	if (!isPathSafe(effectiveRoot, fullPath))
+	if (!m_fileCache.isSafe(effectiveRoot, fullPath))
 	{
 		Response res = makeConfigErrorResponse(server, route, 403, "Forbidden",
 											   "<h1> 403 Forbidden</h1>");
@@ -581,7 +807,7 @@ void SocketManager::dispatchRequest(int fd, const Request &req,
 		finalizeAndQueue(fd, req, res, body_expected, body_fully_consumed);
 		return;
 	}
-	if (!fileExists(fullPath))
+	if (!m_fileCache.lookup(fullPath).exists)
 	{
 		Response res = makeConfigErrorResponse(server, route, 404, "Not Found",
 											   "<h1>404 Not Found</h1>");
@@ -591,24 +817,340 @@ void SocketManager::dispatchRequest(int fd, const Request &req,
 		return;
 	}
 
-	// static file 200
-	std::string body = readFile(fullPath);
+	// static file 200, body streamed from the fd (no copy into memory)
 	Response res;
-	res.status_code = 200;
-	res.status_message = "OK";
-	res.body = body;
-	res.headers["Content-Type"] = getMimeTypeFromPath(fullPath);
-	res.headers["Content-Length"] = to_string(body.length());
-	if (methodUpper == "HEAD")
-		res.body.clear();
+	if (!buildStaticResponse(res, req, fullPath, methodUpper == "HEAD"))
+		res = makeConfigErrorResponse(server, route, 403, "Forbidden",
+									  "<h1>403 Forbidden</h1>");
 	const bool body_expected = false;
 	const bool body_fully_consumed = true;
 	finalizeAndQueue(fd, req, res, body_expected, body_fully_consumed);
 }
 
+// Strong validator from what stat() already gave us: "ino-size-mtime" (hex).
+static std::string makeEtag(const FileInfo &info)
+{
+	std::ostringstream oss;
+	oss << '"' << std::hex << static_cast<unsigned long>(info.ino) << '-'
+		<< info.size << '-' << static_cast<long>(info.mtime) << '"';
+	return oss.str();
+}
+
+// If-None-Match list vs our tag, weak comparison (W/ ignored), "*" matches.
+static bool etagListMatches(const std::string &list, const std::string &etag)
+{
+	size_t pos = 0;
+	while (pos <= list.size())
+	{
+		size_t comma = list.find(',', pos);
+		if (comma == std::string::npos)
+			comma = list.size();
+		std::string item = trimCopy(list.substr(pos, comma - pos));
+		if (item.compare(0, 2, "W/") == 0)
+			item.erase(0, 2);
+		if (item == "*" || item == etag)
+			return true;
+		pos = comma + 1;
+	}
+	return false;
+}
+
+// RFC 9110 13.2.2: If-None-Match wins, If-Modified-Since only without it.
+static bool isNotModified(const Request &req, const FileInfo &info)
+{
+	if (req.headers.has(HeaderTable::IF_NONE_MATCH))
+		return etagListMatches(req.headers.get(HeaderTable::IF_NONE_MATCH),
+							   makeEtag(info));
+
+	time_t since;
+	if (req.headers.has(HeaderTable::IF_MODIFIED_SINCE) &&
+		parseHttpDate(req.headers.get(HeaderTable::IF_MODIFIED_SINCE), since))
+		return info.mtime <= since;
+	return false;
+}
+
+// Range / If-Range (RFC 9110 14.2, 13.1.5). Anything we don't understand
+// makes the Range header void and the whole file goes out as a 200.
+enum RangeVerdict
+{
+	RANGE_IGNORE,
+	RANGE_SATISFIABLE,
+	RANGE_UNSATISFIABLE
+};
+
+struct ByteRange
+{
+	size_t first;
+	size_t last; // inclusive
+};
+
+// More parts than this, or parts adding up to more than the file (overlap
+// games), and we just send the whole thing.
+static const size_t MAX_BYTE_RANGES = 16;
+
+// Decimal byte position, saturating instead of overflowing.
+static bool parseBytePos(const std::string &s, size_t &out)
+{
+	if (s.empty())
+		return false;
+	out = 0;
+	for (size_t i = 0; i < s.size(); ++i)
+	{
+		if (!std::isdigit(static_cast<unsigned char>(s[i])))
+			return false;
+		const size_t digit = static_cast<size_t>(s[i] - '0');
+		if (out > (static_cast<size_t>(-1) - digit) / 10)
+			out = static_cast<size_t>(-1);
+		else
+			out = out * 10 + digit;
+	}
+	return true;
+}
+
+static RangeVerdict parseRanges(const std::string &value, size_t size,
+								std::vector<ByteRange> &out)
+{
+	const std::string v = trimCopy(value);
+	if (v.size() < 6 || toLowerCopy(v.substr(0, 6)) != "bytes=")
+		return RANGE_IGNORE;
+
+	size_t specs = 0;
+	size_t total = 0;
+	size_t pos = 6;
+	while (pos <= v.size())
+	{
+		size_t comma = v.find(',', pos);
+		if (comma == std::string::npos)
+			comma = v.size();
+		const std::string spec = trimCopy(v.substr(pos, comma - pos));
+		pos = comma + 1;
+		if (spec.empty())
+			continue;
+		if (++specs > MAX_BYTE_RANGES)
+			return RANGE_IGNORE;
+
+		const size_t dash = spec.find('-');
+		if (dash == std::string::npos)
+			return RANGE_IGNORE;
+		ByteRange r;
+		if (dash == 0)
+		{
+			size_t suffix;
+			if (!parseBytePos(spec.substr(1), suffix))
+				return RANGE_IGNORE;
+			if (suffix == 0 || size == 0)
+				continue;
+			r.first = suffix >= size ? 0 : size - suffix;
+			r.last = size - 1;
+		}
+		else
+		{
+			if (!parseBytePos(spec.substr(0, dash), r.first))
+				return RANGE_IGNORE;
+			r.last = static_cast<size_t>(-1);
+			if (dash + 1 < spec.size() && !parseBytePos(spec.substr(dash + 1), r.last))
+				return RANGE_IGNORE;
+			if (r.last < r.first)
+				return RANGE_IGNORE;
+			if (r.first >= size)
+				continue;
+			if (r.last >= size)
+				r.last = size - 1;
+		}
+		total += r.last - r.first + 1;
+		out.push_back(r);
+	}
+	if (specs == 0)
+		return RANGE_IGNORE;
+	if (out.empty())
+		return RANGE_UNSATISFIABLE;
+	if (out.size() > 1 && total > size)
+		return RANGE_IGNORE;
+	return RANGE_SATISFIABLE;
+}
+
+// No If-Range, or it still names this version of the file. Only strong
+// validators count: our ETag, or exactly our Last-Modified date.
+static bool ifRangeMatches(const Request &req, const FileInfo &info)
+{
+	if (!req.headers.has(HeaderTable::IF_RANGE))
+		return true;
+	const std::string v = req.headers.get(HeaderTable::IF_RANGE);
+	if (!v.empty() && v[0] == '"')
+		return v == makeEtag(info);
+	time_t date;
+	return parseHttpDate(v, date) && date == info.mtime;
+}
+
+static std::string contentRange(const ByteRange &r, size_t size)
+{
+	std::ostringstream oss;
+	oss << "bytes " << r.first << '-' << r.last << '/' << size;
+	return oss.str();
+}
+
+// Unique enough per process: a counter mixed with the file identity.
+static std::string makeBoundary(const FileInfo &info)
+{
+	static unsigned long counter = 0;
+	std::ostringstream oss;
+	oss << "webserv-" << std::hex << static_cast<unsigned long>(info.ino)
+		<< static_cast<long>(info.mtime) << '-' << ++counter;
+	return oss.str();
+}
+
+// 206 over `ffd`: one range goes out as is, several as multipart/byteranges
+// with the part headers riding in the spans between file slices. Either way
+// the file itself is never read into memory.
+static void buildRangeResponse(Response &res, int ffd, const FileInfo &info,
+							   const std::vector<ByteRange> &ranges)
+{
+	res.status_code = 206;
+	res.status_message = "Partial Content";
+	res.headers["ETag"] = makeEtag(info);
+	res.headers["Last-Modified"] = httpDate(info.mtime);
+	res.body_fd = ffd;
+
+	if (ranges.size() == 1)
+	{
+		const ByteRange &r = ranges[0];
+		res.headers["Content-Type"] = info.mime;
+		res.headers["Content-Range"] = contentRange(r, info.size);
+		res.headers["Content-Length"] = to_string(r.last - r.first + 1);
+		res.body_spans.push_back(FileSpan(static_cast<off_t>(r.first),
+										  r.last - r.first + 1));
+		return;
+	}
+
+	const std::string boundary = makeBoundary(info);
+	size_t length = 0;
+	std::string partHead = "--" + boundary + "\r\n";
+	for (size_t i = 0; i < ranges.size(); ++i)
+	{
+		const ByteRange &r = ranges[i];
+		partHead += std::string("Content-Type: ") + info.mime + "\r\n";
+		partHead += "Content-Range: " + contentRange(r, info.size) + "\r\n\r\n";
+		// The previous span carries this part's head; the first one goes
+		// out with a zero-length span in front.
+		if (i == 0)
+			res.body_spans.push_back(FileSpan(0, 0, partHead));
+		else
+			res.body_spans.back().after = partHead;
+		length += partHead.size() + (r.last - r.first + 1);
+		res.body_spans.push_back(FileSpan(static_cast<off_t>(r.first),
+										  r.last - r.first + 1));
+		partHead = "\r\n--" + boundary + "\r\n";
+	}
+	const std::string closing = "\r\n--" + boundary + "--\r\n";
+	res.body_spans.back().after = closing;
+	length += closing.size();
+	res.headers["Content-Type"] = "multipart/byteranges; boundary=" + boundary;
+	res.headers["Content-Length"] = to_string(length);
+}
+
+// Head of a full 200 for `info`, written without going through the
+// Response header map.
+static std::string fileHead(const FileInfo &info)
+{
+	std::string head;
+	HeaderBuilder hb(head);
+	hb.statusLine(200, "OK");
+	hb.header(HeaderBuilder::H_ACCEPT_RANGES, "bytes");
+	hb.header(HeaderBuilder::H_CONTENT_LENGTH, info.size);
+	hb.header(HeaderBuilder::H_CONTENT_TYPE, info.mime);
+	hb.header(HeaderBuilder::H_ETAG, makeEtag(info));
+	hb.header(HeaderBuilder::H_LAST_MODIFIED, httpDate(info.mtime));
+	return head;
+}
+
+// 200 for a regular file, or 304 when the client's validators still match
+// (decided from cached metadata alone, the file is never opened). Small
+// files come from the content cache with their head prebuilt; anything
+// bigger is attached as a dup of the cached fd and goes out through
+// sendfile(). HEAD never opens a file that isn't cached. A GET with a
+// usable Range gets a 206 (or 416) served from the file offset instead.
+bool SocketManager::buildStaticResponse(Response &res, const Request &req,
+										const std::string &path, bool headOnly)
+{
+	FileInfo info = m_fileCache.lookup(path);
+	if (!info.isReg)
+		return false;
+
+	if (isNotModified(req, info))
+	{
+		res.status_code = 304;
+		res.status_message = "Not Modified";
+		HeaderBuilder hb(res.raw_head);
+		hb.statusLine(res.status_code, res.status_message);
+		hb.header(HeaderBuilder::H_ETAG, makeEtag(info));
+		hb.header(HeaderBuilder::H_LAST_MODIFIED, httpDate(info.mtime));
+		return true;
+	}
+
+	if (!headOnly && req.headers.has(HeaderTable::RANGE))
+	{
+		// Ranges are resolved against the file as opened, not a stale stat.
+		int ffd = m_fileCache.openShared(path, info);
+		if (ffd < 0)
+			return false;
+		std::vector<ByteRange> ranges;
+		RangeVerdict verdict = RANGE_IGNORE;
+		if (ifRangeMatches(req, info))
+			verdict = parseRanges(req.headers.get(HeaderTable::RANGE), info.size,
+								  ranges);
+		if (verdict == RANGE_SATISFIABLE)
+		{
+			buildRangeResponse(res, ffd, info, ranges);
+			return true;
+		}
+		::close(ffd);
+		if (verdict == RANGE_UNSATISFIABLE)
+		{
+			res = makeHtmlError(416, "Range Not Satisfiable",
+								"<h1>416 Range Not Satisfiable</h1>");
+			res.headers["Content-Range"] = "bytes */" + to_string(info.size);
+			return true;
+		}
+	}
+
+	res.status_code = 200;
+	res.status_message = "OK";
+
+	if (m_contentCache.accepts(info.size))
+	{
+		const ContentCache::Entry *hit = m_contentCache.find(path, info);
+		if (!hit)
+		{
+			std::string body;
+			if (m_fileCache.readAll(path, body) && body.size() == info.size)
+				hit = m_contentCache.store(path, info, fileHead(info), body);
+		}
+		if (hit)
+		{
+			res.raw_head = hit->head;
+			if (!headOnly)
+				res.body = hit->body;
+			return true;
+		}
+	}
+
+	if (headOnly)
+	{
+		res.raw_head = fileHead(info);
+		return true;
+	}
+	int ffd = m_fileCache.openShared(path, info);
+	if (ffd < 0)
+		return false;
+	res.body_fd = ffd;
+	res.body_spans.push_back(FileSpan(0, info.size));
+	res.raw_head = fileHead(info); // size as opened
+	return true;
+}
+
 bool SocketManager::clientHasPendingWrite(const ClientState &st) const
 {
-	return !st.writeBuffer.empty();
+	return !st.out.empty();
 }
 
 // Returns true only when the request body is fully read and st.phase is set to
@@ -641,7 +1183,7 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 				consumed = st.chunkDec.feed(st.recvBuffer.data(), st.recvBuffer.size(),
 											max_allowed);
 				if (consumed > 0)
-					st.recvBuffer.erase(0, consumed);
+					st.recvBuffer.consume(consumed);
 			}
 
 			const size_t before = st.bodyBuffer.size();
@@ -668,8 +1210,7 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 				st.recvBuffer.clear();
 
 				const ServerConfig &srv = findServerForClient(fd);
-				const RouteConfig *rt =
-					st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+				const RouteConfig *rt = routeFor(fd, st);
 				Response err =
 					makeConfigErrorResponse(srv, rt, 413, "Payload Too Large",
 											"<h1>413 Payload Too Large</h1>");
@@ -694,9 +1235,7 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 				if (st.isMultipart && !st.mpDone())
 				{
 					const ServerConfig &srv = findServerForClient(fd);
-					const RouteConfig *rt = st.req.path.empty()
-												? NULL
-												: findMatchingLocation(srv, st.req.path);
+					const RouteConfig *rt = routeFor(fd, st);
 					Response err =
 						makeConfigErrorResponse(srv, rt, 400, "Bad Request",
 												"<h1>400 Bad Request</h1><p>Multipart "
@@ -743,19 +1282,17 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 				const char *chunkPtr = st.recvBuffer.data();
 				if (!feedToMultipart(fd, st, chunkPtr, take))
 					return false;
-				st.recvBuffer.erase(0, take);
+				st.recvBuffer.consume(take);
 			}
 			else
 			{
 				st.bodyBuffer.append(st.recvBuffer.data(), take);
-				st.recvBuffer.erase(0, take);
+				st.recvBuffer.consume(take);
 
 				if (st.maxBodyAllowed > 0 && st.bodyBuffer.size() > st.maxBodyAllowed)
 				{
 					const ServerConfig &srv = findServerForClient(fd);
-					const RouteConfig *rt = st.req.path.empty()
-												? NULL
-												: findMatchingLocation(srv, st.req.path);
+					const RouteConfig *rt = routeFor(fd, st);
 					Response err =
 						makeConfigErrorResponse(srv, rt, 413, "Payload Too Large",
 												"<h1>413 Payload Too Large</h1>");
@@ -778,8 +1315,7 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 		if (st.isMultipart && !st.mpDone())
 		{
 			const ServerConfig &srv = findServerForClient(fd);
-			const RouteConfig *rt =
-				st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+			const RouteConfig *rt = routeFor(fd, st);
 			Response err =
 				makeConfigErrorResponse(srv, rt, 400, "Bad Request",
 										"<h1>400 Bad Request</h1><p>Multipart ended "
@@ -798,17 +1334,17 @@ bool SocketManager::tryReadBody(int fd, ClientState &st)
 
 void SocketManager::finalizeRequestAndQueueResponse(int fd, ClientState &st)
 {
-	const ServerConfig &server = m_serversConfig[m_clientToServerIndex[fd]];
+	const ServerConfig &server = findServerForClient(fd);
 	// Get/Head using previous dispatcher for (static/autoindex/redirect)
 	if (st.req.method == "GET" || st.req.method == "HEAD")
 	{
-		dispatchRequest(fd, st.req, server, st.req.method);
+		dispatchRequest(fd, st, server, st.req.method);
 		return;
 	}
 
 	if (st.req.method == "POST")
 	{
-		const RouteConfig *route = findMatchingLocation(server, st.req.path);
+		const RouteConfig *route = routeFor(fd, st);
 		if (st.isMultipart)
 		{
 			if (st.multipartError)
@@ -825,7 +1361,7 @@ void SocketManager::finalizeRequestAndQueueResponse(int fd, ClientState &st)
 	}
 	if (st.req.method == "DELETE")
 	{
-		const RouteConfig *route = findMatchingLocation(server, st.req.path);
+		const RouteConfig *route = routeFor(fd, st);
 		handleDelete(fd, st.req, server, route);
 		return;
 	}
@@ -849,11 +1385,11 @@ void SocketManager::finalizeRequestAndQueueResponse(int fd, ClientState &st)
 // occurs
 void SocketManager::handleClientRead(int fd)
 {
-	std::map<int, ClientState>::iterator it = m_clients.find(fd);
-	if (it == m_clients.end())
+	ClientState *stp = findClient(fd);
+	if (!stp)
 		return;
 
-	ClientState &st = it->second;
+	ClientState &st = *stp;
 
 	if (st.closing)
 	{
@@ -925,9 +1461,7 @@ void SocketManager::handleClientRead(int fd)
 				if (!completed)
 				{
 					const ServerConfig &srv = findServerForClient(fd);
-					const RouteConfig *rt = st.req.path.empty()
-												? NULL
-												: findMatchingLocation(srv, st.req.path);
+					const RouteConfig *rt = routeFor(fd, st);
 					Response err =
 						makeConfigErrorResponse(srv, rt, 400, "Bad Request",
 												"<h1>400 Bad Request</h1><p>Unexpected "
@@ -958,32 +1492,41 @@ void SocketManager::handleClientRead(int fd)
 		std::cerr << "[fd " << fd
 				  << "] after readIntoBuffer recv=" << st.recvBuffer.size()
 				  << std::endl;
+	}
 
-		// 2. advance state machine
-		if (st.phase == ClientState::READING_HEADERS)
-		{
-			if (!tryParseHeaders(fd, st))
-				// tryParseHeaders:
-				// - look for \r\n\r\n in st.recvBuffer
-				// - if not complete yet: return true
-				// - if complete: fill st.req, set
-				// st.isChunked/contentLength/maxBodyAllowed,
-				//               strip header bytes from st.recvBuffer,
-				//               set st.phase to READING_BODY or READY_TO_DISPATCH
-				// - if bad request: queue error response + set st.phase =
-				// SENDING_RESPONSE, return false
-				return; // need more data or we already have an error
+	// 2. advance state machine, 3. dispatch if ready
+	advanceRequest(fd, st);
+}
 
-			if (st.phase == ClientState::READING_BODY && st.isMultipart &&
-				!st.multipartInit)
-			{
-				st.mp.reset(st.multipartBoundary, &SocketManager::onPartBeginThunk,
-							&SocketManager::onPartDataThunk,
-							&SocketManager::onPartEndThunk, &st);
-				st.multipartInit = true;
-				std::cout << "[fd" << fd << "] multipart parser reset";
-			}
+// Everything after the read: headers, body, dispatch, over whatever is
+// already buffered. Also entered from handleClientWrite for a pipelined
+// request that arrived behind the response just sent.
+void SocketManager::advanceRequest(int fd, ClientState &st)
+{
+	if (st.phase == ClientState::READING_HEADERS)
+	{
+		if (!tryParseHeaders(fd, st))
+			// tryParseHeaders:
+			// - look for \r\n\r\n in st.recvBuffer
+			// - if not complete yet: return true
+			// - if complete: fill st.req, set
+			// st.isChunked/contentLength/maxBodyAllowed,
+			//               strip header bytes from st.recvBuffer,
+			//               set st.phase to READING_BODY or READY_TO_DISPATCH
+			// - if bad request: queue error response + set st.phase =
+			// SENDING_RESPONSE, return false
+			return; // need more data or we already have an error
+
+		if (st.phase == ClientState::READING_BODY && st.isMultipart &&
+			!st.multipartInit)
+		{
+			st.mp.reset(st.multipartBoundary, &SocketManager::onPartBeginThunk,
+						&SocketManager::onPartDataThunk,
+						&SocketManager::onPartEndThunk, &st);
+			st.multipartInit = true;
+			std::cout << "[fd" << fd << "] multipart parser reset";
 		}
+
 		// If we just transitioned to READING_BODY, try to consume immediately
 		if (st.phase == ClientState::READING_BODY)
 		{
@@ -1003,7 +1546,7 @@ void SocketManager::handleClientRead(int fd)
 	// 3) Dispatch if ready
 	if (st.phase == ClientState::READY_TO_DISPATCH)
 	{
-		const ServerConfig &srv = m_serversConfig[m_clientToServerIndex[fd]];
+		const ServerConfig &srv = findServerForClient(fd);
 
 		std::string urlPath;
 		std::string query;
@@ -1024,32 +1567,43 @@ void SocketManager::handleClientRead(int fd)
 
 void SocketManager::handleClientWrite(int fd)
 {
-	std::map<int, ClientState>::iterator it = m_clients.find(fd);
-	if (it == m_clients.end())
+	ClientState *st = findClient(fd);
+	if (!st)
+		return;
+
+	// Nothing to send while a request is coming in: POLLOUT was armed by
+	// tryFlushWrite because the next request is already in recvBuffer.
+	// Serve it from there, one per event, rather than wait for a POLLIN
+	// that will not come.
+	if (st->out.empty() && !st->closing &&
+		(st->phase == ClientState::READING_HEADERS ||
+		 st->phase == ClientState::READING_BODY))
+	{
+		clearPollout(fd);
+		if (st->phase == ClientState::READING_HEADERS && !st->recvBuffer.empty())
+			advanceRequest(fd, *st);
 		return;
+	}
 
-	tryFlushWrite(fd, it->second);
+	tryFlushWrite(fd, *st);
 }
 
 void SocketManager::handleClientDisconnect(int fd)
 {
+	ClientState *st = findClient(fd);
+	if (!st)
+		return; // already disconnected earlier in this loop turn
+
 	std::cout << "Disconnecting fd " << fd << std::endl;
+	delPollFd(fd); // before close(): the number may be reused right away
 	::close(fd);
-	m_clientToServerIndex.erase(fd);
-	for (size_t i = 0; i < m_pollfds.size(); ++i)
-	{
-		if (m_pollfds[i].fd == fd)
-		{
-			m_pollfds.erase(m_pollfds.begin() + i);
-			break;
-		}
-	}
-	// old legacy code, will go away now that that we do per ClientState
 
-	std::map<int, ClientState>::iterator it = m_clients.find(fd);
-	if (it != m_clients.end())
-		setPhase(fd, it->second, ClientState::CLOSED, "handleClientDisconnect");
-	m_clients.erase(fd);
+	// A CGI still attached would keep pointing at this fd number, which the
+	// next accept() may hand to a different client.
+	releaseCgiPipes(*st);
+	st->out.clear();
+	setPhase(fd, *st, ClientState::CLOSED, "handleClientDisconnect");
+	detachClient(fd);
 }
 
 void SocketManager::setServers(const std::vector<ServerConfig> &servers)
@@ -1059,22 +1613,49 @@ void SocketManager::setServers(const std::vector<ServerConfig> &servers)
 
 const ServerConfig &SocketManager::findServerForClient(int fd) const
 {
-	std::map<int, size_t>::const_iterator it = m_clientToServerIndex.find(fd);
-	if (it == m_clientToServerIndex.end())
+	if (fd < 0 || static_cast<size_t>(fd) >= m_slots.size() ||
+		m_slots[fd].kind != FdSlot::CLIENT)
 		throw std::runtime_error("No matching server config for client FD");
 
-	const size_t idx = it->second;
+	const size_t idx = m_slots[fd].serverIndex;
 	if (idx >= m_serversConfig.size())
 		throw std::runtime_error("Server index out of range for client FD");
 
 	return m_serversConfig[idx]; // ← use the same vector you map into
 }
 
+// The request's location, matched once (by its raw path, query included,
+// as every policy check always has) and kept until the next request.
+const RouteConfig *SocketManager::routeFor(int fd, ClientState &st)
+{
+	if (st.routeKnown)
+		return st.route;
+	if (st.req.path.empty())
+		return NULL; // not parsed yet, don't remember that
+	st.route = findMatchingLocation(findServerForClient(fd), st.req.path);
+	st.routeKnown = true;
+	return st.route;
+}
+
+// The location a CGI was started for (matched without the query); looked up
+// again only if the CGI state was already reset.
+const RouteConfig *SocketManager::cgiRouteFor(int fd, ClientState &st)
+{
+	if (st.cgi.route)
+		return st.cgi.route;
+	std::string urlPath, query;
+	splitPathAndQuery(st.req.path, urlPath, query);
+	return findMatchingLocation(findServerForClient(fd), urlPath);
+}
+
 void SocketManager::finalizeAndQueue(int fd, const Request &req, Response &res,
 									 bool body_expected,
 									 bool body_fully_consumed)
 {
-	ClientState &st = m_clients[fd];
+	ClientState *stp = findClient(fd);
+	if (!stp)
+		return; // connection already gone
+	ClientState &st = *stp;
 	const bool headers_complete = true;
 	const bool client_close = clientRequestedClose(req);
 	if (st.isMultipart)
@@ -1089,7 +1670,7 @@ void SocketManager::finalizeAndQueue(int fd, const Request &req, Response &res,
 	const bool force_close = close_it || st.closing;
 	res.close_connection = force_close;
 
-	st.writeBuffer = build_http_response(res);
+	queueResponse(st, res);
 	st.forceCloseAfterWrite = force_close;
 	setPhase(fd, st, ClientState::SENDING_RESPONSE, "finalizeAndQueue");
 	tryFlushWrite(fd, st);
@@ -1098,7 +1679,10 @@ void SocketManager::finalizeAndQueue(int fd, const Request &req, Response &res,
 // needed an overload of finalize
 void SocketManager::finalizeAndQueue(int fd, Response &res)
 {
-	ClientState &st = m_clients[fd];
+	ClientState *stp = findClient(fd);
+	if (!stp)
+		return; // connection already gone
+	ClientState &st = *stp;
 	if (st.isMultipart)
 	{
 		const bool unlinkSaved = (res.status_code >= 400);
@@ -1117,7 +1701,7 @@ void SocketManager::finalizeAndQueue(int fd, Response &res)
 	const bool force_close = close_it || st.closing;
 	res.close_connection = force_close;
 
-	st.writeBuffer = build_http_response(res);
+	queueResponse(st, res);
 	st.forceCloseAfterWrite = force_close;
 	setPhase(fd, st, ClientState::SENDING_RESPONSE, "finalizeAndQueue");
 	tryFlushWrite(fd, st);
@@ -1131,10 +1715,30 @@ void SocketManager::finalizeAndQueue(int fd, Response &res)
 // return -1 with errno = EPIPE
 // now that we dont use errno idk if its useful, keeping it for the pre-proc
 // style
+// A response went out completely: report what the request cost in socket
+// syscalls (and heap allocations, with ALLOC_STATS) and start counting afresh
+// for the next one on the connection.
+void SocketManager::noteRequestDone(int fd, ClientState &st)
+{
+	const unsigned long allocs = allocCount() - st.allocMark;
+	std::cerr << "[fd " << fd << "] request done: recv_calls=" << st.recvCalls
+			  << " send_calls=" << st.sendCalls;
+	if (allocStatsEnabled())
+		std::cerr << " allocs=" << allocs;
+	std::cerr << std::endl;
+	++m_io.requests;
+	m_io.recvCalls += st.recvCalls;
+	m_io.sendCalls += st.sendCalls;
+	m_io.allocs += allocs;
+	st.recvCalls = 0;
+	st.sendCalls = 0;
+	st.allocMark = allocCount();
+}
+
 bool SocketManager::tryFlushWrite(int fd, ClientState &st)
 {
 
-	if (st.writeBuffer.empty())
+	if (st.out.empty())
 	{
 		clearPollout(fd);
 
@@ -1144,91 +1748,65 @@ bool SocketManager::tryFlushWrite(int fd, ClientState &st)
 		// wait for the next POLLIN on the CGI pipe. If stdout was
 		// previously paused due to backpressure, resume it now that the
 		// buffer is drained.
-		if (st.cgi.stdout_r != -1)
+		if (st.cgi.stdoutOpen())
 		{
 			maybeResumeCgiStdout(fd, st);
 			return true;
 		}
 
+		noteRequestDone(fd, st);
 		if (st.forceCloseAfterWrite || st.closing)
 		{
 			handleClientDisconnect(fd);
 			return false;
 		}
 
-		st.forceCloseAfterWrite = false;
-		st.closing = false;
-
 		// Reset CGI bookkeeping after the response is fully flushed.
 		st.cgi.reset();
 
-		st.req = Request();
-		st.bodyBuffer.clear();
-		st.isChunked = false;
-		st.contentLength = 0;
-		st.maxBodyAllowed = 0;
-		st.chunkDec = ChunkedDecoder();
-		st.isMultipart = false;
-		st.multipartInit = false;
-		st.multipartBoundary.clear();
-		st.mpState = ClientState::MP_START;
-		st.mp = MultipartStreamParser();
+		st.resetForNextRequest();
 		resetMultipartState(st);
 		setPhase(fd, st, ClientState::READING_HEADERS, "tryFlushWrite");
+		if (!st.recvBuffer.empty())
+			setPollToWrite(fd); // pipelined request waiting, see handleClientWrite
 		return true;
 	}
 
 	// here we have just one send() from the subject and we dont check errno after
-	// it
-#ifdef MSG_NOSIGNAL
-	ssize_t n =
-		::send(fd, st.writeBuffer.data(), st.writeBuffer.size(), MSG_NOSIGNAL);
-#else
-	ssize_t n = ::send(fd, st.writeBuffer.data(), st.writeBuffer.size(), 0);
-#endif
-	if (n <= 0)
+	// it: a sendmsg() of the queued memory segments, or one sendfile() chunk
+	// when a file range is at the front, never more than io_budget_bytes.
+	++st.sendCalls;
+	if (st.out.flush(fd, m_config.io_budget_bytes) <= 0)
 	{
 		handleClientDisconnect(fd);
 		return false;
 	}
 
-	// here we know we sent something so we delete that from writeBuffer
-	st.writeBuffer.erase(0, static_cast<size_t>(n));
-
-	if (st.cgi.stdout_r != -1)
+	if (st.cgi.stdoutOpen())
 	{
 		maybeResumeCgiStdout(fd, st);
 		return true;
 	}
 
 	// keep POLLOUT till we send everything
-	if (!st.writeBuffer.empty())
+	if (clientHasPendingWrite(st))
 	{
 		setPollToWrite(fd); // ensure POLLOUT is set
 		return false;		// still flushing this response
 	}
 	clearPollout(fd);
+	noteRequestDone(fd, st);
 	if (st.forceCloseAfterWrite || st.closing)
 	{
 		handleClientDisconnect(fd);
 		return false;
 	}
 
-	st.forceCloseAfterWrite = false;
-	st.closing = false;
-	st.req = Request();
-	st.bodyBuffer.clear();
-	st.isChunked = false;
-	st.contentLength = 0;
-	st.maxBodyAllowed = 0;
-	st.chunkDec = ChunkedDecoder();
-	st.isMultipart = false;
-	st.multipartInit = false;
-	st.multipartBoundary.clear();
-	st.mpState = ClientState::MP_START;
-	st.mp = MultipartStreamParser();
+	st.resetForNextRequest();
 	resetMultipartState(st);
 	setPhase(fd, st, ClientState::READING_HEADERS, "tryFlushWrite");
+	if (!st.recvBuffer.empty())
+		setPollToWrite(fd); // pipelined request waiting, see handleClientWrite
 	return true;
 }
 
@@ -1255,11 +1833,8 @@ bool SocketManager::clientRequestedClose(const Request &req) const
 	const bool is11 = (hv.size() >= 8 && hv.compare(0, 8, "HTTP/1.1") == 0);
 	const bool is10 = (hv.size() >= 8 && hv.compare(0, 8, "HTTP/1.0") == 0);
 
-	std::string connVal;
-	std::map<std::string, std::string>::const_iterator it =
-		req.headers.find("connection");
-	if (it != req.headers.end())
-		connVal = toLowerCopy(trimCopy(it->second)); // normalize value
+	std::string connVal =
+		toLowerCopy(req.headers.get(HeaderTable::CONNECTION)); // normalize value
 
 	size_t comma = connVal.find(',');
 	if (comma != std::string::npos)
@@ -1568,12 +2143,14 @@ void SocketManager::onPartEndThunk(void *user)
 void SocketManager::run()
 {
 	initPoll();
+	startCgiPools();
 
+	std::vector<ReadyEvent> events;
+	std::vector<unsigned int> generations;
 	while (!g_stop)
 	{
-		struct pollfd *pbase = m_pollfds.empty() ? NULL : &m_pollfds[0];
-		int rc = ::poll(pbase, static_cast<nfds_t>(m_pollfds.size()),
-						100); // changed from -1 to 100 for the time out
+		// 100ms instead of -1 so CGI timeouts are checked while idle
+		int rc = m_events->wait(events, 100);
 		if (rc < 0)
 		{
 			if (errno == EINTR)
@@ -1582,27 +2159,31 @@ void SocketManager::run()
 					break;
 				continue;
 			}
-			std::cerr << "poll() error: " << std::strerror(errno) << std::endl;
+			std::cerr << m_events->name() << " wait error: " << std::strerror(errno)
+					  << std::endl;
 			continue;
 		}
 		if (rc == 0)
 		{
 			checkCgiTimeouts();
+			superviseCgiWorkers();
+			freeRetiredClients();
 			continue;
 		}
 
-		std::vector<std::pair<int, short>> events;
-		events.reserve(m_pollfds.size());
-		for (size_t i = 0; i < m_pollfds.size(); ++i)
-		{
-			if (m_pollfds[i].revents != 0)
-				events.push_back(std::make_pair(m_pollfds[i].fd, m_pollfds[i].revents));
-		}
-		// event driver
+		// Remember who each ready fd belonged to: a handler may close it and
+		// accept() may hand the number to a new connection in the same batch.
+		generations.resize(events.size());
+		for (size_t i = 0; i < events.size(); ++i)
+			generations[i] = slotFor(events[i].fd).generation;
+
+		// event driver: only ready fds are visited, idle ones cost nothing
 		for (size_t i = 0; i < events.size(); ++i)
 		{
-			int fd = events[i].first;
-			short revents = events[i].second;
+			int fd = events[i].fd;
+			short revents = events[i].revents;
+			if (m_slots[fd].generation != generations[i])
+				continue; // stale event, fd was closed/reused meanwhile
 
 			if (revents & POLLIN)
 			{
@@ -1614,6 +2195,10 @@ void SocketManager::run()
 				{
 					handleCgiReadable(fd);
 				}
+				else if (isFcgiConn(fd))
+				{
+					handleFcgiReadable(fd);
+				}
 				else
 				{
 					handleClientRead(fd);
@@ -1625,6 +2210,10 @@ void SocketManager::run()
 				{
 					handleCgiWritable(fd);
 				}
+				else if (isFcgiConn(fd))
+				{
+					handleFcgiWritable(fd);
+				}
 				else
 				{
 					handleClientWrite(fd);
@@ -1636,6 +2225,11 @@ void SocketManager::run()
 				{
 					handleCgiPipeError(fd);
 				}
+				else if (isFcgiConn(fd))
+				{
+					if (!(revents & POLLIN))
+						handleFcgiError(fd);
+				}
 				else
 				{
 					handleClientDisconnect(fd);
@@ -1643,5 +2237,20 @@ void SocketManager::run()
 			}
 		}
 		checkCgiTimeouts();
+		superviseCgiWorkers();
+		freeRetiredClients();
 	}
+
+	const ContentCache::Stats &cs = m_contentCache.stats();
+	std::cerr << "[content-cache] hits=" << cs.hits << " misses=" << cs.misses
+			  << " evictions=" << cs.evictions << " entries=" << cs.entries
+			  << " bytes=" << cs.bytes << std::endl;
+	std::cerr << "[io] requests=" << m_io.requests
+			  << " recv_calls=" << m_io.recvCalls
+			  << " send_calls=" << m_io.sendCalls;
+	if (m_io.requests)
+		std::cerr << " per_request=" << (m_io.recvCalls + m_io.sendCalls) / m_io.requests;
+	if (m_io.requests && allocStatsEnabled())
+		std::cerr << " allocs_per_request=" << m_io.allocs / m_io.requests;
+	std::cerr << std::endl;
 }
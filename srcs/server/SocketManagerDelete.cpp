@@ -69,6 +69,7 @@ void SocketManager::handleDelete(int fd,
 	// Attempt remove
 	if (std::remove(fullPath.c_str()) == 0)
 	{
+		m_fileCache.invalidate(fullPath);
 		Response res;
 		res.status_code = 204;
 		res.status_message = "No Content";
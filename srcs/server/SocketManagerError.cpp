@@ -55,10 +55,19 @@ Response SocketManager::makeConfigErrorResponse(const ServerConfig &server,
 	std::string fullPath = root + "/" + uri;
 
 	//if file missing ->fallback makeHtmlError
-	if (!fileExists(fullPath))
+	// we read file (through the caches, no disk access per error) and build Res
+	// The key can't clash with a static path: error responses get their own
+	// headers (Allow...), only the body is shared.
+	const std::string key = std::string(1, '\0') + fullPath;
+	FileInfo info = m_fileCache.lookup(fullPath);
+	std::string html;
+	const ContentCache::Entry *hit = m_contentCache.find(key, info);
+	if (hit)
+		html = hit->body;
+	else if (!m_fileCache.readAll(fullPath, html))
 		return makeHtmlError(code, reason, fallbackHtml);
-	// we read file and build Res
-	std::string html = readFile(fullPath);
+	else
+		m_contentCache.store(key, info, std::string(), html);
 	if (html.empty())
 		html = fallbackHtml;
 	Response r;
@@ -0,0 +1,316 @@
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "FastCgi.hpp"
+#include "SocketManager.hpp"
+
+#ifdef MSG_NOSIGNAL
+# define FCGI_SEND_FLAGS MSG_NOSIGNAL
+#else
+# define FCGI_SEND_FLAGS 0
+#endif
+
+// A connection carries one request at a time, so every request is id 1.
+static const unsigned FCGI_REQUEST_ID = 1;
+static const size_t FCGI_READ_MAX = 64 << 10;
+static const size_t FCGI_STDIN_CHUNK = 32 << 10; // per STDIN record, 8-aligned
+static const size_t FCGI_IDLE_MAX = 16;          // kept open per address
+
+FcgiConn::FcgiConn(const std::string &addr)
+	: address(addr), client(-1), stdinDone(false), ended(false), pool(-1),
+	  worker(0)
+{
+	return;
+}
+
+bool SocketManager::isFcgiConn(int fd) const
+{
+	return fd >= 0 && static_cast<size_t>(fd) < m_slots.size() &&
+		   m_slots[fd].kind == FdSlot::FCGI;
+}
+
+// An idle pooled connection to `address`, else a new one; -1 if the
+// application can't be reached. A unix stream socket connects (or fails,
+// EAGAIN when its backlog is full) right away, there is no in-progress state.
+int SocketManager::acquireFcgiConn(const std::string &address)
+{
+	std::map<std::string, std::vector<int> >::iterator it = m_fcgiIdle.find(address);
+	if (it != m_fcgiIdle.end() && !it->second.empty())
+	{
+		const int fd = it->second.back();
+		it->second.pop_back();
+		return fd;
+	}
+
+	struct sockaddr_un sa;
+	std::memset(&sa, 0, sizeof(sa));
+	sa.sun_family = AF_UNIX;
+	if (address.size() >= sizeof(sa.sun_path))
+		return -1;
+	std::memcpy(sa.sun_path, address.c_str(), address.size() + 1);
+
+	const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+		return -1;
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	if (::connect(fd, reinterpret_cast<struct sockaddr *>(&sa), sizeof(sa)) != 0)
+	{
+		::close(fd);
+		return -1;
+	}
+	return adoptFcgiConn(fd, address);
+}
+
+// A connected, non-blocking socket to a FastCGI peer becomes an FCGI slot.
+int SocketManager::adoptFcgiConn(int fd, const std::string &address)
+{
+	FdSlot &slot = slotFor(fd);
+	slot.kind = FdSlot::FCGI;
+	slot.owner = -1;
+	++slot.generation;
+	if (m_fcgiConns.size() <= static_cast<size_t>(fd))
+		m_fcgiConns.resize(static_cast<size_t>(fd) + 1, NULL);
+	m_fcgiConns[fd] = new FcgiConn(address);
+	addPollFd(fd, POLLIN);
+	std::cerr << "[fastcgi] connected to " << address << " (fd " << fd << ")"
+			  << std::endl;
+	return fd;
+}
+
+// Send the request (BEGIN_REQUEST, PARAMS) on an idle connection; the body
+// follows as STDIN records from st.cgi.inBuf as the socket takes them, and
+// STDOUT comes back into st.cgi.outBuf, so drainCgiOutput() treats it like
+// a child's pipe.
+void SocketManager::startFastCgi(int fd, ClientState &st, int connFd,
+								 char *const *envp)
+{
+	FcgiConn &c = *m_fcgiConns[connFd];
+	c.client = fd;
+	c.in.clear();
+	c.out.clear();
+	c.stdinDone = false;
+	c.ended = false;
+	m_slots[connFd].owner = fd;
+	++m_cgiPipes;
+
+	fcgiBeginRequest(c.out, FCGI_REQUEST_ID, true);
+	fcgiParams(c.out, FCGI_REQUEST_ID, envp);
+
+	st.cgi.fcgiConn = connFd;
+	st.cgi.fastcgi = true;
+	st.cgi.stdin_closed = false; // until the empty STDIN record is queued
+	modPollEvents(connFd, POLLIN | POLLOUT, 0);
+
+	std::cerr << "[fd " << fd << "] FastCGI dispatch : " << c.address
+			  << " conn=" << connFd << " script=" << st.cgi.scriptFsPath
+			  << std::endl;
+}
+
+// The request on connFd ended cleanly: back to the idle list (or to its
+// cgi_workers pool), unless bytes are left over on either side or the idle
+// list for that address is full.
+void SocketManager::releaseFcgiConn(int connFd)
+{
+	FcgiConn &c = *m_fcgiConns[connFd];
+	ClientState *st = findClient(c.client);
+	if (st && st->cgi.fcgiConn == connFd)
+		st->cgi.fcgiConn = -1;
+	c.client = -1;
+	m_slots[connFd].owner = -1;
+	--m_cgiPipes;
+
+	if (!c.in.empty() || !c.out.empty())
+	{
+		closeFcgiConn(connFd);
+		return;
+	}
+	modPollEvents(connFd, POLLIN, POLLOUT); // POLLIN again if it was paused
+	if (c.pool != -1)
+	{
+		cgiWorkerIdle(connFd);
+		return;
+	}
+	std::vector<int> &idle = m_fcgiIdle[c.address];
+	if (idle.size() >= FCGI_IDLE_MAX)
+	{
+		closeFcgiConn(connFd);
+		return;
+	}
+	idle.push_back(connFd);
+}
+
+void SocketManager::closeFcgiConn(int connFd)
+{
+	FcgiConn *c = m_fcgiConns[connFd];
+	if (c->client != -1)
+	{
+		ClientState *st = findClient(c->client);
+		if (st && st->cgi.fcgiConn == connFd)
+			st->cgi.fcgiConn = -1;
+		--m_cgiPipes;
+	}
+	else if (c->pool == -1)
+	{
+		std::vector<int> &idle = m_fcgiIdle[c->address];
+		for (size_t i = 0; i < idle.size(); ++i)
+		{
+			if (idle[i] != connFd)
+				continue;
+			idle[i] = idle.back();
+			idle.pop_back();
+			break;
+		}
+	}
+	if (c->pool != -1)
+		cgiWorkerGone(connFd);
+	delPollFd(connFd);
+	::close(connFd);
+	FdSlot &slot = m_slots[connFd];
+	slot.kind = FdSlot::FREE;
+	slot.owner = -1;
+	delete c;
+	m_fcgiConns[connFd] = NULL;
+}
+
+// Client gone or the response given up on: a connection still mid-request
+// can't be reused (the application may keep writing), so it is closed.
+void SocketManager::releaseFastCgi(ClientState &st)
+{
+	if (st.cgi.fcgiConn != -1)
+		closeFcgiConn(st.cgi.fcgiConn);
+	st.cgi.fastcgi = false;
+	st.cgi.stdin_closed = true;
+}
+
+void SocketManager::handleFcgiReadable(int connFd)
+{
+	FcgiConn &c = *m_fcgiConns[connFd];
+
+	size_t room = FCGI_READ_MAX;
+	if (m_config.io_budget_bytes && room > m_config.io_budget_bytes)
+		room = m_config.io_budget_bytes;
+	const ssize_t n = ::read(connFd, c.in.prepare(room), room);
+	const int clientFd = c.client;
+	if (n <= 0)
+	{
+		// the application closed (or broke) the connection: for a request
+		// in flight that is the end of its output, like EOF on a pipe
+		closeFcgiConn(connFd);
+		if (clientFd != -1)
+			drainCgiOutput(clientFd);
+		return;
+	}
+	c.in.commit(static_cast<size_t>(n));
+
+	FcgiRecord rec;
+	size_t len;
+	ClientState *st = findClient(clientFd);
+	if (!st)
+	{
+		// idle: only a pool worker answering its health probe is expected
+		bool unasked = c.pool == -1;
+		while (!unasked && (len = fcgiNextRecord(c.in.data(), c.in.size(), rec)) != 0)
+		{
+			unasked = rec.type != FCGI_GET_VALUES_RESULT;
+			if (!unasked)
+				cgiWorkerAnswered(c);
+			c.in.consume(len);
+		}
+		if (unasked)
+			closeFcgiConn(connFd);
+		return;
+	}
+
+	while (!c.ended && (len = fcgiNextRecord(c.in.data(), c.in.size(), rec)) != 0)
+	{
+		if (rec.type == FCGI_GET_VALUES_RESULT && c.pool != -1)
+			cgiWorkerAnswered(c); // a probe sent just before this request
+		else if (rec.requestId == FCGI_REQUEST_ID)
+		{
+			if (rec.type == FCGI_STDOUT)
+				st->cgi.outBuf.append(rec.content, rec.length);
+			else if (rec.type == FCGI_STDERR)
+				std::cerr.write(rec.content, static_cast<std::streamsize>(rec.length));
+			else if (rec.type == FCGI_END_REQUEST)
+			{
+				unsigned long appStatus = 0;
+				int protocolStatus = FCGI_REQUEST_COMPLETE;
+				fcgiEndRequest(rec, appStatus, protocolStatus);
+				if (protocolStatus != FCGI_REQUEST_COMPLETE || appStatus != 0)
+					std::cerr << "[fd " << clientFd << "] FastCGI request ended: app status "
+							  << appStatus << ", protocol status " << protocolStatus
+							  << std::endl;
+				c.ended = true;
+			}
+		}
+		c.in.consume(len);
+	}
+	const bool ended = c.ended;
+
+	drainCgiOutput(clientFd); // parse headers / push body / enforce caps
+
+	// The end comes as a second step, like EOF on a pipe after its last
+	// bytes: the output above was handled while the request was still open.
+	// The drain may have dropped the connection (an error response).
+	if (ended && m_fcgiConns[connFd] && m_fcgiConns[connFd]->client == clientFd)
+	{
+		releaseFcgiConn(connFd);
+		drainCgiOutput(clientFd);
+	}
+}
+
+void SocketManager::handleFcgiWritable(int connFd)
+{
+	FcgiConn &c = *m_fcgiConns[connFd];
+	ClientState *st = findClient(c.client);
+	if (!st && c.out.empty())
+	{
+		modPollEvents(connFd, 0, POLLOUT);
+		return;
+	}
+
+	// stdin feed: the next STDIN record once the previous bytes are out, the
+	// empty one when the body is used up (idle: a pool health probe is out)
+	if (st && c.out.empty() && !c.stdinDone)
+	{
+		size_t n = st->cgi.inBuf.size();
+		if (n > FCGI_STDIN_CHUNK)
+			n = FCGI_STDIN_CHUNK;
+		fcgiStdin(c.out, FCGI_REQUEST_ID, st->cgi.inBuf.data(), n);
+		st->cgi.inBuf.consume(n);
+		st->cgi.bytesInTotal += n;
+		if (n == 0)
+		{
+			c.stdinDone = true;
+			st->cgi.stdin_closed = true;
+		}
+	}
+
+	const ssize_t n = ::send(connFd, c.out.data(), c.out.size(), FCGI_SEND_FLAGS);
+	if (n <= 0)
+	{
+		const int clientFd = c.client;
+		closeFcgiConn(connFd);
+		if (clientFd != -1)
+			drainCgiOutput(clientFd);
+		return;
+	}
+	c.out.consume(static_cast<size_t>(n));
+	if (c.out.empty() && (c.stdinDone || !st))
+		modPollEvents(connFd, 0, POLLOUT);
+}
+
+// Hang-up without POLLIN (run() leaves readable ones to the read, which sees
+// the rest of the output before the EOF). A request in flight still gets
+// that read, paused or not; an idle connection is just dropped.
+void SocketManager::handleFcgiError(int connFd)
+{
+	if (m_fcgiConns[connFd]->client != -1)
+		handleFcgiReadable(connFd);
+	else
+		closeFcgiConn(connFd);
+}
@@ -1,3 +1,4 @@
+#include <cctype>
 #include <iostream>
 
 #include "Chunked.hpp"
@@ -62,39 +63,21 @@ static void toLowerInPlace(std::string &s)
 	}
 }
 
-static bool isTokenChar(char c)
-{
-	return ( (c >= 'A' && c <= 'Z')
-		|| (c >= 'a' && c <= 'z')
-		|| (c >= '0' && c <= '9')
-		|| (c == '-') );
-}
-
-static bool isValidHeaderName(const std::string &name)
-{
-	if (name.empty())
-		return false;
-	for (size_t i = 0; i < name.size(); ++i)
-	{
-		if (!isTokenChar(name[i]))
-			return false;
-	}
-	return true;
-}
-
+// Only the bytes that arrived since the last call are searched (see
+// findHeaderEnd), st.hdrScanPos remembers where that was.
 static bool findHeaderBoundary(ClientState &st, size_t &hdrEndPos)
 {
-	hdrEndPos = st.recvBuffer.find("\r\n\r\n");
-	if (hdrEndPos == std::string::npos)
-		return true;
-	hdrEndPos += 4;
-	return false;
+	if (st.hdrScanPos > st.recvBuffer.size())
+		st.hdrScanPos = 0; // buffer was cut under us, start over
+	hdrEndPos = findHeaderEnd(st.recvBuffer.data(), st.recvBuffer.size(),
+							  st.hdrScanPos);
+	return hdrEndPos == std::string::npos;
 }
 
+static const size_t HEADER_CAP = 32 * 1024;
+
 bool SocketManager::checkHeaderLimits(int fd, ClientState &st, size_t &hdrEndPos)
 {
-	const size_t HEADER_CAP = 32 * 1024;
-
 	if (hdrEndPos > HEADER_CAP)
 	{
 		Response err = makeHtmlError(431, "Request Header Fields Too Larger", "<h1>431 Request Header Fields Too Larger</h1>");
@@ -161,11 +144,7 @@ bool SocketManager::detectMultipartBoundary(int fd, ClientState &st)
 		st.multipartBoundary.clear();
 		st.multipartInit = false;
 
-		std::map<std::string, std::string>::const_iterator it = st.req.headers.find("content-type");
-		if (it == st.req.headers.end())
-				return true;
-
-		const std::string raw = it->second;
+		const std::string raw = st.req.headers.get(HeaderTable::CONTENT_TYPE);
 		if (raw.empty())
 				return true;
 
@@ -265,94 +244,62 @@ static bool parseSizeT(const std::string &s, size_t &out)
 
 bool SocketManager::parseRawHeadersIntoRequest(int fd, ClientState &st, size_t hdrEndPos)
 {
-	// we extract just the header
-	if (hdrEndPos > st.recvBuffer.size())
-		hdrEndPos = st.recvBuffer.size();
-	
-	std::string block = st.recvBuffer.substr(0, hdrEndPos);
+	// the header block moves into the request as is, recvBuffer keeps the
+	// body/pipelined bytes
+	st.req.headers.adopt(st.recvBuffer.data(), hdrEndPos);
+	st.recvBuffer.consume(hdrEndPos);
+	const std::string &block = st.req.headers.raw();
+	// until Host is known (and for a 400 before that), the listener's default
+	const VirtualHosts &vhosts = m_vhosts[m_slots[fd].listener];
+	m_slots[fd].serverIndex = vhosts.defaultServer();
+
 	// we split start line up to \r\n\r\n
 	size_t lineEnd = block.find("\r\n");
 	if (lineEnd == std::string::npos)
 		return badRequestAndQueue(fd, st);
-	std::string startLine = block.substr(0, lineEnd);
 
 	// Split into exactly 3 space-separated tokens
-	size_t sp1 = startLine.find(' ');
-	if (sp1 == std::string::npos)
+	size_t sp1 = block.find(' ');
+	if (sp1 == std::string::npos || sp1 > lineEnd)
 		return badRequestAndQueue(fd, st);
 
-	size_t sp2 = startLine.find(' ', sp1 + 1);
-	if (sp2 == std::string::npos)
+	size_t sp2 = block.find(' ', sp1 + 1);
+	if (sp2 == std::string::npos || sp2 > lineEnd)
 		return badRequestAndQueue(fd, st);
 
 	// Ensure there isn't a 4th token (reject extra spaces/tokens)
-	if (startLine.find(' ', sp2 + 1) != std::string::npos)
+	size_t sp3 = block.find(' ', sp2 + 1);
+	if (sp3 != std::string::npos && sp3 < lineEnd)
 		return badRequestAndQueue(fd, st);
 
-	std::string method = startLine.substr(0, sp1);
-	std::string target = startLine.substr(sp1 + 1, sp2 - (sp1 + 1));
-	std::string version = startLine.substr(sp2 + 1);
-
-	if (method.empty() || target.empty() || version.empty())
+	if (sp1 == 0 || sp2 == sp1 + 1 || lineEnd == sp2 + 1)
 		return badRequestAndQueue(fd, st);
 
 	// Accept only HTTP/1.0 or HTTP/1.1 here (keep it simple)
-	if (!(version == "HTTP/1.1" || version == "HTTP/1.0"))
+	if (block.compare(sp2 + 1, lineEnd - sp2 - 1, "HTTP/1.1") != 0 &&
+		block.compare(sp2 + 1, lineEnd - sp2 - 1, "HTTP/1.0") != 0)
 		return badRequestAndQueue(fd, st);
 
-	// Store into st.req (adjust field names to your Request type)
-	st.req.method = toUpperCopy(method);
-	st.req.path = target;      // or st.req.uri
-	st.req.http_version = version;
-	std::cerr << "[fd " << fd << "] parsed request line + headers: "
-		  << st.req.method << " " << st.req.path << " " << st.req.http_version
-		  << " (hdrs=" << st.req.headers.size() << ")\n";
-
-
-	// 2) Header fields
-	size_t pos = lineEnd + 2; // skip CRLF after start-line
-	while (pos < block.size())
-	{
-		// End of headers: the blank line before CRLFCRLF
-		if (block.compare(pos, 2, "\r\n") == 0)
-			break;
-
-		size_t nl = block.find("\r\n", pos);
-		if (nl == std::string::npos)
-			return badRequestAndQueue(fd, st);
-
-		std::string line = block.substr(pos, nl - pos);
-		pos = nl + 2;
-
-		// No obs-fold: reject lines starting with SP/HTAB
-		if (!line.empty() && (line[0] == ' ' || line[0] == '\t'))
-			return badRequestAndQueue(fd, st);
-
-		// Split at first ':'
-		size_t colon = line.find(':');
-		if (colon == std::string::npos)
-			return badRequestAndQueue(fd, st);
-
-		std::string name = line.substr(0, colon);
-		std::string value = line.substr(colon + 1);
-
-		trim(name);
-		if (!isValidHeaderName(name))
-			return badRequestAndQueue(fd, st);
-
-		trim(value); // OWS allowed around the field-value
+	// Store into st.req
+	st.req.method.assign(block, 0, sp1);
+	for (size_t i = 0; i < st.req.method.size(); ++i)
+		st.req.method[i] = static_cast<char>(std::toupper(static_cast<unsigned char>(st.req.method[i])));
+	st.req.path.assign(block, sp1 + 1, sp2 - (sp1 + 1));
+	st.req.http_version.assign(block, sp2 + 1, lineEnd - sp2 - 1);
 
-		// Normalize header name to lowercase for case-insensitive map
-		toLowerInPlace(name);
+	// 2) Header fields: one pass, slices only; a repeated Host is a 400
+	if (st.req.headers.parse(lineEnd + 2) != HeaderTable::PARSE_OK)
+		return badRequestAndQueue(fd, st);
 
-		// Append duplicates with comma-join (simple behavior)
-		std::string &slot = st.req.headers[name];
-		if (!slot.empty())
-			slot.append(",").append(value);
-		else
-			slot = value;
-	}
+	// 3) Name-based virtual host: one hash lookup on the Host slice
+	const HeaderTable::Field *host = st.req.headers.first(HeaderTable::HOST);
+	if (host)
+		m_slots[fd].serverIndex = vhosts.resolve(block.data() + host->valueOff,
+												 host->valueLen);
 
+	std::cerr << "[fd " << fd << "] parsed request line + headers: "
+		  << st.req.method << " " << st.req.path << " " << st.req.http_version
+		  << " (hdrs=" << st.req.headers.size() << ")\n";
 	return true;
 
 }
@@ -360,8 +307,8 @@ bool SocketManager::parseRawHeadersIntoRequest(int fd, ClientState &st, size_t h
 bool SocketManager::applyRoutePolicyAfterHeaders(int fd, ClientState &st)
 {
 	// 1)we grab the active server and the matching route
-	const ServerConfig &server = m_serversConfig[m_clientToServerIndex[fd]];
-	const RouteConfig  *route  = findMatchingLocation(server, st.req.path);
+	const ServerConfig &server = findServerForClient(fd);
+	const RouteConfig  *route  = routeFor(fd, st);
 	// 2) Resovlve max body allowance 
 	{
 		size_t allowed = 0;
@@ -451,11 +398,11 @@ bool SocketManager::setupBodyFramingAndLimits(int fd, ClientState &st)
 
 	//fetch headers
 
-	std::map<std::string, std::string>::const_iterator itTE  = st.req.headers.find("transfer-encoding");
-	std::map<std::string, std::string>::const_iterator itCL  = st.req.headers.find("content-length");
+	const std::string te = st.req.headers.get(HeaderTable::TRANSFER_ENCODING);
+	const std::string clv = st.req.headers.get(HeaderTable::CONTENT_LENGTH);
 
-	const bool hasTE = (itTE != st.req.headers.end() && !itTE->second.empty());
-	const bool hasCL = (itCL != st.req.headers.end() && !itCL->second.empty());
+	const bool hasTE = !te.empty();
+	const bool hasCL = !clv.empty();
 
 	//1) has in previous iteration we check if both TE and CL present if so -> 400
 	if (hasTE && hasCL)
@@ -470,7 +417,7 @@ bool SocketManager::setupBodyFramingAndLimits(int fd, ClientState &st)
 	if (hasTE)
 	{
 		std::vector<std::string> tokens;
-		splitCsvLower(itTE->second, tokens);
+		splitCsvLower(te, tokens);
 
 		if (tokens.empty())
 		{
@@ -501,7 +448,7 @@ bool SocketManager::setupBodyFramingAndLimits(int fd, ClientState &st)
 	if (hasCL)
 	{
 		std::vector<std::string> vals;
-		splitCsvLower(itCL->second, vals);
+		splitCsvLower(clv, vals);
 		if (vals.size() != 1)
 		{
 			Response err = makeHtmlError(400, "Bad Request",
@@ -527,7 +474,7 @@ bool SocketManager::setupBodyFramingAndLimits(int fd, ClientState &st)
 		if (st.maxBodyAllowed > 0 && st.contentLength > st.maxBodyAllowed)
 		{
 			const ServerConfig &srv = findServerForClient(fd);
-			const RouteConfig *rt = st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+			const RouteConfig *rt = routeFor(fd, st);
 			Response err = makeConfigErrorResponse(
 								srv,
 								rt,
@@ -565,12 +512,10 @@ static const char* phaseToStr(ClientState::Phase p)
 
 // Headers are fully parsed; prepare for body phase or dispatch.
 
-void SocketManager::finalizeHeaderPhaseTransition (int fd, ClientState &st, size_t hdrEndPos)
+void SocketManager::finalizeHeaderPhaseTransition (int fd, ClientState &st)
 {
-	// 1) Drop the header block from the recv buffer (leave any coalesced body/pipelined data)
-	if (hdrEndPos > st.recvBuffer.size())
-		hdrEndPos = st.recvBuffer.size(); // defensive
-	st.recvBuffer.erase(0, hdrEndPos);
+	// 1) The header block already left the recv buffer (HeaderTable::adopt),
+	// what is left is coalesced body/pipelined data
 	// 2) Decide the next phase + optionally move already-received body bytes (CL case)
 	if (st.isChunked)
 	{
@@ -606,7 +551,7 @@ void SocketManager::finalizeHeaderPhaseTransition (int fd, ClientState &st, size
 		if (take > 0)
 		{
 			st.bodyBuffer.append(st.recvBuffer.data(), take);
-			st.recvBuffer.erase(0, take);
+			st.recvBuffer.consume(take);
 		}
 
 		// If we finished the body right away, we may already have pipelined data
@@ -644,7 +589,7 @@ bool SocketManager::doTheMultiPartThing(int fd, ClientState &st)
 	if (st.multipartBoundary.empty())
 	{
 		const ServerConfig &srv = findServerForClient(fd);
-		const RouteConfig *rt = st.req.path.empty() ? NULL : findMatchingLocation(srv, st.req.path);
+		const RouteConfig *rt = routeFor(fd, st);
 		Response err = makeConfigErrorResponse(
 				srv,
 				rt,
@@ -656,8 +601,8 @@ bool SocketManager::doTheMultiPartThing(int fd, ClientState &st)
 		return false;
 	}
 
-	const ServerConfig &server = m_serversConfig[m_clientToServerIndex[fd]];
-	const RouteConfig  *route  = findMatchingLocation(server, st.req.path);
+	const ServerConfig &server = findServerForClient(fd);
+	const RouteConfig  *route  = routeFor(fd, st);
 	if (!route || route->upload_path.empty())
 	{
 		Response err = makeConfigErrorResponse(
@@ -695,7 +640,16 @@ bool SocketManager::tryParseHeaders(int fd, ClientState &st)
 		  << " recv=" << st.recvBuffer.size()
 		  << " body=" << st.bodyBuffer.size() << std::endl;
 	if (findHeaderBoundary(st, hdrEndPos))
+	{
+		// No terminator yet. A merely oversized head is left to arrive in
+		// full (closing on a client that is still sending would reset the
+		// connection before it reads the 431), but an endless one is cut
+		// off instead of being buffered forever.
+		size_t seen = st.recvBuffer.size();
+		if (seen > 4 * HEADER_CAP)
+			return checkHeaderLimits(fd, st, seen);
 		return true;
+	}
 
 	// 2) limits
 	if (!checkHeaderLimits(fd, st, hdrEndPos))
@@ -707,8 +661,14 @@ bool SocketManager::tryParseHeaders(int fd, ClientState &st)
 
 	// header dump for debugging
 	std::cerr << "[fd " << fd << "] headers:";
-	for (std::map<std::string,std::string>::const_iterator it = st.req.headers.begin(); it != st.req.headers.end(); ++it)
-		std::cerr << " [" << it->first << ": " << it->second << "]" << std::endl;
+	for (size_t i = 0; i < st.req.headers.size(); ++i)
+	{
+		const HeaderTable::Field &f = st.req.headers.field(i);
+		const char *raw = st.req.headers.raw().data();
+		std::cerr << " [";
+		std::cerr.write(raw + f.nameOff, f.nameLen) << ": ";
+		std::cerr.write(raw + f.valueOff, f.valueLen) << "]" << std::endl;
+	}
 
 	if (!detectMultipartBoundary(fd, st))
 		return false;
@@ -729,7 +689,7 @@ bool SocketManager::tryParseHeaders(int fd, ClientState &st)
 			<< (st.isChunked?1:0) << " contentLength=" << st.contentLength << std::endl;
 
 	// 6) transition (only enter READING_BODY if we actually have framing)
-	finalizeHeaderPhaseTransition(fd, st, hdrEndPos);
+	finalizeHeaderPhaseTransition(fd, st);
 
 	return true;
 }
@@ -1,4 +1,5 @@
 #include <arpa/inet.h>
+#include <cctype>
 #include <csignal>
 #include <cstdlib>
 #include <cerrno>
@@ -9,6 +10,7 @@
 #include <map>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <set>
 #include <sstream>
 #include <sys/socket.h>
 #include <sys/stat.h>
@@ -23,22 +25,36 @@
 #include "file_utils.hpp"
 #include "utils.hpp"
 
-//uppercase text and change - to _
-static std::string httpKeyToCgiVar(const std::string &k)
+//uppercase text and change - to _, appended to `out`
+static void appendCgiVarName(std::string &out, const char *p, size_t n)
 {
-	std::string r;
-	r.reserve(k.size());
-	for (size_t i = 0; i < k.size(); ++i)
+	for (size_t i = 0; i < n; ++i)
 	{
-		unsigned char c = (unsigned char)k[i];
+		unsigned char c = (unsigned char)p[i];
 		if (c == '-')
-			r.push_back('_');
+			out.push_back('_');
 		else if (c >= 'a' && c <= 'z')
-			r.push_back((char)(c - 'a' + 'A'));
+			out.push_back((char)(c - 'a' + 'A'));
 		else 
-			r.push_back((char)c);
+			out.push_back((char)c);
 	}
-	return r;
+}
+
+// Fields i and j carry the same header name (case-insensitive).
+static bool sameHeaderName(const HeaderTable &h, size_t i, size_t j)
+{
+	const HeaderTable::Field &a = h.field(i);
+	const HeaderTable::Field &b = h.field(j);
+	if (a.id != HeaderTable::OTHER || b.id != HeaderTable::OTHER)
+		return a.id == b.id;
+	if (a.nameLen != b.nameLen)
+		return false;
+	const char *raw = h.raw().data();
+	for (size_t k = 0; k < a.nameLen; ++k)
+		if (std::tolower((unsigned char)raw[a.nameOff + k]) !=
+			std::tolower((unsigned char)raw[b.nameOff + k]))
+			return false;
+	return true;
 }
 
 
@@ -47,11 +63,11 @@ void SocketManager::splitPathAndQuery(const std::string &raw, std::string &urlPa
 	size_t q = raw.find('?');
 	if (q == std::string::npos) 
 	{
-		urlPath = raw; query.clear();
+		urlPath.assign(raw); query.clear();
 	}
 	else 
 	{ 
-		urlPath = raw.substr(0, q); query = raw.substr(q + 1);
+		urlPath.assign(raw, 0, q); query.assign(raw, q + 1, std::string::npos);
 	}
 }
 
@@ -533,31 +549,154 @@ static std::string makeUploadFileName(const std::string &hint)
 } */
 
 
+// CGI/1.1 meta-variables as the NULL-terminated array execve() wants, built
+// in the request's arena before fork() so the child only has to exec.
+// Relative to our working directory, which a FastCGI application (or a
+// cgi_workers interpreter) doesn't share.
+static void makeAbsolute(std::string &path)
+{
+	if (path.empty() || path[0] == '/')
+		return;
+	char cwd[PATH_MAX];
+	if (::getcwd(cwd, sizeof(cwd)))
+		path.insert(0, std::string(cwd) + "/");
+}
+
+static char **buildCgiEnv(ClientState &st, const ServerConfig &server,
+						  const RouteConfig &route, const std::string &urlPath,
+						  const std::string &query)
+{
+	Arena &a = st.arena;
+	const HeaderTable &h = st.req.headers;
+	const size_t maxVars = 16 + h.size() + route.cgi_pass_env.size();
+	char **envp = static_cast<char **>(a.alloc((maxVars + 1) * sizeof(char *)));
+	size_t n = 0;
+
+	// SERVER_NAME / SERVER_PORT from the config, Host: overrides them
+	std::string &serverName = a.str();
+	std::string &serverPort = a.str();
+	if (!server.server_name.empty())
+		serverName = server.server_name;
+	else if (!server.host.empty())
+		serverName = server.host;
+	else
+		serverName = "localhost";
+	serverPort = to_string(server.port);
+	if (h.has(HeaderTable::HOST))
+	{
+		const std::string host = h.get(HeaderTable::HOST); // OWS already trimmed
+		size_t c = host.rfind(':');
+		if (c != std::string::npos)
+		{
+			serverName.assign(host, 0, c);
+			serverPort.assign(host, c + 1, std::string::npos);
+		}
+		else
+			serverName = host;
+	}
+
+	// Core vars
+	envp[n++] = a.concat("GATEWAY_INTERFACE=", "CGI/1.1");
+	envp[n++] = a.concat("REQUEST_METHOD=", st.req.method);
+	envp[n++] = a.concat("SERVER_PROTOCOL=", st.req.http_version);
+	envp[n++] = a.concat("SERVER_SOFTWARE=", "webserv/0.1");
+	envp[n++] = a.concat("SERVER_NAME=", serverName);
+	envp[n++] = a.concat("SERVER_PORT=", serverPort);
+
+	// SCRIPT fields
+	envp[n++] = a.concat("SCRIPT_FILENAME=", st.cgi.scriptFsPath);
+	std::string &scriptUrlPath = a.str();
+	std::string &pathInfo = a.str();
+	splitScriptAndPathInfo(urlPath, route.cgi_extension, scriptUrlPath, pathInfo);
+	envp[n++] = a.concat("SCRIPT_NAME=", makeScriptName(route.path, scriptUrlPath));
+	if (!pathInfo.empty())
+		envp[n++] = a.concat("PATH_INFO=", pathInfo);
+
+	// REQUEST_URI & QUERY_STRING
+	std::string &uri = a.str();
+	uri = urlPath;
+	if (!query.empty())
+		uri.append(1, '?').append(query);
+	envp[n++] = a.concat("REQUEST_URI=", uri);
+	envp[n++] = a.concat("QUERY_STRING=", query);
+
+	// Document root
+	const std::string &docroot = !route.root.empty() ? route.root : server.root;
+	if (!docroot.empty())
+		envp[n++] = a.concat("DOCUMENT_ROOT=", docroot);
+
+	if (!st.cgi.inBuf.empty())
+		envp[n++] = a.concat("CONTENT_LENGTH=", to_string(st.cgi.inBuf.size()));
+	if (h.has(HeaderTable::CONTENT_TYPE))
+		envp[n++] = a.concat("CONTENT_TYPE=", h.get(HeaderTable::CONTENT_TYPE));
+
+	// HTTP_*: repeats go out once, comma-joined, read straight off the head
+	const char *raw = h.raw().data();
+	for (size_t i = 0; i < h.size(); ++i)
+	{
+		const HeaderTable::Field &f = h.field(i);
+		if (f.id == HeaderTable::CONTENT_TYPE || f.id == HeaderTable::CONTENT_LENGTH)
+			continue;
+		bool seen = false;
+		for (size_t j = 0; j < i && !seen; ++j)
+			seen = sameHeaderName(h, j, i);
+		if (seen)
+			continue;
+		std::string &var = a.str();
+		var = "HTTP_";
+		appendCgiVarName(var, raw + f.nameOff, f.nameLen);
+		var += '=';
+		var.append(raw + f.valueOff, f.valueLen);
+		for (size_t j = i + 1; j < h.size(); ++j)
+		{
+			if (!sameHeaderName(h, i, j))
+				continue;
+			var += ',';
+			var.append(raw + h.field(j).valueOff, h.field(j).valueLen);
+		}
+		envp[n++] = a.dup(var);
+	}
+
+	for (size_t i = 0; i < route.cgi_pass_env.size(); ++i)
+	{
+		const std::string &key = route.cgi_pass_env[i];
+		const char *v = std::getenv(key.c_str());
+		if (!v || !*v)
+			continue;
+		std::string &var = a.str();
+		var = key;
+		var.append(1, '=').append(v);
+		envp[n++] = a.dup(var);
+	}
+	envp[n] = NULL;
+	return envp;
+}
+
 void SocketManager::startCgiDispatch(int fd,
 									 ClientState &st,
 									 const ServerConfig &server,
 									 const RouteConfig &route)
 {
 	// fix for string query:
-	std::string urlPath;
-	std::string query;
+	std::string &urlPath = st.arena.str();
+	std::string &query = st.arena.str();
 	splitPathAndQuery(st.req.path, urlPath, query);
 
 	// Decide working directory: prefer cgi_path, else route.root, else server.root
-	std::string workingDir = !route.cgi_path.empty() ? route.cgi_path
-						  : (!route.root.empty()     ? route.root : server.root);
+	const std::string &workingDir = !route.cgi_path.empty() ? route.cgi_path
+								 : (!route.root.empty()     ? route.root : server.root);
 
 	// URL part after the location prefix (e.g. /cgi-bin/debug.py -> "debug.py")
 	const std::string rel = stripLocationPrefix(urlPath, route.path);
 
 	// Fill CGI state
 	st.cgi.reset();
+	st.cgi.route        = &route;
 	st.cgi.workingDir   = workingDir;
 
 	st.cgi.scriptFsPath = rel;
 
-	std::string interpreterPath;
-	bool hasInterpreter = false;
+	const std::string *interpreterPath = NULL;
 	{
 		std::string ext;
 		size_t dot = st.cgi.scriptFsPath.rfind('.');
@@ -568,14 +707,11 @@ void SocketManager::startCgiDispatch(int fd,
 			route.cgi_extension.find(ext);
 
 		if (itInterp != route.cgi_extension.end() && !itInterp->second.empty())
-		{
-			hasInterpreter = true;
-			interpreterPath = itInterp->second;
-		}
+			interpreterPath = &itInterp->second;
 	}
 
 	// Move decoded request body to CGI stdin buffer
-	st.cgi.inBuf.swap(st.bodyBuffer);
+	st.cgi.inBuf.assignSwap(st.bodyBuffer);
 	st.cgi.tStartMs      = now_ms();
 	st.cgi.stdin_w       = -1;
 	st.cgi.stdout_r      = -1;
@@ -597,7 +733,8 @@ void SocketManager::startCgiDispatch(int fd,
 
 	// Full path from the server's point of view:
 	//   workingDir + "/" + scriptFsPath (relative to workingDir)
-	std::string fullScriptPath = joinPaths(workingDir, st.cgi.scriptFsPath);
+	std::string &fullScriptPath = st.arena.str();
+	joinPaths(fullScriptPath, workingDir, st.cgi.scriptFsPath);
 
 	// Security: ensure script stays inside workingDir (no "../" escape)
 	if (!isPathSafe(workingDir, fullScriptPath))
@@ -611,6 +748,27 @@ void SocketManager::startCgiDispatch(int fd,
 		return;
 	}
 
+	// FastCGI: the application finds (or routes) the script itself, and its
+	// working directory isn't ours, so SCRIPT_FILENAME goes out absolute
+	if (!route.fastcgi_pass.empty())
+	{
+		const int connFd = acquireFcgiConn(route.fastcgi_pass);
+		if (connFd < 0)
+		{
+			Response err = makeConfigErrorResponse(server,
+												   &route,
+												   502,
+												   "Bad Gateway",
+												   "<h1>502 Bad Gateway</h1><p>FastCGI application unavailable.</p>");
+			finalizeAndQueue(fd, st.req, err, false, true);
+			return;
+		}
+		makeAbsolute(fullScriptPath);
+		st.cgi.scriptFsPath = fullScriptPath;
+		startFastCgi(fd, st, connFd, buildCgiEnv(st, server, route, urlPath, query));
+		return;
+	}
+
 	// Check that the script exists, is a regular file and readable
 	struct stat sb;
 	if (::stat(fullScriptPath.c_str(), &sb) != 0)
@@ -658,12 +816,26 @@ void SocketManager::startCgiDispatch(int fd,
 		return;
 	}
 
-	if (hasInterpreter)
+	// cgi_workers: an idle pre-forked interpreter runs it, same as above;
+	// with every worker busy (or restarting) it is forked the classic way
+	if (route.cgi_workers)
+	{
+		const int connFd = acquireCgiWorker(route);
+		if (connFd >= 0)
+		{
+			makeAbsolute(fullScriptPath);
+			st.cgi.scriptFsPath = fullScriptPath;
+			startFastCgi(fd, st, connFd, buildCgiEnv(st, server, route, urlPath, query));
+			return;
+		}
+	}
+
+	if (interpreterPath)
 	{
 		struct stat ist;
-		if (::stat(interpreterPath.c_str(), &ist) != 0
+		if (::stat(interpreterPath->c_str(), &ist) != 0
 			|| !S_ISREG(ist.st_mode)
-			|| ::access(interpreterPath.c_str(), X_OK) != 0)
+			|| ::access(interpreterPath->c_str(), X_OK) != 0)
 		{
 			Response res = makeConfigErrorResponse(server,
 												   &route,
@@ -689,6 +861,17 @@ void SocketManager::startCgiDispatch(int fd,
 		}
 	}
 
+	// argv and env before fork(), in the arena
+	char **argv = static_cast<char **>(st.arena.alloc(3 * sizeof(char *)));
+	{
+		size_t argc = 0;
+		if (interpreterPath)
+			argv[argc++] = st.arena.dup(*interpreterPath);
+		argv[argc++] = st.arena.dup(st.cgi.scriptFsPath);
+		argv[argc] = NULL;
+	}
+	char **envp = buildCgiEnv(st, server, route, urlPath, query);
+
 	// we do the pipex thingy here
 	int inPipe[2], outPipe[2];
 	if (::pipe(inPipe) < 0 || ::pipe(outPipe) < 0)
@@ -736,9 +919,11 @@ void SocketManager::startCgiDispatch(int fd,
 		::close(inPipe[1]);
 		::close(outPipe[0]);
 
-		for (size_t i = 0; i < m_pollfds.size(); ++i)
+		std::vector<int> inherited;
+		m_events->watchedFds(inherited);
+		for (size_t i = 0; i < inherited.size(); ++i)
 		{
-			int cfd = m_pollfds[i].fd;
+			int cfd = inherited[i];
 			if (cfd > 2)
 				::close(cfd);
 		}
@@ -747,137 +932,8 @@ void SocketManager::startCgiDispatch(int fd,
 		if (!st.cgi.workingDir.empty())
 			::chdir(st.cgi.workingDir.c_str());
 
-		// build argv
-		std::vector<char*> argv;
-		{
-			if (hasInterpreter)
-			{
-				argv.push_back(const_cast<char*>(interpreterPath.c_str()));
-				argv.push_back(const_cast<char*>(st.cgi.scriptFsPath.c_str()));
-			}
-			else
-			{
-				argv.push_back(const_cast<char*>(st.cgi.scriptFsPath.c_str()));
-			}
-			argv.push_back(NULL);
-		}
-
-		// build env
-		std::vector<std::string> env;
-		env.reserve(64);
-
-		// 1) URL parts
-		std::string urlPath2, query2;
-		splitPathAndQuery(st.req.path, urlPath2, query2);
-
-		std::string hostHeader;
-		{
-			std::map<std::string,std::string>::const_iterator itH =
-				st.req.headers.find("host");
-			if (itH != st.req.headers.end())
-				hostHeader = itH->second;
-		}
-
-		// Compute SERVER_NAME and SERVER_PORT without getSocketAddrs()
-		std::string serverName;
-		if (!server.server_name.empty())
-			serverName = server.server_name;
-		else if (!server.host.empty())
-			serverName = server.host;
-		else
-			serverName = "localhost";
-
-		std::ostringstream portOss;
-		portOss << server.port;
-		std::string serverPortStr = portOss.str();
-
-		// If Host: header present, override SERVER_NAME / SERVER_PORT
-		if (!hostHeader.empty())
-		{
-			std::string h = hostHeader;
-
-			while (!h.empty() && (h[0] == ' ' || h[0] == '\t'))
-				h.erase(0, 1);
-			while (!h.empty() && (h[h.size() - 1] == ' ' || h[h.size() - 1] == '\t'))
-				h.erase(h.size() - 1);
-
-			size_t c = h.rfind(':');
-			if (c != std::string::npos)
-			{
-				serverName    = h.substr(0, c);
-				serverPortStr = h.substr(c + 1);
-			}
-			else
-				serverName = h;
-		}
-
-		// 2) Core vars
-		env.push_back("GATEWAY_INTERFACE=CGI/1.1");
-		env.push_back("REQUEST_METHOD="  + st.req.method);
-		env.push_back("SERVER_PROTOCOL=" + st.req.http_version);
-		env.push_back("SERVER_SOFTWARE=webserv/0.1");
-		env.push_back("SERVER_NAME="     + serverName);
-		env.push_back("SERVER_PORT="     + serverPortStr);
-
-		// SCRIPT fields
-		env.push_back("SCRIPT_FILENAME=" + st.cgi.scriptFsPath);
-		std::string scriptUrlPath, pathInfo;
-		splitScriptAndPathInfo(urlPath2, route.cgi_extension, scriptUrlPath, pathInfo);
-
-		env.push_back("SCRIPT_NAME=" + makeScriptName(route.path, scriptUrlPath));
-		if (!pathInfo.empty())
-			env.push_back("PATH_INFO=" + pathInfo);
-
-		// REQUEST_URI & QUERY_STRING
-		env.push_back("REQUEST_URI="  + urlPath2 + (query2.empty() ? "" : "?" + query2));
-		env.push_back("QUERY_STRING=" + query2);
-
-		// Document root
-		{
-			std::string docroot = !route.root.empty() ? route.root : server.root;
-			if (!docroot.empty())
-				env.push_back("DOCUMENT_ROOT=" + docroot);
-		}
-
-		if (!st.cgi.inBuf.empty())
-		{
-			std::ostringstream oss;
-			oss << st.cgi.inBuf.size();
-			env.push_back("CONTENT_LENGTH=" + oss.str());
-		}
-		{
-			std::map<std::string,std::string>::const_iterator itCT =
-				st.req.headers.find("content-type");
-			if (itCT != st.req.headers.end())
-				env.push_back("CONTENT_TYPE=" + itCT->second);
-		}
-
-		for (std::map<std::string,std::string>::const_iterator it = st.req.headers.begin();
-			 it != st.req.headers.end(); ++it)
-		{
-			const std::string &k = it->first;
-			if (k == "content-type" || k == "content-length")
-				continue;
-			env.push_back("HTTP_" + httpKeyToCgiVar(k) + "=" + it->second);
-		}
-
-		for (size_t i = 0; i < route.cgi_pass_env.size(); ++i)
-		{
-			const std::string &key = route.cgi_pass_env[i];
-			const char *v = std::getenv(key.c_str());
-			if (v && *v)
-				env.push_back(key + "=" + std::string(v));
-		}
-
-		// Convert to char*[]
-		std::vector<char*> envp;
-		envp.reserve(env.size() + 1);
-		for (size_t i = 0; i < env.size(); ++i)
-			envp.push_back(const_cast<char*>(env[i].c_str()));
-		envp.push_back(NULL);
-
 		// exec
-		::execve(argv[0], &argv[0], &envp[0]);
+		::execve(argv[0], argv, envp);
 		std::exit(127);
 	}
 
@@ -903,12 +959,12 @@ void SocketManager::startCgiDispatch(int fd,
 
 	// Register pipe fds in poll()
 	addPollFd(st.cgi.stdout_r, POLLIN);
-	m_cgiStdoutToClient[st.cgi.stdout_r] = fd;
+	bindCgiPipe(st.cgi.stdout_r, FdSlot::CGI_STDOUT, fd);
 
 	if (st.cgi.stdin_w != -1)
 	{
 		addPollFd(st.cgi.stdin_w, POLLOUT);
-		m_cgiStdinToClient[st.cgi.stdin_w] = fd;
+		bindCgiPipe(st.cgi.stdin_w, FdSlot::CGI_STDIN, fd);
 	}
 
 	std::cerr << "[fd " << fd << "] CGI spawned pid=" << pid
@@ -956,6 +1012,7 @@ void SocketManager::handlePostUpload(int fd,
 		if (!body.empty())
 			ofs.write(&body[0], static_cast<std::streamsize>(body.size()));
 		ofs.close();
+		m_fileCache.invalidate(full);
 		Response res;
 		res.status_code = 201;
 		res.status_message = "Created";
@@ -0,0 +1,167 @@
+#include "VirtualHosts.hpp"
+
+static char lowerAscii(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// 32-bit FNV-1a, case-folded as it goes so lookups don't copy the Host.
+static unsigned fnv1a(const char *p, size_t len)
+{
+	unsigned h = 2166136261u;
+	for (size_t i = 0; i < len; ++i)
+	{
+		h ^= static_cast<unsigned char>(lowerAscii(p[i]));
+		h *= 16777619u;
+	}
+	return h;
+}
+
+VirtualHosts::NameTable::NameTable() : m_entries(), m_index(8, -1), m_mask(7)
+{
+	return;
+}
+
+size_t VirtualHosts::NameTable::size() const
+{
+	return m_entries.size();
+}
+
+bool VirtualHosts::NameTable::equals(const Entry &e, const char *p, size_t len,
+									 unsigned h) const
+{
+	if (e.hash != h || e.name.size() != len)
+		return false;
+	for (size_t i = 0; i < len; ++i)
+		if (lowerAscii(p[i]) != e.name[i])
+			return false;
+	return true;
+}
+
+// Kept at most half full: linear probing stays short.
+void VirtualHosts::NameTable::grow()
+{
+	const size_t cap = m_index.size() * 2;
+	m_index.assign(cap, -1);
+	m_mask = cap - 1;
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		size_t slot = m_entries[i].hash & m_mask;
+		while (m_index[slot] != -1)
+			slot = (slot + 1) & m_mask;
+		m_index[slot] = static_cast<int>(i);
+	}
+}
+
+bool VirtualHosts::NameTable::insert(const std::string &lowerName, size_t server)
+{
+	size_t found;
+	if (find(lowerName.data(), lowerName.size(), found))
+		return false;
+	if ((m_entries.size() + 1) * 2 > m_index.size())
+		grow();
+	Entry e;
+	e.name = lowerName;
+	e.server = server;
+	e.hash = fnv1a(lowerName.data(), lowerName.size());
+	m_entries.push_back(e);
+	size_t slot = e.hash & m_mask;
+	while (m_index[slot] != -1)
+		slot = (slot + 1) & m_mask;
+	m_index[slot] = static_cast<int>(m_entries.size() - 1);
+	return true;
+}
+
+bool VirtualHosts::NameTable::find(const char *p, size_t len, size_t &server) const
+{
+	if (m_entries.empty())
+		return false;
+	const unsigned h = fnv1a(p, len);
+	for (size_t slot = h & m_mask; m_index[slot] != -1; slot = (slot + 1) & m_mask)
+	{
+		const Entry &e = m_entries[m_index[slot]];
+		if (equals(e, p, len, h))
+		{
+			server = e.server;
+			return true;
+		}
+	}
+	return false;
+}
+
+VirtualHosts::VirtualHosts() : m_exact(), m_suffix(), m_default(0)
+{
+	return;
+}
+
+void VirtualHosts::setDefault(size_t server)
+{
+	m_default = server;
+}
+
+size_t VirtualHosts::defaultServer() const
+{
+	return m_default;
+}
+
+size_t VirtualHosts::names() const
+{
+	return m_exact.size() + m_suffix.size();
+}
+
+void VirtualHosts::add(const std::string &name, size_t server)
+{
+	std::string lower(name);
+	for (size_t i = 0; i < lower.size(); ++i)
+		lower[i] = lowerAscii(lower[i]);
+	if (!lower.empty() && lower[lower.size() - 1] == '.')
+		lower.erase(lower.size() - 1);
+	if (lower.empty())
+		return;
+
+	if (lower.compare(0, 2, "*.") == 0)
+		m_suffix.insert(lower.substr(1), server);
+	else if (lower[0] == '.')
+	{
+		m_exact.insert(lower.substr(1), server);
+		m_suffix.insert(lower, server);
+	}
+	else
+		m_exact.insert(lower, server);
+}
+
+size_t VirtualHosts::resolve(const char *host, size_t len) const
+{
+	// drop ":port" (after the "]" of an IPv6 literal) and a trailing dot
+	size_t end = len;
+	size_t from = 0;
+	if (len && host[0] == '[')
+	{
+		while (from < len && host[from] != ']')
+			++from;
+	}
+	for (size_t i = from; i < len; ++i)
+	{
+		if (host[i] == ':')
+		{
+			end = i;
+			break;
+		}
+	}
+	if (end && host[end - 1] == '.')
+		--end;
+	if (!end)
+		return m_default;
+
+	size_t server;
+	if (m_exact.find(host, end, server))
+		return server;
+	if (m_suffix.size())
+	{
+		// leftmost dot first: the longest suffix
+		for (size_t i = 0; i < end; ++i)
+			if (host[i] == '.' && m_suffix.find(host + i, end - i, server))
+				return server;
+	}
+	return m_default;
+}
@@ -0,0 +1,159 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+#ifdef __linux__
+# include <sys/prctl.h>
+#endif
+
+#include "SocketManager.hpp"
+#include "WorkerMaster.hpp"
+#include "utils.hpp"
+
+extern volatile sig_atomic_t g_stop;
+
+// A worker dying this fast never got to serve anything (bind failure, bad
+// root...): respawning it would just spin, so the master gives up instead.
+static const unsigned long long WORKER_MIN_UPTIME_MS = 1000;
+
+WorkerMaster::WorkerMaster(const Config &config) : m_config(config)
+{
+	return;
+}
+
+WorkerMaster::~WorkerMaster()
+{
+	return;
+}
+
+int WorkerMaster::runWorker(const Config &config, bool reusePort)
+{
+	SocketManager sm(config);
+	sm.setServers(config.servers);
+
+	for (size_t i = 0; i < config.servers.size(); ++i)
+		sm.addServer(i, reusePort);
+	sm.run();
+	return 0;
+}
+
+int WorkerMaster::run()
+{
+	if (m_config.worker_processes <= 1)
+		return runWorker(m_config, false);
+
+	std::cout << "Master pid " << getpid() << ", starting "
+			  << m_config.worker_processes << " workers" << std::endl;
+
+	m_pids.assign(m_config.worker_processes, -1);
+	m_startedMs.assign(m_config.worker_processes, 0ULL);
+	for (size_t i = 0; i < m_pids.size(); ++i)
+	{
+		if (!spawn(i))
+		{
+			stopAll();
+			return 1;
+		}
+	}
+
+	int rc = 0;
+	while (!g_stop)
+	{
+		int status = 0;
+		pid_t pid = ::waitpid(-1, &status, WNOHANG);
+		if (pid <= 0)
+		{
+			usleep(100000); // cut short by SIGINT/SIGTERM
+			continue;
+		}
+
+		int slot = slotOf(pid);
+		if (slot < 0)
+			continue;
+		m_pids[slot] = -1;
+
+		std::cerr << "[master] worker " << slot << " (pid " << pid << ") ";
+		if (WIFSIGNALED(status))
+			std::cerr << "killed by signal " << WTERMSIG(status);
+		else
+			std::cerr << "exited with status " << WEXITSTATUS(status);
+		std::cerr << std::endl;
+
+		if (now_ms() - m_startedMs[slot] < WORKER_MIN_UPTIME_MS)
+		{
+			std::cerr << "[master] worker died during startup, shutting down"
+					  << std::endl;
+			rc = 1;
+			break;
+		}
+		if (!spawn(static_cast<size_t>(slot)))
+		{
+			rc = 1;
+			break;
+		}
+	}
+	stopAll();
+	return rc;
+}
+
+bool WorkerMaster::spawn(size_t slot)
+{
+	const pid_t masterPid = getpid();
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		std::cerr << "[master] fork() failed: " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	if (pid == 0)
+	{
+#ifdef __linux__
+		// Master killed hard: don't leave orphans holding the port.
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+#endif
+		if (getppid() != masterPid)
+			std::exit(0);
+
+		int code = 0;
+		try
+		{
+			std::cout << "[worker " << slot << "] pid " << getpid() << std::endl;
+			code = runWorker(m_config, true);
+		}
+		catch (const std::exception &e)
+		{
+			std::cerr << "[worker " << slot << "] fatal error: " << e.what()
+					  << std::endl;
+			code = 1;
+		}
+		std::exit(code);
+	}
+	m_pids[slot] = pid;
+	m_startedMs[slot] = now_ms();
+	return true;
+}
+
+void WorkerMaster::stopAll()
+{
+	for (size_t i = 0; i < m_pids.size(); ++i)
+		if (m_pids[i] > 0)
+			::kill(m_pids[i], SIGTERM);
+	for (size_t i = 0; i < m_pids.size(); ++i)
+	{
+		if (m_pids[i] > 0)
+			::waitpid(m_pids[i], NULL, 0);
+		m_pids[i] = -1;
+	}
+}
+
+int WorkerMaster::slotOf(pid_t pid) const
+{
+	for (size_t i = 0; i < m_pids.size(); ++i)
+		if (m_pids[i] == pid)
+			return static_cast<int>(i);
+	return -1;
+}
@@ -0,0 +1,61 @@
+#include <cstdlib>
+#include <new>
+
+#include "alloc_stats.hpp"
+
+#ifdef WEBSERV_ALLOC_STATS
+
+static unsigned long g_allocs = 0;
+
+static void *countedAlloc(size_t n)
+{
+	++g_allocs;
+	void *p = std::malloc(n ? n : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new(size_t n) throw(std::bad_alloc)
+{
+	return countedAlloc(n);
+}
+
+void *operator new[](size_t n) throw(std::bad_alloc)
+{
+	return countedAlloc(n);
+}
+
+void operator delete(void *p) throw()
+{
+	std::free(p);
+}
+
+void operator delete[](void *p) throw()
+{
+	std::free(p);
+}
+
+bool allocStatsEnabled()
+{
+	return true;
+}
+
+unsigned long allocCount()
+{
+	return g_allocs;
+}
+
+#else
+
+bool allocStatsEnabled()
+{
+	return false;
+}
+
+unsigned long allocCount()
+{
+	return 0;
+}
+
+#endif
@@ -1,15 +1,49 @@
+#include <cstdio>
+#include <cstring>
 #include <dirent.h>
 #include <sstream>
 
+#include "MimeTypes.hpp"
 #include "SocketManager.hpp"
 #include "utils.hpp"
 #include <ctime>
 
 std::string to_string(size_t val)
 {
-	std::ostringstream oss;
-	oss << val;
-	return oss.str();
+	char buf[24];
+	char *p = buf + sizeof(buf);
+	do
+	{
+		*--p = static_cast<char>('0' + val % 10);
+		val /= 10;
+	} while (val);
+	return std::string(p, buf + sizeof(buf));
+}
+
+// End of the header block ("\r\n\r\n" included) in buf[0, len), or npos.
+// scanPos carries over between calls: bytes before it were already
+// searched, so a slow client's trickle is not rescanned from the start.
+// memchr (vectorized in libc) jumps from '\n' to '\n' and we only look
+// back three bytes from each, which also catches a terminator split
+// across two reads.
+size_t findHeaderEnd(const char *buf, size_t len, size_t &scanPos)
+{
+	size_t pos = scanPos;
+	while (pos < len)
+	{
+		const char *nl = static_cast<const char *>(std::memchr(buf + pos, '\n', len - pos));
+		if (!nl)
+			break;
+		const size_t i = static_cast<size_t>(nl - buf);
+		if (i >= 3 && buf[i - 1] == '\r' && buf[i - 2] == '\n' && buf[i - 3] == '\r')
+		{
+			scanPos = 0;
+			return i + 1;
+		}
+		pos = i + 1;
+	}
+	scanPos = len;
+	return std::string::npos;
 }
 
 bool isPathPrefix(const std::string& path, const std::string& prefix) {
@@ -35,11 +69,23 @@ std::string getFileExtension(const std::string &path)
 
 std::string joinPaths(const std::string &a, const std::string &b)
 {
-	if (a.empty()) return b;
-	if (b.empty()) return a;
-	if (a[a.size()-1] == '/' && b[0] == '/') return a + b.substr(1);
-	if (a[a.size()-1] != '/' && b[0] != '/') return a + "/" + b;
-	return a + b;
+	std::string out;
+	joinPaths(out, a, b);
+	return out;
+}
+
+// Same, into a string the caller keeps around (an Arena slot).
+void joinPaths(std::string &out, const std::string &a, const std::string &b)
+{
+	out.assign(a);
+	if (a.empty() || b.empty())
+	{
+		out.append(b);
+		return;
+	}
+	if (a[a.size()-1] == '/' && b[0] == '/') out.append(b, 1, std::string::npos);
+	else if (a[a.size()-1] != '/' && b[0] != '/') out.append(1, '/').append(b);
+	else out.append(b);
 }
 
 unsigned long long now_ms()
@@ -52,27 +98,83 @@ unsigned long long now_ms()
 	return static_cast<unsigned long long>(t) * 1000ULL;
 }
 
+static const char *const kMonths[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+									  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+// IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT" (RFC 9110 5.6.7).
+// We never call setlocale(), so %a/%b are the English names HTTP wants.
+std::string httpDate(time_t t)
+{
+	struct tm g;
+	gmtime_r(&t, &g);
+	char buf[32];
+	std::strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &g);
+	return buf;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date (no timegm() needed).
+static long daysFromCivil(long y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const long era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<long>(doe) - 719468;
+}
+
+// Only the IMF-fixdate form: that's what we send and what clients echo back.
+bool parseHttpDate(const std::string &s, time_t &out)
+{
+	if (s.size() != 29 || s[3] != ',' || s.compare(26, 3, "GMT") != 0)
+		return false;
+	int day, year, hh, mm, ss;
+	char mon[4];
+	if (std::sscanf(s.c_str() + 5, "%2d %3s %4d %2d:%2d:%2d", &day, mon, &year,
+					&hh, &mm, &ss) != 6)
+		return false;
+	unsigned month = 0;
+	while (month < 12 && std::strncmp(mon, kMonths[month], 3) != 0)
+		++month;
+	if (month == 12 || day < 1 || day > 31 || hh > 23 || mm > 59 || ss > 60)
+		return false;
+	long days = daysFromCivil(year, month + 1, static_cast<unsigned>(day));
+	out = static_cast<time_t>(days * 86400L + hh * 3600L + mm * 60L + ss);
+	return true;
+}
+
 /* version 2.0 of the routing logic because request with route like "/upload" werent 
 matchin our /upload/ creating the helper matchOnePass for it*/
 
-static const RouteConfig* matchOnePass(const ServerConfig &server, const std::string &reqPath)
+// With `slash` the request path is matched as if it had a trailing '/'
+// (so "/upload" finds "/upload/"), without building that string.
+static const RouteConfig* matchOnePass(const ServerConfig &server, const std::string &reqPath, bool slash)
 {
 	const RouteConfig *best_match = NULL;
 	size_t best_length = 0;
+	const size_t reqLen = reqPath.size() + (slash ? 1 : 0);
 	for (size_t i = 0; i < server.routes.size(); i++)
 	{
 		const RouteConfig &route = server.routes[i];
 		const std::string &locPath = route.path;
 		// prefix must be shared E.G does this request path start with locPath ? if not skip it
-		if (reqPath.compare(0, locPath.size(), locPath) != 0)
+		if (locPath.size() > reqLen)
+			continue;
+		if (slash && locPath.size() == reqLen)
+		{
+			if (locPath[reqLen - 1] != '/' || reqPath.compare(0, reqPath.size(), locPath, 0, reqPath.size()) != 0)
+				continue;
+		}
+		else if (reqPath.compare(0, locPath.size(), locPath) != 0)
 			continue;
 		/*here we check
 		1. is the request path the same lenght as location path? I.e "/upload" with "/upload"
 		2. if request path is stricly longer than locPath AND it ends with '/'?
 		3. Does the location itself ends with '/'?
 		*/
-		bool exact = reqPath.size() == locPath.size();
-		bool isNextSlash = (reqPath.size() > locPath.size() && reqPath[locPath.size()] == '/');
+		bool exact = reqLen == locPath.size();
+		bool isNextSlash = (reqLen > locPath.size() &&
+							(locPath.size() == reqPath.size() || reqPath[locPath.size()] == '/'));
 		bool locEndsWithSlash = (!locPath.empty() && locPath[locPath.size() - 1] == '/');
 		if (exact || isNextSlash || locEndsWithSlash)
 		{
@@ -86,17 +188,19 @@ static const RouteConfig* matchOnePass(const ServerConfig &server, const std::st
 	return best_match;
 }
 
+// The server's compiled trie answers when it can; the two scans are the
+// fallback (and the reference it has to agree with).
 const RouteConfig* findMatchingLocation(const ServerConfig& server, const std::string& path)
 {
+	int index;
+	if (server.routeTrie.match(path, server.routes.size(), index))
+		return index == -1 ? NULL : &server.routes[index];
+
 	// first path we try exact as-is
-	const RouteConfig *bestNormal = matchOnePass(server, path);
+	const RouteConfig *bestNormal = matchOnePass(server, path, false);
 	const RouteConfig *bestWithSlash = NULL;
 	if (!path.empty()  && path[path.size() - 1] != '/')
-	{
-		std::string alt = path;
-		alt += '/';
-		bestWithSlash = matchOnePass(server, alt);
-	}
+		bestWithSlash = matchOnePass(server, path, true);
 	if (bestNormal && !bestWithSlash)
 	{
 		return bestNormal;
@@ -201,73 +305,12 @@ std::string trimCopy(const std::string &s)
 	return s.substr(b, e - b);
 }
 
-std::string getMimeTypeFromPath(const std::string& path) 
+// The built-in table (for callers without the configured one); the name
+// is looked at in place and nothing is allocated.
+const char *getMimeTypeFromPath(const std::string& path)
 {
-	// find last dot (.) that comes after the last slash (/)
-	size_t slash = path.find_last_of("/\\");
-	size_t dot   = path.find_last_of('.');
-	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
-		return "application/octet-stream";
-
-	std::string ext = path.substr(dot + 1);
-	// lowercase the extension safely
-	for (size_t i = 0; i < ext.size(); ++i)
-		ext[i] = static_cast<char>(std::tolower(static_cast<unsigned char>(ext[i])));
-
-	if (ext == "html" || ext == "htm")  return "text/html; charset=utf-8";
-	if (ext == "css")                   return "text/css";
-	if (ext == "js")                    return "application/javascript";
-	if (ext == "json")                  return "application/json";
-	if (ext == "txt" || ext == "log")   return "text/plain; charset=utf-8";
-	if (ext == "svg")                   return "image/svg+xml";
-	if (ext == "png")                   return "image/png";
-	if (ext == "jpg" || ext == "jpeg")  return "image/jpeg";
-	if (ext == "gif")                   return "image/gif";
-	if (ext == "webp")                  return "image/webp";
-	if (ext == "ico")                   return "image/x-icon";
-	if (ext == "pdf")                   return "application/pdf";
-	// fallback
-	return "application/octet-stream";
-}
-
-// Count how many times each header name appears (case-insensitive)
-// we check each line, lowecase it and had to a map "value(hearder) key(count of header)"
-// so if count > 1 we now there is a problem 
-
-void countHeaderNames(const std::string &rawHeaders, std::map<std::string, size_t> &outCounts)
-{
-	outCounts.clear();
-	size_t pos = 0;
-	while (pos < rawHeaders.size())
-	{
-		size_t nl = rawHeaders.find("\r\n", pos);
-		if (nl == std::string::npos) nl = rawHeaders.size();
-		if (nl == pos) break; // empty line (defensive)
-
-		const std::string line = rawHeaders.substr(pos, nl - pos);
-
-		// only header lines have ':'
-		size_t colon = line.find(':');
-		if (colon != std::string::npos)
-		{
-			std::string name = line.substr(0, colon);
-
-			// trim trailing spaces/tabs in header-name
-			while (!name.empty() && (name[name.size() - 1] == ' ' || name[name.size() - 1] == '\t'))
-				name.erase(name.size() - 1);
-
-			// lowercase ASCII
-			for (size_t i = 0; i < name.size(); ++i)
-			{
-				unsigned char c = static_cast<unsigned char>(name[i]);
-				if (c >= 'A' && c <= 'Z')
-					name[i] = static_cast<char>(c - 'A' + 'a');
-			}
-			++outCounts[name];
-		}
-
-		pos = (nl == rawHeaders.size()) ? nl : nl + 2; 
-	}
+	static const MimeTypes builtin;
+	return builtin.forPath(path);
 }
 
 std::string toLowerCopy(const std::string &str)
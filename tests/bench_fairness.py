@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""
+Small-request latency next to bulk transfers, per io_budget_bytes.
+
+For each budget the server is started on port 18084 (one worker) with a
+throw-away config whose root is a temp dir holding a 1 KB page and a 64 MB
+file. A few "bulk" clients download the big file over and over while "small"
+clients fetch the page in a loop on keep-alive connections. We report the
+small clients' p50/p99 latency and request rate next to the bulk throughput:
+with no budget (0) a single readiness event can push a whole sendfile chunk
+to one bulk client before the small ones are looked at; a budget caps what
+any connection moves per event so the loop turns faster.
+
+Usage: python3 tests/bench_fairness.py [seconds] [bulk_clients] [small_clients] [budgets]
+Defaults: seconds = 5, bulk = 4, small = 8, budgets = 0,1048576,262144,65536.
+Only uses the Python standard library. Run `make` first.
+"""
+import multiprocessing
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18084
+BIG_SIZE = 64 << 20
+
+CONFIG = """io_budget_bytes %d;
+content_cache_max_file 0;
+server {
+    listen 127.0.0.1:%d;
+    root %s;
+    location / {
+        root %s;
+        methods GET;
+    }
+}
+"""
+
+SMALL = b'GET /small.html HTTP/1.1\r\nHost: bench\r\n\r\n'
+BIG = b'GET /big.bin HTTP/1.1\r\nHost: bench\r\n\r\n'
+
+
+def wait_for_port(port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            socket.create_connection(('127.0.0.1', port), 0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def read_response(sock, pending):
+    """Returns (body bytes, leftover)."""
+    data = pending
+    while b'\r\n\r\n' not in data:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise RuntimeError('connection closed')
+        data += chunk
+    head, rest = data.split(b'\r\n\r\n', 1)
+    length = 0
+    for line in head.split(b'\r\n'):
+        if line.lower().startswith(b'content-length:'):
+            length = int(line.split(b':', 1)[1])
+    # Count the body instead of keeping it: the big file is 64 MB.
+    got = len(rest)
+    extra = rest[length:]
+    while got < length:
+        chunk = sock.recv(1 << 20)
+        if not chunk:
+            raise RuntimeError('connection closed')
+        got += len(chunk)
+        if got > length:
+            extra = chunk[len(chunk) - (got - length):]
+    return length, extra
+
+
+def client(request, deadline, out):
+    latencies = []
+    moved = 0
+    sock = None
+    pending = b''
+    while time.time() < deadline:
+        try:
+            if sock is None:
+                sock = socket.create_connection(('127.0.0.1', PORT), 5)
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                sock.settimeout(10)
+                pending = b''
+            t0 = time.time()
+            sock.sendall(request)
+            n, pending = read_response(sock, pending)
+            latencies.append(time.time() - t0)
+            moved += n
+        except (OSError, RuntimeError):
+            if sock is not None:
+                sock.close()
+            sock = None
+    if sock is not None:
+        sock.close()
+    out.put((request is SMALL, latencies, moved))
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p))]
+
+
+def bench(root, budget, seconds, bulk, small):
+    cfg = tempfile.NamedTemporaryFile('w', suffix='.conf', delete=False)
+    cfg.write(CONFIG % (budget, PORT, root, root))
+    cfg.close()
+    proc = subprocess.Popen([WEBSERV, cfg.name], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port(PORT):
+            raise RuntimeError('server did not start')
+        out = multiprocessing.Queue()
+        deadline = time.time() + seconds
+        procs = [multiprocessing.Process(target=client, args=(BIG, deadline, out))
+                 for _ in range(bulk)]
+        procs += [multiprocessing.Process(target=client, args=(SMALL, deadline, out))
+                  for _ in range(small)]
+        for p in procs:
+            p.start()
+        results = [out.get() for _ in procs]
+        for p in procs:
+            p.join()
+    finally:
+        proc.terminate()
+        proc.wait()
+        os.unlink(cfg.name)
+    lat = []
+    bulk_bytes = 0
+    for is_small, latencies, moved in results:
+        if is_small:
+            lat.extend(latencies)
+        else:
+            bulk_bytes += moved
+    return (percentile(lat, 0.50) * 1000, percentile(lat, 0.99) * 1000,
+            len(lat) / float(seconds), bulk_bytes / float(seconds) / (1 << 20))
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+    seconds = float(sys.argv[1]) if len(sys.argv) > 1 else 5.0
+    bulk = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+    small = int(sys.argv[3]) if len(sys.argv) > 3 else 8
+    budgets = [int(b) for b in (sys.argv[4] if len(sys.argv) > 4
+                                else '0,1048576,262144,65536').split(',')]
+
+    root = tempfile.mkdtemp(prefix='webserv_fair_')
+    try:
+        with open(os.path.join(root, 'small.html'), 'wb') as f:
+            f.write(b'x' * 1024)
+        with open(os.path.join(root, 'big.bin'), 'wb') as f:
+            f.truncate(BIG_SIZE)
+
+        print('bulk=%d small=%d duration=%.1fs big=%dMB'
+              % (bulk, small, seconds, BIG_SIZE >> 20))
+        print('%10s | %9s | %9s | %9s | %10s'
+              % ('budget', 'p50 ms', 'p99 ms', 'small/s', 'bulk MB/s'))
+        print('-' * 58)
+        for budget in budgets:
+            p50, p99, rps, mbs = bench(root, budget, seconds, bulk, small)
+            print('%10s | %9.2f | %9.2f | %9.0f | %10.0f'
+                  % (budget if budget else 'none', p50, p99, rps, mbs))
+    finally:
+        shutil.rmtree(root)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
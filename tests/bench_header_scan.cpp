@@ -0,0 +1,88 @@
+/*
+ * Header terminator search: rescanning recvBuffer from the start on every
+ * read (the old `recvBuffer.find("\r\n\r\n")`) vs findHeaderEnd, which
+ * resumes where the previous read stopped.
+ *
+ * A ~16 KB request head is fed to both in 1-byte, 4 KB and 64 KB
+ * fragments, the way recv() would hand it over, and we report how long
+ * each takes per request. With 1-byte fragments the rescan is quadratic.
+ *
+ * Usage: make bench && ./tests/bench_header_scan [requests]
+ * Default: 200 requests per fragment size.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+
+#include "utils.hpp"
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string sampleHead()
+{
+	std::string head = "GET /index.html HTTP/1.1\r\nHost: bench\r\n";
+	for (int i = 0; head.size() < 16 * 1024; ++i)
+		head += "X-Filler-" + to_string(i) + ": " + std::string(60, 'v') + "\r\n";
+	head += "\r\n";
+	return head;
+}
+
+static size_t rescan(const std::string &buf, size_t &)
+{
+	size_t p = buf.find("\r\n\r\n");
+	return p == std::string::npos ? p : p + 4;
+}
+
+static size_t incremental(const std::string &buf, size_t &scanPos)
+{
+	return findHeaderEnd(buf.data(), buf.size(), scanPos);
+}
+
+// Feed `head` in `frag`-byte pieces until the terminator is found.
+static double run(size_t (*find)(const std::string &, size_t &),
+				  const std::string &head, size_t frag, long requests)
+{
+	size_t sink = 0;
+	const double t0 = seconds();
+	for (long r = 0; r < requests; ++r)
+	{
+		std::string recvBuffer;
+		size_t scanPos = 0;
+		size_t end = std::string::npos;
+		for (size_t off = 0; off < head.size() && end == std::string::npos; off += frag)
+		{
+			recvBuffer.append(head, off, frag);
+			end = find(recvBuffer, scanPos);
+		}
+		sink += end;
+	}
+	const double dt = seconds() - t0;
+	if (sink != head.size() * requests)
+		std::cerr << "terminator not found where expected" << std::endl;
+	return dt / requests * 1e6;
+}
+
+int main(int argc, char **argv)
+{
+	const long requests = argc > 1 ? std::atol(argv[1]) : 200;
+	const std::string head = sampleHead();
+	const size_t frags[] = {1, 4096, 65536};
+
+	std::cout << "head=" << head.size() << " bytes, " << requests
+			  << " requests per run" << std::endl;
+	std::cout << "fragment | rescan us/req | incremental us/req | speedup" << std::endl;
+	for (size_t i = 0; i < sizeof(frags) / sizeof(frags[0]); ++i)
+	{
+		const double a = run(rescan, head, frags[i], requests);
+		const double b = run(incremental, head, frags[i], requests);
+		std::cout << frags[i] << " | " << a << " | " << b << " | "
+				  << (b > 0 ? a / b : 0) << "x" << std::endl;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Response head serialization: HeaderBuilder vs the std::stringstream
+ * builder it replaced.
+ *
+ * Both sides turn the same Response (a 200 with the usual static-file
+ * headers, a 404 with a non-default reason, a CGI 200 with two Set-Cookie
+ * lines) into status line + headers + Date + blank line, the way
+ * queueResponse does, and we report heads per second for each.
+ *
+ * Usage: make bench && ./tests/bench_headers [iterations]
+ * Default: 1000000 iterations per builder.
+ */
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <sys/time.h>
+
+#include "HeaderBuilder.hpp"
+#include "request_response_struct.hpp"
+#include "utils.hpp"
+
+// What every response paid before: to_string through an ostringstream and
+// the head through a stringstream (Date formatted per response).
+static std::string legacyToString(size_t val)
+{
+	std::ostringstream oss;
+	oss << val;
+	return oss.str();
+}
+
+static std::string legacyHead(const Response &res)
+{
+	std::stringstream response;
+	response << "HTTP/1.1 " << res.status_code << " " << res.status_message << "\r\n";
+	for (std::map<std::string, std::string>::const_iterator it = res.headers.begin();
+			it != res.headers.end(); ++it)
+		response << it->first << ": " << it->second << "\r\n";
+	for (size_t i = 0; i < res.header_lines.size(); ++i)
+		response << res.header_lines[i] << "\r\n";
+	response << "Date: " << httpDate(std::time(NULL)) << "\r\n";
+	if (res.close_connection)
+		response << "Connection: close\r\n";
+	response << "\r\n";
+	return response.str();
+}
+
+static std::string builderHead(const Response &res)
+{
+	std::string head = build_http_head(res);
+	HeaderBuilder hb(head, 64);
+	hb.date();
+	if (res.close_connection)
+		hb.connectionClose();
+	hb.end();
+	return head;
+}
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::vector<Response> sampleResponses(std::string (*num)(size_t))
+{
+	std::vector<Response> v(3);
+	v[0].status_code = 200;
+	v[0].status_message = "OK";
+	v[0].headers["Accept-Ranges"] = "bytes";
+	v[0].headers["Content-Type"] = "text/html; charset=utf-8";
+	v[0].headers["Content-Length"] = num(48213);
+	v[0].headers["ETag"] = "\"11e05f-bc55-6927a46f\"";
+	v[0].headers["Last-Modified"] = "Thu, 27 Nov 2025 01:07:59 GMT";
+
+	v[1].status_code = 404;
+	v[1].status_message = "Not Found Here";
+	v[1].headers["Content-Type"] = "text/html; charset=utf-8";
+	v[1].headers["Content-Length"] = num(22);
+	v[1].close_connection = true;
+
+	v[2].status_code = 200;
+	v[2].status_message = "OK";
+	v[2].headers["content-type"] = "text/plain";
+	v[2].header_lines.push_back("Set-Cookie: a=1");
+	v[2].header_lines.push_back("Set-Cookie: b=2");
+	return v;
+}
+
+static double run(const char *name, std::string (*num)(size_t),
+				  std::string (*head)(const Response &), long iterations)
+{
+	size_t sink = 0;
+	const double t0 = seconds();
+	for (long i = 0; i < iterations; ++i)
+	{
+		// Building the Response is part of the cost (Content-Length).
+		std::vector<Response> v = sampleResponses(num);
+		for (size_t j = 0; j < v.size(); ++j)
+			sink += head(v[j]).size();
+	}
+	const double dt = seconds() - t0;
+	const double rate = iterations * 3 / dt;
+	std::cout << name << ": " << static_cast<long>(rate) << " heads/s"
+			  << " (" << sink << " bytes)" << std::endl;
+	return rate;
+}
+
+int main(int argc, char **argv)
+{
+	const long iterations = argc > 1 ? std::atol(argv[1]) : 1000000;
+
+	// Same bytes out of both, Date aside.
+	std::vector<Response> a = sampleResponses(legacyToString);
+	for (size_t i = 0; i < a.size(); ++i)
+		if (legacyHead(a[i]) != builderHead(a[i]))
+		{
+			std::cerr << "builders disagree on response " << i << std::endl;
+			return 1;
+		}
+
+	const double legacy = run("stringstream ", legacyToString, legacyHead, iterations);
+	const double fast = run("HeaderBuilder", to_string, builderHead, iterations);
+	std::cout << "speedup: " << fast / legacy << "x" << std::endl;
+	return 0;
+}
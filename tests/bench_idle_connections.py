@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+Idle keep-alive connections vs per-request latency.
+
+For each event backend (poll, epoll) the server is started on port 18082 with a
+throw-away config, N idle connections are opened and left silent, then one
+extra keep-alive connection issues sequential GETs and we record the latency.
+With poll every wakeup walks the whole fd set, so latency grows with N; with
+epoll only ready fds are visited and the column should stay flat.
+
+Usage: python3 tests/bench_idle_connections.py [requests_per_point]
+Only uses the Python standard library. Run `make` first.
+"""
+import os
+import resource
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18082
+IDLE_COUNTS = [0, 500, 1000, 2000, 4000]
+
+CONFIG = """event_backend %s;
+server {
+    listen 127.0.0.1:%d;
+    root ./www;
+    index index.html;
+    location / {
+        root ./www;
+        index index.html;
+        methods GET;
+    }
+}
+"""
+
+
+def wait_for_port(port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            socket.create_connection(('127.0.0.1', port), 0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def read_response(sock):
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise RuntimeError('connection closed')
+        data += chunk
+    head, body = data.split(b'\r\n\r\n', 1)
+    length = 0
+    for line in head.split(b'\r\n'):
+        if line.lower().startswith(b'content-length:'):
+            length = int(line.split(b':', 1)[1])
+    while len(body) < length:
+        body += sock.recv(65536)
+
+
+def measure(requests):
+    sock = socket.create_connection(('127.0.0.1', PORT), 5)
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    req = b'GET /index.html HTTP/1.1\r\nHost: bench\r\n\r\n'
+    samples = []
+    for _ in range(requests):
+        t0 = time.perf_counter()
+        sock.sendall(req)
+        read_response(sock)
+        samples.append((time.perf_counter() - t0) * 1e6)
+    sock.close()
+    samples.sort()
+    return samples[len(samples) // 2], samples[int(len(samples) * 0.99) - 1]
+
+
+def bench_backend(backend, requests):
+    cfg = tempfile.NamedTemporaryFile('w', suffix='.conf', delete=False)
+    cfg.write(CONFIG % (backend, PORT))
+    cfg.close()
+    proc = subprocess.Popen([WEBSERV, cfg.name], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    rows = []
+    idle = []
+    try:
+        if not wait_for_port(PORT):
+            raise RuntimeError('server did not start')
+        for target in IDLE_COUNTS:
+            while len(idle) < target:
+                idle.append(socket.create_connection(('127.0.0.1', PORT), 5))
+            time.sleep(0.3)  # let the server accept() all of them
+            rows.append((target,) + measure(requests))
+    finally:
+        for s in idle:
+            s.close()
+        proc.terminate()
+        proc.wait()
+        os.unlink(cfg.name)
+    return rows
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+    requests = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+
+    soft, hard = resource.getrlimit(resource.RLIMIT_NOFILE)
+    want = max(IDLE_COUNTS) * 2 + 256
+    if soft < want:
+        resource.setrlimit(resource.RLIMIT_NOFILE, (min(want, hard), hard))
+
+    results = {}
+    for backend in ('poll', 'epoll'):
+        results[backend] = bench_backend(backend, requests)
+
+    print('%8s | %22s | %22s' % ('idle', 'poll p50/p99 (us)', 'epoll p50/p99 (us)'))
+    print('-' * 58)
+    for i, target in enumerate(IDLE_COUNTS):
+        p = results['poll'][i]
+        e = results['epoll'][i]
+        print('%8d | %10.1f / %9.1f | %10.1f / %9.1f' % (target, p[1], p[2], e[1], e[2]))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
@@ -0,0 +1,142 @@
+/*
+ * Content-Type lookup per static response: the old chain of case-folding
+ * extension compares (a dozen types) vs MimeTypes, the perfect hash the
+ * config compiles at startup, with the built-in table and with a large
+ * Apache/nginx mime.types loaded on top.
+ *
+ * The paths cover every built-in extension in mixed case, plus unknown
+ * extensions, dotted directories and extension-less names. Every type the
+ * old chain knew must come out the same from the built-in table.
+ *
+ * Usage: make bench && ./tests/bench_mime [rounds] [mime.types]
+ * Default: 2000 rounds, /etc/mime.types if it exists.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+#include "MimeTypes.hpp"
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static bool extIs(const char *ext, size_t len, const char *name)
+{
+	size_t i = 0;
+	for (; i < len && name[i]; ++i)
+		if (std::tolower(static_cast<unsigned char>(ext[i])) != name[i])
+			return false;
+	return i == len && !name[i];
+}
+
+// getMimeTypeFromPath as it was
+static const char *chainLookup(const std::string &path)
+{
+	size_t slash = path.find_last_of("/\\");
+	size_t dot   = path.find_last_of('.');
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return "application/octet-stream";
+
+	const char *ext = path.data() + dot + 1;
+	const size_t len = path.size() - dot - 1;
+
+	if (extIs(ext, len, "html") || extIs(ext, len, "htm"))  return "text/html; charset=utf-8";
+	if (extIs(ext, len, "css"))                             return "text/css";
+	if (extIs(ext, len, "js"))                              return "application/javascript";
+	if (extIs(ext, len, "json"))                            return "application/json";
+	if (extIs(ext, len, "txt") || extIs(ext, len, "log"))   return "text/plain; charset=utf-8";
+	if (extIs(ext, len, "svg"))                             return "image/svg+xml";
+	if (extIs(ext, len, "png"))                             return "image/png";
+	if (extIs(ext, len, "jpg") || extIs(ext, len, "jpeg"))  return "image/jpeg";
+	if (extIs(ext, len, "gif"))                             return "image/gif";
+	if (extIs(ext, len, "webp"))                            return "image/webp";
+	if (extIs(ext, len, "ico"))                             return "image/x-icon";
+	if (extIs(ext, len, "pdf"))                             return "application/pdf";
+	return "application/octet-stream";
+}
+
+static std::vector<std::string> makePaths()
+{
+	static const char *exts[] = {
+		"html", "HTM", "css", "Js", "json", "txt", "log", "svg", "PNG", "jpg",
+		"jpeg", "gif", "webp", "ico", "pdf", "woff2", "mp4", "wasm", "7z",
+		"tar", "xlsx", "unknownext", "c", "", "Html5", "cgi"
+	};
+	std::vector<std::string> paths;
+	for (size_t i = 0; i < sizeof(exts) / sizeof(exts[0]); ++i)
+	{
+		paths.push_back(std::string("./www/site/assets/file.") + exts[i]);
+		paths.push_back(std::string("./www/v1.2/") + exts[i]);
+		paths.push_back(std::string("/srv/a.b/c/index.min.") + exts[i]);
+	}
+	paths.push_back("./www/Makefile");
+	paths.push_back("./www/.hidden");
+	return paths;
+}
+
+template <typename Lookup>
+static double timeIt(Lookup lookup, const std::vector<std::string> &paths,
+					 long rounds, size_t &sink)
+{
+	const double t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		for (size_t i = 0; i < paths.size(); ++i)
+			sink += std::strlen(lookup(paths[i]));
+	return seconds() - t0;
+}
+
+static const MimeTypes *g_table = NULL;
+
+static const char *tableLookup(const std::string &path)
+{
+	return g_table->forPath(path);
+}
+
+int main(int argc, char **argv)
+{
+	const long rounds = argc > 1 ? std::atol(argv[1]) : 2000;
+	const std::string file = argc > 2 ? argv[2] : "/etc/mime.types";
+
+	const MimeTypes builtin;
+	MimeTypes loaded;
+	std::string err;
+	const bool haveFile = loaded.loadFile(file, err);
+	loaded.compile();
+
+	const std::vector<std::string> paths = makePaths();
+	for (size_t i = 0; i < paths.size(); ++i)
+	{
+		const std::string before = chainLookup(paths[i]);
+		const std::string after = builtin.forPath(paths[i]);
+		if (before != MimeTypes::DEFAULT_TYPE && before != after)
+		{
+			std::cerr << "mismatch for '" << paths[i] << "': chain " << before
+					  << ", table " << after << std::endl;
+			return 1;
+		}
+	}
+
+	size_t sink = 0;
+	const double chain = timeIt(chainLookup, paths, rounds, sink);
+	g_table = &builtin;
+	const double hashed = timeIt(tableLookup, paths, rounds, sink);
+	g_table = &loaded;
+	const double big = timeIt(tableLookup, paths, rounds, sink);
+
+	const double lookups = static_cast<double>(rounds) * paths.size();
+	std::cout << paths.size() << " paths: chain (12 types) " << chain / lookups * 1e9
+			  << " ns, perfect hash (" << builtin.size() << " extensions) "
+			  << hashed / lookups * 1e9 << " ns";
+	if (haveFile)
+		std::cout << ", with " << file << " (" << loaded.size() << " extensions) "
+				  << big / lookups * 1e9 << " ns";
+	std::cout << std::endl;
+	return sink ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+/*
+ * Consuming input from the front: std::string::erase(0, n), which moves
+ * everything left behind on every step, vs ByteQueue's consume cursor.
+ *
+ *  - pipelined: 1000 small GETs arrive in one read and are taken off one
+ *    head at a time (findHeaderEnd + consume), the way tryParseHeaders
+ *    walks a pipelined batch.
+ *  - streaming: a 16 MB body arrives in 64 KB reads and is consumed in
+ *    1000-byte steps (a chunked body with small chunks), a partial step
+ *    staying behind for the next read.
+ *  - cgi stdin: a 16 MB body handed over in one piece and drained in 64 KB
+ *    pipe writes.
+ *
+ * Usage: make bench && ./tests/bench_recv_queue [rounds]
+ * Default: 20 rounds per scenario.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+
+#include "ByteQueue.hpp"
+#include "utils.hpp"
+
+// What recvBuffer and cgi.inBuf were before.
+struct StringQueue
+{
+	std::string buf;
+
+	const char *data() const { return buf.data(); }
+	size_t size() const { return buf.size(); }
+	void append(const char *p, size_t n) { buf.append(p, n); }
+	void consume(size_t n) { buf.erase(0, n); }
+	void assignSwap(std::string &s) { buf.swap(s); s.clear(); }
+};
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+template <typename Q>
+static size_t pipelined(const std::string &batch)
+{
+	Q q;
+	q.append(batch.data(), batch.size());
+	size_t served = 0;
+	size_t scanPos = 0;
+	for (;;)
+	{
+		size_t end = findHeaderEnd(q.data(), q.size(), scanPos);
+		if (end == std::string::npos)
+			break;
+		q.consume(end);
+		++served;
+	}
+	return served;
+}
+
+template <typename Q>
+static size_t streaming(const std::string &read, size_t total)
+{
+	const size_t step = 1000;
+	Q q;
+	size_t taken = 0;
+	for (size_t got = 0; got < total; got += read.size())
+	{
+		q.append(read.data(), read.size());
+		while (q.size() >= step)
+		{
+			q.consume(step);
+			taken += step;
+		}
+	}
+	return taken;
+}
+
+template <typename Q>
+static size_t cgiStdin(const std::string &body)
+{
+	const size_t pipe = 64 * 1024;
+	std::string copy(body);
+	Q q;
+	q.assignSwap(copy);
+	size_t written = 0;
+	while (q.size())
+	{
+		size_t n = q.size() < pipe ? q.size() : pipe;
+		written += n;
+		q.consume(n);
+	}
+	return written;
+}
+
+static void report(const char *name, double legacy, double fast)
+{
+	std::cout << name << ": erase " << legacy * 1000 << " ms, ByteQueue "
+			  << fast * 1000 << " ms, speedup " << legacy / fast << "x"
+			  << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+	const long rounds = argc > 1 ? std::atol(argv[1]) : 20;
+
+	std::string batch;
+	for (int i = 0; i < 1000; ++i)
+		batch += "GET /item/" + to_string(i) +
+				 " HTTP/1.1\r\nHost: bench\r\nAccept: */*\r\nUser-Agent: bench\r\n\r\n";
+	const std::string read(64 * 1024, 'b');
+	const size_t streamTotal = 16 << 20;
+	const std::string body(16 << 20, 'c');
+
+	size_t sink = 0;
+	double t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink += pipelined<StringQueue>(batch);
+	double legacy = seconds() - t0;
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink -= pipelined<ByteQueue>(batch);
+	report("pipelined ", legacy, seconds() - t0);
+
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink += streaming<StringQueue>(read, streamTotal);
+	legacy = seconds() - t0;
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink -= streaming<ByteQueue>(read, streamTotal);
+	report("streaming ", legacy, seconds() - t0);
+
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink += cgiStdin<StringQueue>(body);
+	legacy = seconds() - t0;
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink -= cgiStdin<ByteQueue>(body);
+	report("cgi stdin ", legacy, seconds() - t0);
+
+	// Both sides must have consumed exactly the same bytes.
+	if (sink != 0)
+	{
+		std::cerr << "queues disagree" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * Location matching with many locations: the two linear passes of
+ * findMatchingLocation (one with a '/' appended) vs the segment trie the
+ * parser compiles with ServerConfig::compileRoutes().
+ *
+ * 500 locations: "/", 200 "/svc<N>" (half with a trailing slash), 200
+ * "/api/v<K>/svc<N>/" two levels down, and 99 "/static/<N>/img". The probe
+ * paths hit all of them, plus sub-paths, query strings, near misses and
+ * paths no location covers. Every probe must get the same route from both.
+ *
+ * Usage: make bench && ./tests/bench_routes [rounds]
+ * Default: 200 rounds over the probe set.
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <sys/time.h>
+#include <vector>
+
+#include "Config.hpp"
+#include "utils.hpp"
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static void addLocation(ServerConfig &server, const std::string &path)
+{
+	RouteConfig route;
+	route.path = path;
+	server.routes.push_back(route);
+}
+
+static ServerConfig makeServer()
+{
+	ServerConfig server;
+	addLocation(server, "/");
+	for (int i = 0; i < 200; ++i)
+		addLocation(server, "/svc" + to_string(i) + (i % 2 ? "/" : ""));
+	for (int i = 0; i < 200; ++i)
+		addLocation(server, "/api/v" + to_string(i % 4) + "/svc" + to_string(i) + "/");
+	for (int i = 0; i < 99; ++i)
+		addLocation(server, "/static/" + to_string(i) + "/img");
+	return server;
+}
+
+static std::vector<std::string> makeProbes()
+{
+	std::vector<std::string> probes;
+	for (int i = 0; i < 220; ++i)
+	{
+		const std::string n = to_string(i);
+		probes.push_back("/svc" + n);
+		probes.push_back("/svc" + n + "/");
+		probes.push_back("/svc" + n + "/item/" + n + ".html");
+		probes.push_back("/svc" + n + "x/item");
+		probes.push_back("/svc" + n + "?q=" + n);
+		probes.push_back("/api/v" + to_string(i % 4) + "/svc" + n + "/users/" + n);
+		probes.push_back("/api/v" + to_string(i % 4) + "/svc" + n);
+		probes.push_back("/api/v9/svc" + n + "/");
+		probes.push_back("/static/" + n + "/img/logo.png");
+		probes.push_back("/static/" + n + "/imgs");
+		probes.push_back("/static//" + n + "/img");
+		probes.push_back("/nothing/" + n);
+	}
+	probes.push_back("/");
+	probes.push_back("");
+	probes.push_back("*");
+	return probes;
+}
+
+static size_t sweep(const ServerConfig &server, const std::vector<std::string> &probes)
+{
+	size_t sink = 0;
+	for (size_t i = 0; i < probes.size(); ++i)
+	{
+		const RouteConfig *r = findMatchingLocation(server, probes[i]);
+		sink += r ? r->path.size() : 0;
+	}
+	return sink;
+}
+
+int main(int argc, char **argv)
+{
+	const long rounds = argc > 1 ? std::atol(argv[1]) : 200;
+
+	ServerConfig linear = makeServer();  // never compiled: scans
+	ServerConfig trie = makeServer();
+	trie.compileRoutes();
+	const std::vector<std::string> probes = makeProbes();
+
+	for (size_t i = 0; i < probes.size(); ++i)
+	{
+		const RouteConfig *a = findMatchingLocation(linear, probes[i]);
+		const RouteConfig *b = findMatchingLocation(trie, probes[i]);
+		const std::string pa = a ? a->path : "(none)";
+		const std::string pb = b ? b->path : "(none)";
+		if (pa != pb)
+		{
+			std::cerr << "mismatch for '" << probes[i] << "': scan " << pa
+					  << ", trie " << pb << std::endl;
+			return 1;
+		}
+	}
+
+	size_t sink = 0;
+	double t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink += sweep(linear, probes);
+	const double scan = seconds() - t0;
+	t0 = seconds();
+	for (long r = 0; r < rounds; ++r)
+		sink -= sweep(trie, probes);
+	const double fast = seconds() - t0;
+
+	const double lookups = static_cast<double>(rounds) * probes.size();
+	std::cout << linear.routes.size() << " locations, " << probes.size()
+			  << " probes: scan " << scan / lookups * 1e9 << " ns/lookup, trie "
+			  << fast / lookups * 1e9 << " ns/lookup, speedup " << scan / fast
+			  << "x" << std::endl;
+	return sink == 0 ? 0 : 1;
+}
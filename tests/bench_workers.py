@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""
+Throughput vs worker_processes.
+
+For each worker count from 1 to N the server is started on port 18083 with a
+throw-away config (`worker_processes K;`), then a pool of client processes
+hammers GET /index.html over keep-alive connections for a fixed duration and
+we report requests per second. With SO_REUSEPORT the kernel spreads accepted
+connections over the workers, so throughput should grow with K until the
+cores (or the load generator) run out.
+
+Usage: python3 tests/bench_workers.py [max_workers] [seconds] [clients]
+Defaults: max_workers = CPU count, seconds = 5, clients = 4 * max_workers.
+Only uses the Python standard library. Run `make` first.
+"""
+import multiprocessing
+import os
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18083
+
+CONFIG = """worker_processes %d;
+server {
+    listen 127.0.0.1:%d;
+    root ./www;
+    index index.html;
+    location / {
+        root ./www;
+        index index.html;
+        methods GET;
+    }
+}
+"""
+
+REQUEST = b'GET /index.html HTTP/1.1\r\nHost: bench\r\n\r\n'
+
+
+def wait_for_port(port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            socket.create_connection(('127.0.0.1', port), 0.5).close()
+            return True
+        except OSError:
+            time.sleep(0.1)
+    return False
+
+
+def read_response(sock, pending):
+    data = pending
+    while b'\r\n\r\n' not in data:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise RuntimeError('connection closed')
+        data += chunk
+    head, rest = data.split(b'\r\n\r\n', 1)
+    length = 0
+    for line in head.split(b'\r\n'):
+        if line.lower().startswith(b'content-length:'):
+            length = int(line.split(b':', 1)[1])
+    while len(rest) < length:
+        chunk = sock.recv(65536)
+        if not chunk:
+            raise RuntimeError('connection closed')
+        rest += chunk
+    return rest[length:]
+
+
+def client(deadline, out):
+    done = 0
+    sock = None
+    pending = b''
+    while time.time() < deadline:
+        try:
+            if sock is None:
+                sock = socket.create_connection(('127.0.0.1', PORT), 5)
+                sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+                pending = b''
+            sock.sendall(REQUEST)
+            pending = read_response(sock, pending)
+            done += 1
+        except (OSError, RuntimeError):
+            if sock is not None:
+                sock.close()
+            sock = None
+    if sock is not None:
+        sock.close()
+    out.put(done)
+
+
+def bench(workers, seconds, clients):
+    cfg = tempfile.NamedTemporaryFile('w', suffix='.conf', delete=False)
+    cfg.write(CONFIG % (workers, PORT))
+    cfg.close()
+    proc = subprocess.Popen([WEBSERV, cfg.name], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port(PORT):
+            raise RuntimeError('server did not start')
+        time.sleep(0.3)  # let every worker reach its event loop
+        out = multiprocessing.Queue()
+        deadline = time.time() + seconds
+        procs = [multiprocessing.Process(target=client, args=(deadline, out))
+                 for _ in range(clients)]
+        for p in procs:
+            p.start()
+        total = sum(out.get() for _ in procs)
+        for p in procs:
+            p.join()
+    finally:
+        proc.terminate()
+        proc.wait()
+        os.unlink(cfg.name)
+    return total / float(seconds)
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+    cpus = multiprocessing.cpu_count()
+    max_workers = int(sys.argv[1]) if len(sys.argv) > 1 else cpus
+    seconds = float(sys.argv[2]) if len(sys.argv) > 2 else 5.0
+    clients = int(sys.argv[3]) if len(sys.argv) > 3 else 4 * max_workers
+
+    print('cpus=%d clients=%d duration=%.1fs' % (cpus, clients, seconds))
+    print('%8s | %12s | %8s' % ('workers', 'req/s', 'speedup'))
+    print('-' * 34)
+    base = None
+    for k in range(1, max_workers + 1):
+        rps = bench(k, seconds, clients)
+        if base is None:
+            base = rps
+        print('%8d | %12.0f | %7.2fx' % (k, rps, rps / base if base else 0.0))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""
+Functional test for cgi_workers (pre-forked CGI interpreters).
+
+Starts a server on port 18089 with /pool (two workers running
+tools/cgi_worker.py, recycled every 5 requests) and /fork (the same
+scripts, one child per request). Checks that the pool answers from the
+same long-lived processes, that a POST body and the CGI variables get
+through, max-requests recycling, respawn after a worker crashes, the
+health probe replacing a stopped worker, fork fallback while every worker
+is busy, and that no worker outlives the server.
+
+This test uses only the Python standard library so it can run on most systems.
+"""
+import hashlib
+import os
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18089
+PYTHON = sys.executable or '/usr/bin/python3'
+
+SCRIPTS = {
+    'pid.py': (
+        'import os\n'
+        'print("Content-Type: text/plain")\n'
+        'print()\n'
+        'print("pid=%d" % os.getpid())\n'),
+    'echo.py': (
+        'import hashlib, os, sys\n'
+        'body = sys.stdin.buffer.read() if hasattr(sys.stdin, "buffer") else b""\n'
+        'sys.stdout.write("Content-Type: text/plain\\r\\n\\r\\n")\n'
+        'sys.stdout.write("method=%s\\nquery=%s\\nlength=%s\\nmd5=%s\\n" % (\n'
+        '    os.environ.get("REQUEST_METHOD"), os.environ.get("QUERY_STRING"),\n'
+        '    os.environ.get("CONTENT_LENGTH", ""), hashlib.md5(body).hexdigest()))\n'),
+    'crash.py': 'import os\nos._exit(3)\n',
+    'slow.py': (
+        'import os, time\n'
+        'time.sleep(1)\n'
+        'print("Content-Type: text/plain")\n'
+        'print()\n'
+        'print("pid=%d" % os.getpid())\n'),
+}
+
+
+def wait_for_port(host, port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            s = socket.create_connection((host, port), 0.5)
+            s.close()
+            return True
+        except Exception:
+            time.sleep(0.1)
+    return False
+
+
+def recv_response(s):
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    head, _, body = data.partition(b'\r\n\r\n')
+    lines = head.decode(errors='ignore').split('\r\n')
+    headers = {}
+    for line in lines[1:]:
+        key, _, value = line.partition(':')
+        headers[key.strip().lower()] = value.strip()
+    if 'content-length' in headers:
+        want = int(headers['content-length'])
+        while len(body) < want:
+            chunk = s.recv(1 << 20)
+            if not chunk:
+                break
+            body += chunk
+    else:
+        while True:
+            chunk = s.recv(65536)
+            if not chunk:
+                break
+            body += chunk
+    status = int(lines[0].split(' ')[1]) if lines[0].startswith('HTTP/') else 0
+    return status, headers, body
+
+
+def fetch(method, path, body=b''):
+    s = socket.create_connection(('127.0.0.1', PORT), 10)
+    try:
+        head = '%s %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n' % (method, path)
+        if body:
+            head += 'Content-Type: application/octet-stream\r\nContent-Length: %d\r\n' % len(body)
+        s.sendall(head.encode() + b'\r\n' + body)
+        return recv_response(s)
+    finally:
+        s.close()
+
+
+def pid_of(body):
+    for line in body.decode(errors='ignore').splitlines():
+        if line.startswith('pid='):
+            return int(line[4:])
+    return -1
+
+
+def alive(pid):
+    try:
+        os.kill(pid, 0)
+    except ProcessLookupError:
+        return False
+    except PermissionError:
+        return True
+    # a zombie is not a worker
+    try:
+        with open('/proc/%d/stat' % pid) as f:
+            return f.read().rsplit(')', 1)[1].split()[0] != 'Z'
+    except OSError:
+        return True
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+
+    tmp = tempfile.mkdtemp(prefix='webserv_pool_')
+    www = os.path.join(tmp, 'www')
+    os.makedirs(www)
+    for name, text in SCRIPTS.items():
+        with open(os.path.join(www, name), 'w') as f:
+            f.write(text)
+    runner = os.path.join(ROOT, 'tools', 'cgi_worker.py')
+
+    config = os.path.join(tmp, 'pool.conf')
+    with open(config, 'w') as f:
+        f.write('server {\n'
+                '    listen %d;\n'
+                '    root %s;\n'
+                '    client_max_body_size 10000000;\n'
+                '    location /pool {\n'
+                '        root %s;\n'
+                '        allowed_methods GET POST;\n'
+                '        cgi_extension .py %s;\n'
+                '        cgi_workers 2;\n'
+                '        cgi_worker_max_requests 5;\n'
+                '        cgi_worker %s %s;\n'
+                '        cgi_timeout_ms 3000;\n'
+                '    }\n'
+                '    location /fork {\n'
+                '        root %s;\n'
+                '        allowed_methods GET POST;\n'
+                '        cgi_extension .py %s;\n'
+                '    }\n'
+                '}\n' % (PORT, www, www, PYTHON, PYTHON, runner, www, PYTHON))
+
+    failures = []
+
+    def check(name, ok, detail=''):
+        print(('ok   ' if ok else 'FAIL ') + name + ('' if ok else ' (%s)' % detail))
+        if not ok:
+            failures.append(name)
+
+    proc = subprocess.Popen([WEBSERV, config], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    seen = set()
+    try:
+        if not wait_for_port('127.0.0.1', PORT):
+            print('Server failed to start', file=sys.stderr)
+            return 2
+        time.sleep(0.5)  # let the interpreters come up
+
+        pids = []
+        for _ in range(4):
+            status, _, body = fetch('GET', '/pool/pid.py')
+            pids.append(pid_of(body) if status == 200 else -1)
+        seen.update(pids)
+        check('pool answers', -1 not in pids, pids)
+        check('at most two interpreters', len(set(pids)) <= 2, pids)
+        check('interpreters outlive the request', all(alive(p) for p in set(pids)), pids)
+
+        status, _, body = fetch('GET', '/fork/pid.py')
+        forked = pid_of(body)
+        time.sleep(0.2)
+        check('fork location still forks', status == 200 and forked not in pids
+              and not alive(forked), '%d %d' % (status, forked))
+
+        payload = os.urandom(200 * 1024)
+        status, _, body = fetch('POST', '/pool/echo.py?a=1', payload)
+        check('POST body and CGI variables',
+              status == 200 and b'method=POST' in body and b'query=a=1' in body
+              and ('md5=%s' % hashlib.md5(payload).hexdigest()).encode() in body
+              and ('length=%d' % len(payload)).encode() in body, '%d %r' % (status, body[:200]))
+
+        # 5 so far; 10 more cross the max_requests = 5 line on both workers
+        later = []
+        for _ in range(10):
+            status, _, body = fetch('GET', '/pool/pid.py')
+            later.append(pid_of(body) if status == 200 else -1)
+            time.sleep(0.05)
+        seen.update(later)
+        check('recycled after cgi_worker_max_requests',
+              -1 not in later and set(later) - set(pids), later)
+
+        status, _, _ = fetch('GET', '/pool/crash.py')
+        check('crashing script is 502', status == 502, status)
+        ok = True
+        for _ in range(4):
+            status, _, body = fetch('GET', '/pool/pid.py')
+            seen.add(pid_of(body))
+            ok = ok and status == 200
+        check('still serving after a crash', ok)
+
+        time.sleep(1.5)  # respawn backoff
+        status, _, body = fetch('GET', '/pool/pid.py')
+        victim = pid_of(body)
+        check('worker respawned', status == 200 and alive(victim), '%d %d' % (status, victim))
+
+        # a stopped worker misses its health probe and is replaced
+        os.kill(victim, signal.SIGSTOP)
+        time.sleep(4)
+        check('unresponsive worker killed', not alive(victim), victim)
+        ok = True
+        for _ in range(4):
+            status, _, body = fetch('GET', '/pool/pid.py')
+            seen.add(pid_of(body))
+            ok = ok and status == 200 and pid_of(body) != victim
+        check('still serving after the probe', ok)
+
+        # three at once on two workers: the third forks
+        results = []
+
+        def slow():
+            results.append(fetch('GET', '/pool/slow.py')[0])
+
+        threads = [threading.Thread(target=slow) for _ in range(3)]
+        t0 = time.time()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        check('fork fallback while the pool is busy',
+              results == [200, 200, 200] and time.time() - t0 < 2.5,
+              '%r after %.1fs' % (results, time.time() - t0))
+    finally:
+        try:
+            proc.terminate()
+            proc.wait()
+        except Exception:
+            pass
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    time.sleep(0.2)
+    left = [p for p in seen if p > 0 and alive(p)]
+    check('no worker outlives the server', not left, left)
+
+    if failures:
+        print('CGI pool tests failed: %s' % ', '.join(failures))
+        return 1
+    print('CGI pool tests passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
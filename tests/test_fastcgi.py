@@ -0,0 +1,319 @@
+#!/usr/bin/env python3
+"""
+Functional test for fastcgi_pass.
+
+Runs a small FastCGI responder (FCGI_KEEP_CONN aware, one thread per
+connection) on a unix socket in a temporary directory and a server on port
+18088 with three locations: /app (everything to the application), /mixed
+(only *.php, static files from disk) and /down (a socket nobody listens on).
+Checks the CGI variables the application gets, a POST body through STDIN
+records, Status and header pass-through, STDERR records kept out of the
+response, a 2 MiB streamed response, connection reuse across requests,
+502 for an unreachable application and 504 for one that doesn't answer
+within cgi_timeout_ms.
+
+This test uses only the Python standard library so it can run on most systems.
+"""
+import hashlib
+import os
+import shutil
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18088
+
+BEGIN_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT, STDERR = 1, 3, 4, 5, 6, 7
+BIG = 2 * 1024 * 1024
+
+
+def wait_for_port(host, port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            s = socket.create_connection((host, port), 0.5)
+            s.close()
+            return True
+        except Exception:
+            time.sleep(0.1)
+    return False
+
+
+def record(rtype, req_id, content=b''):
+    pad = (8 - len(content) % 8) % 8
+    return (struct.pack('>BBHHBB', 1, rtype, req_id, len(content), pad, 0)
+            + content + b'\0' * pad)
+
+
+def stream(rtype, req_id, data):
+    out = b''
+    for off in range(0, len(data), 65535):
+        out += record(rtype, req_id, data[off:off + 65535])
+    return out
+
+
+def parse_params(data):
+    params = {}
+    i = 0
+    while i < len(data):
+        lens = []
+        for _ in range(2):
+            if data[i] & 0x80:
+                lens.append(struct.unpack('>I', data[i:i + 4])[0] & 0x7fffffff)
+                i += 4
+            else:
+                lens.append(data[i])
+                i += 1
+        name = data[i:i + lens[0]].decode()
+        i += lens[0]
+        params[name] = data[i:i + lens[1]].decode()
+        i += lens[1]
+    return params
+
+
+class Responder(object):
+    """Answers by REQUEST_URI; counts accepted connections."""
+
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.bind(path)
+        self.sock.listen(16)
+        self.accepts = 0
+        self.last_params = {}
+        threading.Thread(target=self.serve, daemon=True).start()
+
+    def serve(self):
+        while True:
+            try:
+                conn, _ = self.sock.accept()
+            except OSError:
+                return
+            self.accepts += 1
+            threading.Thread(target=self.connection, args=(conn,), daemon=True).start()
+
+    def connection(self, conn):
+        buf = b''
+        params = b''
+        body = b''
+        keep = False
+        try:
+            while True:
+                while len(buf) < 8 or len(buf) < 8 + struct.unpack('>H', buf[4:6])[0] + buf[6]:
+                    chunk = conn.recv(65536)
+                    if not chunk:
+                        return
+                    buf += chunk
+                _, rtype, req_id, length, pad, _ = struct.unpack('>BBHHBB', buf[:8])
+                content = buf[8:8 + length]
+                buf = buf[8 + length + pad:]
+                if rtype == BEGIN_REQUEST:
+                    keep = bool(content[2] & 1)
+                    params, body = b'', b''
+                elif rtype == PARAMS:
+                    params += content
+                elif rtype == STDIN and content:
+                    body += content
+                elif rtype == STDIN:
+                    conn.sendall(self.respond(req_id, parse_params(params), body))
+                    if not keep:
+                        return
+        except OSError:
+            pass
+        finally:
+            conn.close()
+
+    def respond(self, req_id, env, body):
+        self.last_params = env
+        uri = env.get('REQUEST_URI', '')
+        out = b''
+        if uri.startswith('/app/slow'):
+            time.sleep(3)
+        if uri.startswith('/app/big'):
+            data = b'z' * BIG
+            head = 'Content-Type: application/octet-stream\r\nContent-Length: %d\r\n\r\n' % BIG
+        elif uri.startswith('/app/missing'):
+            data = b'nothing here\n'
+            head = 'Status: 404 Not Found\r\nContent-Length: %d\r\n\r\n' % len(data)
+        else:
+            if uri.startswith('/app/noisy'):
+                out += record(STDERR, req_id, b'[test app] a warning\n')
+            data = ('method=%s\nquery=%s\nscript=%s\nlength=%s\nmd5=%s\n' % (
+                env.get('REQUEST_METHOD'), env.get('QUERY_STRING'),
+                env.get('SCRIPT_FILENAME'), env.get('CONTENT_LENGTH', ''),
+                hashlib.md5(body).hexdigest())).encode()
+            head = ('Content-Type: text/plain\r\nX-App: fcgi\r\n'
+                    'Content-Length: %d\r\n\r\n' % len(data))
+        out += stream(STDOUT, req_id, head.encode() + data)
+        out += record(STDOUT, req_id)
+        out += record(END_REQUEST, req_id, struct.pack('>IB3x', 0, 0))
+        return out
+
+
+def recv_response(s):
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    head, _, body = data.partition(b'\r\n\r\n')
+    lines = head.decode(errors='ignore').split('\r\n')
+    headers = {}
+    for line in lines[1:]:
+        key, _, value = line.partition(':')
+        headers[key.strip().lower()] = value.strip()
+    if 'content-length' in headers:
+        want = int(headers['content-length'])
+        while len(body) < want:
+            chunk = s.recv(1 << 20)
+            if not chunk:
+                break
+            body += chunk
+    status = int(lines[0].split(' ')[1]) if lines[0].startswith('HTTP/') else 0
+    return status, headers, body
+
+
+def request(s, method, path, body=b''):
+    head = '%s %s HTTP/1.1\r\nHost: localhost\r\n' % (method, path)
+    if body:
+        head += 'Content-Type: application/octet-stream\r\nContent-Length: %d\r\n' % len(body)
+    s.sendall(head.encode() + b'\r\n' + body)
+    return recv_response(s)
+
+
+def fetch(method, path, body=b''):
+    s = socket.create_connection(('127.0.0.1', PORT), 10)
+    try:
+        return request(s, method, path, body)
+    finally:
+        s.close()
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+
+    tmp = tempfile.mkdtemp(prefix='webserv_fcgi_')
+    www = os.path.join(tmp, 'www')
+    os.makedirs(os.path.join(www, 'mixed'))
+    with open(os.path.join(www, 'mixed', 'static.txt'), 'w') as f:
+        f.write('from disk\n')
+    sock_path = os.path.join(tmp, 'app.sock')
+    app = Responder(sock_path)
+
+    config = os.path.join(tmp, 'fcgi.conf')
+    with open(config, 'w') as f:
+        f.write('server {\n'
+                '    listen %d;\n'
+                '    root %s;\n'
+                '    client_max_body_size 10000000;\n'
+                '    location /app {\n'
+                '        root %s;\n'
+                '        allowed_methods GET POST;\n'
+                '        fastcgi_pass unix:%s;\n'
+                '        cgi_timeout_ms 1000;\n'
+                '    }\n'
+                '    location /mixed {\n'
+                '        root %s/mixed;\n'
+                '        allowed_methods GET;\n'
+                '        cgi_extension .php /usr/bin/php-cgi;\n'
+                '        fastcgi_pass %s;\n'
+                '    }\n'
+                '    location /down {\n'
+                '        root %s;\n'
+                '        allowed_methods GET;\n'
+                '        fastcgi_pass unix:%s;\n'
+                '    }\n'
+                '}\n' % (PORT, www, www, sock_path, www, sock_path, www,
+                         os.path.join(tmp, 'nobody.sock')))
+
+    failures = []
+
+    def check(name, ok, detail=''):
+        print(('ok   ' if ok else 'FAIL ') + name + ('' if ok else ' (%s)' % detail))
+        if not ok:
+            failures.append(name)
+
+    proc = subprocess.Popen([WEBSERV, config], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port('127.0.0.1', PORT):
+            print('Server failed to start', file=sys.stderr)
+            return 2
+
+        status, headers, body = fetch('GET', '/app/hello?x=1&y=2')
+        check('GET reaches the application', status == 200 and b'method=GET' in body,
+              '%d %r' % (status, body[:80]))
+        check('query string', b'query=x=1&y=2' in body, body)
+        # the location prefix is stripped, as for any CGI: root + "/hello"
+        check('absolute SCRIPT_FILENAME', ('script=%s/hello\n' % www).encode() in body, body)
+        check('application header passed through', headers.get('x-app') == 'fcgi', headers)
+
+        payload = os.urandom(300 * 1024)
+        status, _, body = fetch('POST', '/app/upload', payload)
+        check('POST body through STDIN records',
+              status == 200 and ('md5=%s' % hashlib.md5(payload).hexdigest()).encode() in body
+              and ('length=%d' % len(payload)).encode() in body, '%d %r' % (status, body[:200]))
+
+        status, _, body = fetch('GET', '/app/missing')
+        check('Status header', status == 404 and body == b'nothing here\n', '%d %r' % (status, body))
+
+        status, _, body = fetch('GET', '/app/noisy')
+        check('STDERR kept out of the response', status == 200 and b'warning' not in body, body)
+
+        status, _, body = fetch('GET', '/app/big')
+        check('2 MiB streamed response', status == 200 and len(body) == BIG and body == b'z' * BIG,
+              '%d %d' % (status, len(body)))
+
+        before = app.accepts
+        s = socket.create_connection(('127.0.0.1', PORT), 10)
+        ok = True
+        for i in range(10):
+            status, _, body = request(s, 'GET', '/app/keep?n=%d' % i)
+            ok = ok and status == 200 and ('query=n=%d' % i).encode() in body
+        s.close()
+        check('keep-alive client, ten requests', ok)
+        check('application connection reused', app.accepts == before, '%d new connections'
+              % (app.accepts - before))
+
+        status, _, body = fetch('GET', '/mixed/page.php')
+        check('cgi_extension selects FastCGI',
+              status == 200 and ('script=%s/mixed/page.php\n' % www).encode() in body,
+              '%d %r' % (status, body[:80]))
+        status, _, body = fetch('GET', '/mixed/static.txt')
+        check('other files stay static', status == 200 and body == b'from disk\n', '%d %r' % (status, body))
+
+        status, _, _ = fetch('GET', '/down/x')
+        check('unreachable application is 502', status == 502, status)
+
+        t0 = time.time()
+        status, _, _ = fetch('GET', '/app/slow')
+        check('slow application is 504', status == 504 and time.time() - t0 < 2.9,
+              '%d after %.1fs' % (status, time.time() - t0))
+
+        status, _, body = fetch('GET', '/app/after')
+        check('still serving after the timeout', status == 200 and b'query=' in body, status)
+    finally:
+        try:
+            proc.terminate()
+            proc.wait()
+        except Exception:
+            pass
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    if failures:
+        print('FastCGI tests failed: %s' % ', '.join(failures))
+        return 1
+    print('FastCGI tests passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
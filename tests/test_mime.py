@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+"""
+Functional test for Content-Type selection on static files.
+
+Writes a config on port 18087 with a `types { ... }` block and a
+`types_file` (Apache format, with comments and type-only lines) and serves a
+temporary directory. Checks built-in types, case-insensitive extensions,
+types added and overridden by the config (including "+" in the type and a
+digit-led extension), the last-dot rule for dotted names and directories,
+and application/octet-stream for everything unknown.
+
+This test uses only the Python standard library so it can run on most systems.
+"""
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18087
+
+TYPES_FILE = """# Apache style: type, then extensions, one per line
+application/vnd.webserv-test\twsvt   wsvt2
+text/x-only-type
+model/gltf+json\t\tgltf
+"""
+
+# file name -> expected Content-Type
+EXPECTED = {
+    'index.html': 'text/html; charset=utf-8',
+    'PAGE.HTM': 'text/html; charset=utf-8',
+    'style.Css': 'text/css',
+    'font.woff2': 'font/woff2',
+    'clip.mp4': 'video/mp4',
+    'pack.7z': 'application/x-7z-compressed',
+    'scene.gltf': 'model/gltf+json',
+    'data.wsvt2': 'application/vnd.webserv-test',
+    'photo.png': 'image/x-test-png',
+    'doc.md': 'text/x-test-markdown',
+    'archive.tar.gz': 'application/gzip',
+    'noext': 'application/octet-stream',
+    'weird.unknownext': 'application/octet-stream',
+    'v1.2/readme': 'application/octet-stream',
+}
+
+
+def wait_for_port(host, port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            s = socket.create_connection((host, port), 0.5)
+            s.close()
+            return True
+        except Exception:
+            time.sleep(0.1)
+    return False
+
+
+def write_tree(tmp):
+    www = os.path.join(tmp, 'www')
+    os.makedirs(os.path.join(www, 'v1.2'))
+    for name in EXPECTED:
+        with open(os.path.join(www, name), 'w') as f:
+            f.write('x\n')
+    types_file = os.path.join(tmp, 'test.types')
+    with open(types_file, 'w') as f:
+        f.write(TYPES_FILE)
+    config = os.path.join(tmp, 'mime.conf')
+    with open(config, 'w') as f:
+        f.write('types_file %s;\n'
+                'types {\n'
+                '    image/x-test-png   png;\n'
+                '    # comments are fine in here\n'
+                '    text/x-test-markdown md;\n'
+                '}\n' % types_file)
+    return www, config
+
+
+def content_type(name):
+    s = socket.create_connection(('127.0.0.1', PORT), 5)
+    s.sendall(('GET /%s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n'
+               % name).encode())
+    data = b''
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    head = data.partition(b'\r\n\r\n')[0].decode(errors='ignore')
+    if not head.startswith('HTTP/1.1 200'):
+        return head.split('\r\n')[0]
+    for line in head.split('\r\n')[1:]:
+        key, _, value = line.partition(':')
+        if key.lower() == 'content-type':
+            return value.strip()
+    return None
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+
+    tmp = tempfile.mkdtemp(prefix='webserv_mime_')
+    www, config = write_tree(tmp)
+    failures = []
+
+    def check(name, got, expected):
+        ok = got == expected
+        print(('ok   ' if ok else 'FAIL ') + name + ('' if ok else ' (got %r)' % got))
+        if not ok:
+            failures.append(name)
+
+    # a "types" entry without extensions is a config error
+    bad = os.path.join(tmp, 'bad.conf')
+    with open(bad, 'w') as f:
+        f.write('types { text/plain; }\nserver { listen %d; root %s; }\n' % (PORT, www))
+    rc = subprocess.call([WEBSERV, bad], cwd=ROOT,
+                         stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=10)
+    check('types entry without extensions rejected', rc != 0, True)
+
+    with open(config, 'a') as f:
+        f.write('server {\n'
+                '    listen %d;\n'
+                '    root %s;\n'
+                '    location / {\n'
+                '        root %s;\n'
+                '        allowed_methods GET;\n'
+                '    }\n'
+                '}\n' % (PORT, www, www))
+    proc = subprocess.Popen([WEBSERV, config], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        if not wait_for_port('127.0.0.1', PORT):
+            print('Server failed to start', file=sys.stderr)
+            return 2
+        for name in sorted(EXPECTED):
+            check(name, content_type(name), EXPECTED[name])
+        # second hit comes from the file cache entry
+        check('cached entry keeps its type', content_type('scene.gltf'), 'model/gltf+json')
+    finally:
+        try:
+            proc.terminate()
+            proc.wait()
+        except Exception:
+            pass
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    if failures:
+        print('MIME tests failed: %s' % ', '.join(failures))
+        return 1
+    print('MIME tests passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
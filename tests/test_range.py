@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+"""
+Functional test for Range requests on static files.
+
+Starts the server with tests/test_config.conf on port 18081, writes a random
+file under `www/`, and checks single ranges (206 + Content-Range), suffix and
+open-ended ranges, multi-range multipart/byteranges, 416 for unsatisfiable
+ranges, and If-Range with a matching / stale validator.
+
+This test uses only the Python standard library so it can run on most systems.
+"""
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+CONFIG = os.path.join(os.path.dirname(__file__), 'test_config.conf')
+PORT = 18081
+NAME = 'test_range_target.bin'
+SIZE = 300000
+
+
+def wait_for_port(host, port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            s = socket.create_connection((host, port), 0.5)
+            s.close()
+            return True
+        except Exception:
+            time.sleep(0.1)
+    return False
+
+
+def request(headers, method='GET'):
+    s = socket.create_connection(('127.0.0.1', PORT), 5)
+    s.sendall(('%s /%s HTTP/1.1\r\nHost: localhost\r\n%sConnection: close\r\n\r\n'
+               % (method, NAME, headers)).encode())
+    data = b''
+    while True:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        data += chunk
+    s.close()
+    head, _, body = data.partition(b'\r\n\r\n')
+    return head.decode(errors='ignore'), body
+
+
+def split_byteranges(head, body):
+    boundary = re.search(r'boundary=(\S+)', head).group(1).encode()
+    parts = []
+    for raw in body.split(b'--' + boundary)[1:-1]:
+        part_head, _, part_body = raw.partition(b'\r\n\r\n')
+        parts.append((part_head.decode(errors='ignore'), part_body[:-2]))
+    return parts
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+
+    target = os.path.join(ROOT, 'www', NAME)
+    data = os.urandom(SIZE)
+    with open(target, 'wb') as f:
+        f.write(data)
+
+    proc = subprocess.Popen([WEBSERV, CONFIG], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    failures = []
+
+    def check(name, cond):
+        print(('ok   ' if cond else 'FAIL ') + name)
+        if not cond:
+            failures.append(name)
+
+    try:
+        if not wait_for_port('127.0.0.1', PORT, timeout=5.0):
+            print('Server failed to start', file=sys.stderr)
+            return 2
+
+        head, body = request('')
+        check('200 advertises Accept-Ranges',
+              head.startswith('HTTP/1.1 200') and 'Accept-Ranges: bytes' in head and body == data)
+        etag = re.search(r'ETag: (\S+)', head).group(1)
+        last_modified = re.search(r'Last-Modified: ([^\r\n]+)', head).group(1)
+
+        head, body = request('Range: bytes=100-199\r\n')
+        check('single range',
+              head.startswith('HTTP/1.1 206') and body == data[100:200]
+              and 'Content-Range: bytes 100-199/%d' % SIZE in head)
+
+        head, body = request('Range: bytes=-500\r\n')
+        check('suffix range', head.startswith('HTTP/1.1 206') and body == data[-500:])
+
+        head, body = request('Range: bytes=%d-\r\n' % (SIZE - 10))
+        check('open-ended range', head.startswith('HTTP/1.1 206') and body == data[-10:])
+
+        head, body = request('Range: bytes=%d-\r\n' % SIZE)
+        check('416 past the end',
+              head.startswith('HTTP/1.1 416') and 'Content-Range: bytes */%d' % SIZE in head)
+
+        head, body = request('Range: bytes=0-9, 200000-200009, -5\r\n')
+        expected = [(0, 9), (200000, 200009), (SIZE - 5, SIZE - 1)]
+        ok = head.startswith('HTTP/1.1 206') and 'multipart/byteranges' in head
+        length = int(re.search(r'Content-Length: (\d+)', head).group(1))
+        ok = ok and length == len(body)
+        parts = split_byteranges(head, body) if ok else []
+        ok = ok and len(parts) == len(expected)
+        for (part_head, part_body), (first, last) in zip(parts, expected):
+            ok = ok and part_body == data[first:last + 1]
+            ok = ok and 'Content-Range: bytes %d-%d/%d' % (first, last, SIZE) in part_head
+        check('multipart/byteranges', ok)
+
+        head, body = request('Range: bytes=0-0\r\nIf-Range: %s\r\n' % etag)
+        check('If-Range current ETag', head.startswith('HTTP/1.1 206') and body == data[:1])
+
+        head, body = request('Range: bytes=0-0\r\nIf-Range: %s\r\n' % last_modified)
+        check('If-Range current date', head.startswith('HTTP/1.1 206') and body == data[:1])
+
+        head, body = request('Range: bytes=0-0\r\nIf-Range: "stale"\r\n')
+        check('If-Range stale ETag -> 200', head.startswith('HTTP/1.1 200') and body == data)
+
+        head, body = request('Range: lines=1-2\r\n')
+        check('unknown unit ignored', head.startswith('HTTP/1.1 200') and body == data)
+    finally:
+        try:
+            proc.terminate()
+            proc.wait()
+        except Exception:
+            pass
+        os.unlink(target)
+
+    if failures:
+        print('Range tests failed: %s' % ', '.join(failures))
+        return 1
+    print('Range tests passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
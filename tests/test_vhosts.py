@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""
+Functional test for name-based virtual hosts.
+
+Writes a config with four server blocks on port 18085 (one socket) and one on
+18086, each serving its own index.html from a temporary directory, and checks
+that Host picks the block: exact names, case and a trailing dot, ":port",
+"*.suffix" wildcards (longest wins), nginx-style ".name", the first block as
+the default for a missing or unknown Host, and a keep-alive connection
+switching sites between requests.
+
+This test uses only the Python standard library so it can run on most systems.
+"""
+import os
+import shutil
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), '..'))
+WEBSERV = os.path.join(ROOT, 'webserv')
+PORT = 18085
+OTHER_PORT = 18086
+
+# (site, port, server_name values)
+SITES = [
+    ('default', PORT, 'default.test'),
+    ('alpha', PORT, 'alpha.test www.alpha.test'),
+    ('wild', PORT, '*.wild.test'),
+    ('deep', PORT, '*.deep.wild.test .both.test'),
+    ('other', OTHER_PORT, 'alpha.test'),
+]
+
+
+def wait_for_port(host, port, timeout=5.0):
+    end = time.time() + timeout
+    while time.time() < end:
+        try:
+            s = socket.create_connection((host, port), 0.5)
+            s.close()
+            return True
+        except Exception:
+            time.sleep(0.1)
+    return False
+
+
+def write_config(tmp):
+    blocks = []
+    for site, port, names in SITES:
+        root = os.path.join(tmp, site)
+        os.mkdir(root)
+        with open(os.path.join(root, 'index.html'), 'w') as f:
+            f.write('site=%s\n' % site)
+        blocks.append('server {\n'
+                      '    listen %d;\n'
+                      '    server_name %s;\n'
+                      '    root %s;\n'
+                      '    location / {\n'
+                      '        root %s;\n'
+                      '        index index.html;\n'
+                      '        allowed_methods GET;\n'
+                      '    }\n'
+                      '}\n' % (port, names, root, root))
+    path = os.path.join(tmp, 'vhosts.conf')
+    with open(path, 'w') as f:
+        f.write('\n'.join(blocks))
+    return path
+
+
+def read_response(s):
+    data = b''
+    while b'\r\n\r\n' not in data:
+        chunk = s.recv(65536)
+        if not chunk:
+            return '', b''
+        data += chunk
+    head, _, body = data.partition(b'\r\n\r\n')
+    head = head.decode(errors='ignore')
+    length = 0
+    for line in head.split('\r\n')[1:]:
+        name, _, value = line.partition(':')
+        if name.lower() == 'content-length':
+            length = int(value.strip())
+    while len(body) < length:
+        chunk = s.recv(65536)
+        if not chunk:
+            break
+        body += chunk
+    return head, body
+
+
+def site(host_line, port=PORT):
+    s = socket.create_connection(('127.0.0.1', port), 5)
+    s.sendall(('GET / HTTP/1.1\r\n%sConnection: close\r\n\r\n' % host_line).encode())
+    head, body = read_response(s)
+    s.close()
+    if not head.startswith('HTTP/1.1 200'):
+        return head.split('\r\n')[0]
+    return body.decode(errors='ignore').strip().replace('site=', '')
+
+
+def run():
+    if not os.path.exists(WEBSERV):
+        print('Error: compiled binary ./webserv not found. Run `make` first.', file=sys.stderr)
+        return 2
+
+    tmp = tempfile.mkdtemp(prefix='webserv_vhosts_')
+    config = write_config(tmp)
+    proc = subprocess.Popen([WEBSERV, config], cwd=ROOT,
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    failures = []
+
+    def check(name, got, expected):
+        ok = got == expected
+        print(('ok   ' if ok else 'FAIL ') + name + ('' if ok else ' (got %r)' % got))
+        if not ok:
+            failures.append(name)
+
+    try:
+        if not (wait_for_port('127.0.0.1', PORT) and wait_for_port('127.0.0.1', OTHER_PORT)):
+            print('Server failed to start', file=sys.stderr)
+            return 2
+
+        check('exact name', site('Host: alpha.test\r\n'), 'alpha')
+        check('second name', site('Host: www.alpha.test\r\n'), 'alpha')
+        check('case and trailing dot', site('Host: ALPHA.Test.\r\n'), 'alpha')
+        check('with :port', site('Host: alpha.test:%d\r\n' % PORT), 'alpha')
+        check('wildcard', site('Host: a.wild.test\r\n'), 'wild')
+        check('wildcard, two labels', site('Host: a.b.wild.test\r\n'), 'wild')
+        check('wildcard is not the bare name', site('Host: wild.test\r\n'), 'default')
+        check('longest wildcard wins', site('Host: x.deep.wild.test\r\n'), 'deep')
+        check('.name: bare', site('Host: both.test\r\n'), 'deep')
+        check('.name: subdomain', site('Host: www.both.test\r\n'), 'deep')
+        check('unknown host -> first block', site('Host: nobody.test\r\n'), 'default')
+        check('IP literal -> first block', site('Host: 127.0.0.1:%d\r\n' % PORT), 'default')
+        check('no Host (HTTP/1.1) rejected or default',
+              site('') in ('default', 'HTTP/1.1 400 Bad Request'), True)
+        check('same name, other port', site('Host: alpha.test\r\n', OTHER_PORT), 'other')
+
+        # one connection, a different site per request
+        s = socket.create_connection(('127.0.0.1', PORT), 5)
+        seen = []
+        for host in ('alpha.test', 'a.wild.test', 'nobody.test', 'both.test'):
+            s.sendall(('GET / HTTP/1.1\r\nHost: %s\r\n\r\n' % host).encode())
+            head, body = read_response(s)
+            seen.append(body.decode(errors='ignore').strip().replace('site=', ''))
+        s.close()
+        check('keep-alive switches sites', seen, ['alpha', 'wild', 'default', 'deep'])
+    finally:
+        try:
+            proc.terminate()
+            proc.wait()
+        except Exception:
+            pass
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    if failures:
+        print('Virtual host tests failed: %s' % ', '.join(failures))
+        return 1
+    print('Virtual host tests passed')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(run())
@@ -0,0 +1,198 @@
+#!/usr/bin/env python3
+"""
+Long-lived CGI interpreter for webserv's `cgi_workers`.
+
+webserv starts this with fd 0 a listening unix socket holding one queued
+connection, and sends it requests over that connection as FastCGI records
+(responder role, one request at a time, FCGI_KEEP_CONN). Each request is a
+plain CGI script run the CGI way (environment from the params, body on
+stdin, headers and body on stdout), but Python scripts run inside this
+interpreter: no fork, no exec, no interpreter start-up, and the compiled
+script and the modules it imports stay cached between requests. Scripts of
+any other kind are still run as a child process.
+
+    location /cgi-bin {
+        cgi_extension .py /usr/bin/python3;
+        cgi_workers 4;
+        cgi_worker_max_requests 1000;
+        cgi_worker /usr/bin/python3 tools/cgi_worker.py;
+    }
+
+Only uses the Python standard library.
+"""
+import builtins
+import io
+import os
+import socket
+import struct
+import subprocess
+import sys
+import traceback
+
+BEGIN_REQUEST, ABORT_REQUEST, END_REQUEST, PARAMS, STDIN, STDOUT, STDERR = 1, 2, 3, 4, 5, 6, 7
+GET_VALUES, GET_VALUES_RESULT, UNKNOWN_TYPE = 9, 10, 11
+KEEP_CONN = 1
+CHUNK = 32768
+
+HOME = os.getcwd()
+BASE_ENV = dict(os.environ)
+_code_cache = {}
+
+
+def record(rtype, req_id, content=b''):
+    pad = (8 - len(content) % 8) % 8
+    return (struct.pack('>BBHHBB', 1, rtype, req_id, len(content), pad, 0)
+            + content + b'\0' * pad)
+
+
+def stream(rtype, req_id, data):
+    out = [record(rtype, req_id, data[off:off + CHUNK])
+           for off in range(0, len(data), CHUNK)]
+    out.append(record(rtype, req_id))
+    return b''.join(out)
+
+
+def pair_len(n):
+    return bytes([n]) if n < 128 else struct.pack('>I', n | 0x80000000)
+
+
+def read_pairs(data):
+    pairs = {}
+    i = 0
+    while i < len(data):
+        lens = []
+        for _ in range(2):
+            if data[i] & 0x80:
+                lens.append(struct.unpack('>I', data[i:i + 4])[0] & 0x7fffffff)
+                i += 4
+            else:
+                lens.append(data[i])
+                i += 1
+        name = data[i:i + lens[0]]
+        i += lens[0]
+        pairs[name.decode('latin-1')] = data[i:i + lens[1]].decode('latin-1')
+        i += lens[1]
+    return pairs
+
+
+def get_values_result(content):
+    known = {'FCGI_MAX_CONNS': '1', 'FCGI_MAX_REQS': '1', 'FCGI_MPXS_CONNS': '0'}
+    body = b''
+    for name in read_pairs(content):
+        if name in known:
+            value = known[name].encode()
+            body += pair_len(len(name)) + pair_len(len(value)) + name.encode() + value
+    return record(GET_VALUES_RESULT, 0, body)
+
+
+def compiled(path):
+    mtime = os.stat(path).st_mtime_ns
+    hit = _code_cache.get(path)
+    if hit and hit[0] == mtime:
+        return hit[1]
+    with open(path, 'rb') as f:
+        code = compile(f.read(), path, 'exec')
+    _code_cache[path] = (mtime, code)
+    return code
+
+
+def run_python(path, env, body):
+    """Runs the script in this interpreter; returns (stdout, stderr)."""
+    out, err = io.BytesIO(), io.BytesIO()
+    saved = sys.stdin, sys.stdout, sys.stderr, sys.argv
+    sys.stdin = io.TextIOWrapper(io.BytesIO(body), encoding='utf-8', errors='surrogateescape')
+    sys.stdout = io.TextIOWrapper(out, encoding='utf-8', errors='surrogateescape',
+                                  write_through=True)
+    sys.stderr = io.TextIOWrapper(err, encoding='utf-8', errors='replace', write_through=True)
+    sys.argv = [path]
+    os.environ.clear()
+    os.environ.update(env)
+    try:
+        os.chdir(os.path.dirname(path) or '.')
+        exec(compiled(path), {'__name__': '__main__', '__file__': path,
+                              '__builtins__': builtins})
+    except SystemExit:
+        pass
+    except BaseException:
+        traceback.print_exc()
+        if not out.getvalue():
+            sys.stdout.write('Status: 500 Internal Server Error\r\n'
+                             'Content-Type: text/plain\r\n\r\nCGI script failed\n')
+    finally:
+        sys.stdout.flush()
+        sys.stderr.flush()
+        sys.stdin, sys.stdout, sys.stderr, sys.argv = saved
+        os.environ.clear()
+        os.environ.update(BASE_ENV)
+        os.chdir(HOME)
+    return out.getvalue(), err.getvalue()
+
+
+def run_child(path, env, body):
+    try:
+        done = subprocess.run([path], input=body, env=env, cwd=os.path.dirname(path) or '.',
+                              stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        return done.stdout, done.stderr
+    except OSError as e:
+        return (b'Status: 502 Bad Gateway\r\nContent-Type: text/plain\r\n\r\n',
+                ('%s: %s\n' % (path, e)).encode())
+
+
+def respond(req_id, params, body):
+    path = params.get('SCRIPT_FILENAME', '')
+    if path.endswith('.py'):
+        out, err = run_python(path, params, body)
+    else:
+        out, err = run_child(path, params, body)
+    data = b''
+    if err:
+        data += stream(STDERR, req_id, err)
+    data += stream(STDOUT, req_id, out)
+    return data + record(END_REQUEST, req_id, struct.pack('>IB3x', 0, 0))
+
+
+def serve(conn):
+    buf = b''
+    params, body, keep, req_id = b'', b'', False, 0
+    while True:
+        while len(buf) < 8 or len(buf) < 8 + struct.unpack('>H', buf[4:6])[0] + buf[6]:
+            chunk = conn.recv(65536)
+            if not chunk:
+                return
+            buf += chunk
+        _, rtype, rid, length, pad, _ = struct.unpack('>BBHHBB', buf[:8])
+        content = buf[8:8 + length]
+        buf = buf[8 + length + pad:]
+        if rid == 0:
+            if rtype == GET_VALUES:
+                conn.sendall(get_values_result(content))
+            else:
+                conn.sendall(record(UNKNOWN_TYPE, 0, bytes([rtype]) + b'\0' * 7))
+        elif rtype == BEGIN_REQUEST:
+            params, body, req_id = b'', b'', rid
+            keep = bool(content[2] & KEEP_CONN)
+        elif rtype == PARAMS:
+            params += content
+        elif rtype == STDIN and content:
+            body += content
+        elif rtype == STDIN:
+            conn.sendall(respond(req_id, read_pairs(params), body))
+            if not keep:
+                return
+        elif rtype == ABORT_REQUEST:
+            conn.sendall(record(END_REQUEST, rid, struct.pack('>IB3x', 1, 0)))
+
+
+def main():
+    listener = socket.socket(fileno=0)
+    conn, _ = listener.accept()
+    listener.close()
+    try:
+        serve(conn)
+    except OSError:
+        pass
+    conn.close()
+
+
+if __name__ == '__main__':
+    main()